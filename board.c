@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "mpi.h"
+#include "roadmap.h"
+#include "code.h"
+#include "partition.h"
+#include "board.h"
+
+static struct RoadBoardSegment *getOwnSegment(struct RoadBoard *);
+static struct RoadBoardSegment *getJunctionSegment(struct RoadBoard *, int);
+static void layoutSegment(struct RoadBoardSegment *, int, int, char *);
+static void beginPublish(struct RoadBoardSegment *);
+static void endPublish(struct RoadBoardSegment *);
+static uint32_t beginRead(const struct RoadBoardSegment *);
+static int endRead(const struct RoadBoardSegment *, uint32_t);
+static void refreshReplica(struct RoadBoard *, int);
+
+/**
+ * Creates the board. Every map actor allocates its segment, sized by the junctions and roads it owns, in one node
+ * level MPI-3 shared memory window, initialises it to the maximum road speeds, and every process on the same node
+ * attaches to it. The map actors also expose their segments in an RMA window over MPI_COMM_WORLD, from which
+ * processes on other nodes copy them into private replicas. This is collective over MPI_COMM_WORLD, so it must be
+ * called by every process before the process pool is initialised
+ **/
+void createRoadBoard(const struct RoadTopology *topology, const struct MapPartition *partition, struct RoadBoard *board)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    char isMap = rank >= MAP_ACTOR_RANK && rank < MAP_ACTOR_RANK + NUM_MAP_ACTORS;
+    board->topology = topology;
+    board->partition = partition;
+    board->numSegments = NUM_MAP_ACTORS;
+    board->segments = (struct RoadBoardSegment *)malloc(sizeof(struct RoadBoardSegment) * NUM_MAP_ACTORS);
+    for (int m = 0; m < NUM_MAP_ACTORS; m++)
+    {
+        int num_junctions = partition->partOffsets[m + 1] - partition->partOffsets[m];
+        board->segments[m].size = sizeof(struct RoadBoardHeader) + sizeof(int32_t) * ((size_t)partition->partRoads[m] + 2 * (size_t)num_junctions);
+    }
+
+    // 每个map演员在节点共享内存中分配自己的段
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &board->nodeComm);
+    char *base;
+    MPI_Win_allocate_shared(isMap ? board->segments[rank - MAP_ACTOR_RANK].size : 0, 1, MPI_INFO_NULL, board->nodeComm, &base, &board->sharedWindow);
+
+    // 和本进程在同一个节点上的map演员的段直接读取，其他节点上的map演员的段读取私有的副本
+    MPI_Group worldGroup, nodeGroup;
+    MPI_Comm_group(MPI_COMM_WORLD, &worldGroup);
+    MPI_Comm_group(board->nodeComm, &nodeGroup);
+    for (int m = 0; m < NUM_MAP_ACTORS; m++)
+    {
+        struct RoadBoardSegment *segment = &board->segments[m];
+        int mapRank = MAP_ACTOR_RANK + m, mapNodeRank;
+        MPI_Group_translate_ranks(worldGroup, 1, &mapRank, nodeGroup, &mapNodeRank);
+        segment->local = mapNodeRank != MPI_UNDEFINED;
+        segment->lastRefresh = -1;
+        char *segmentBase;
+        if (segment->local)
+        {
+            MPI_Aint segmentSize;
+            int dispUnit;
+            MPI_Win_shared_query(board->sharedWindow, mapNodeRank, &segmentSize, &dispUnit, &segmentBase);
+        }
+        else
+        {
+            segmentBase = (char *)malloc(segment->size);
+        }
+        layoutSegment(segment, partition->partOffsets[m + 1] - partition->partOffsets[m], partition->partRoads[m], segmentBase);
+    }
+    MPI_Group_free(&worldGroup);
+    MPI_Group_free(&nodeGroup);
+
+    struct RoadBoardSegment *own = isMap ? getOwnSegment(board) : NULL;
+    if (own != NULL)
+    {
+        int part = rank - MAP_ACTOR_RANK, first = partition->partOffsets[part];
+        own->header->sequence = 0;
+        own->header->num_junctions = partition->partOffsets[part + 1] - first;
+        own->header->num_roads = partition->partRoads[part];
+        own->header->minute = 0;
+        for (int i = 0; i < own->header->num_junctions; i++)
+        {
+            int junction = partition->partJunctions[first + i];
+            for (int road = topology->roadOffsets[junction]; road < topology->roadOffsets[junction + 1]; road++)
+            {
+                own->roadSpeed[partition->roadIndex[road]] = topology->roadMaxSpeed[road];
+            }
+        }
+        memset(own->junctionVehicles, 0, sizeof(int32_t) * own->header->num_junctions);
+        memset(own->lightRoad, 0, sizeof(int32_t) * own->header->num_junctions);
+    }
+    MPI_Win_create(own != NULL ? (void *)own->header : NULL, own != NULL ? own->size : 0, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &board->remoteWindow);
+
+    // 确保其他进程在map演员初始化之后才读取
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * Releases the board created by createRoadBoard, collective over MPI_COMM_WORLD
+ **/
+void freeRoadBoard(struct RoadBoard *board)
+{
+    MPI_Win_free(&board->remoteWindow);
+    for (int m = 0; m < board->numSegments; m++)
+    {
+        if (!board->segments[m].local)
+            free(board->segments[m].header);
+    }
+    MPI_Win_free(&board->sharedWindow);
+    MPI_Comm_free(&board->nodeComm);
+    free(board->segments);
+    board->segments = NULL;
+}
+
+/**
+ * Publishes everything that changed since the last call in one write section, so readers never see the speeds of a
+ * junction's roads from two different updates. The map state and the segment share the partition's local indices
+ **/
+void publishRoadState(struct RoadBoard *board, struct RoadMapState *state)
+{
+    if (state->numDirtyRoads == 0 && state->numDirtyJunctions == 0)
+        return;
+
+    struct RoadBoardSegment *segment = getOwnSegment(board);
+    beginPublish(segment);
+    for (int i = 0; i < state->numDirtyRoads; i++)
+    {
+        int road = state->dirtyRoads[i];
+        __atomic_store_n(&segment->roadSpeed[road], state->currentSpeed[road], __ATOMIC_RELAXED);
+        state->roadDirty[road] = 0;
+    }
+    for (int i = 0; i < state->numDirtyJunctions; i++)
+    {
+        int junction = state->dirtyJunctions[i];
+        __atomic_store_n(&segment->junctionVehicles[junction], state->num_vehicles[junction], __ATOMIC_RELAXED);
+        state->junctionDirty[junction] = 0;
+    }
+    endPublish(segment);
+    state->numDirtyRoads = 0;
+    state->numDirtyJunctions = 0;
+}
+
+/**
+ * Publishes the traffic lights of the junctions the map actor owns for the simulated minute
+ **/
+void publishTrafficLights(struct RoadBoard *board, const struct RoadMapState *state, int elapsed_mins)
+{
+    struct RoadBoardSegment *segment = getOwnSegment(board);
+    beginPublish(segment);
+    for (int i = 0; i < state->num_junctions; i++)
+    {
+        __atomic_store_n(&segment->lightRoad[i], state->trafficLightsRoadEnabled[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&segment->header->minute, elapsed_mins, __ATOMIC_RELAXED);
+    endPublish(segment);
+}
+
+/**
+ * Copies the current speeds of the roads leaving a junction, retrying if the map actor published in between
+ **/
+void readRoadSpeeds(struct RoadBoard *board, int junction, int *speeds)
+{
+    const struct RoadBoardSegment *segment = getJunctionSegment(board, junction);
+    int numRoads = board->topology->roadOffsets[junction + 1] - board->topology->roadOffsets[junction];
+    if (numRoads == 0)
+        return;
+    int first = board->partition->roadIndex[board->topology->roadOffsets[junction]];
+    uint32_t sequence;
+    do
+    {
+        sequence = beginRead(segment);
+        for (int i = 0; i < numRoads; i++)
+        {
+            speeds[i] = __atomic_load_n(&segment->roadSpeed[first + i], __ATOMIC_RELAXED);
+        }
+    } while (!endRead(segment, sequence));
+}
+
+/**
+ * Returns the number of vehicles at a junction, a single value is always read consistently
+ **/
+int readJunctionVehicles(struct RoadBoard *board, int junction)
+{
+    return __atomic_load_n(&getJunctionSegment(board, junction)->junctionVehicles[board->partition->junctionIndex[junction]], __ATOMIC_RELAXED);
+}
+
+/**
+ * Returns the offset of the road enabled by a junction's traffic lights
+ **/
+int readTrafficLights(struct RoadBoard *board, int junction)
+{
+    return __atomic_load_n(&getJunctionSegment(board, junction)->lightRoad[board->partition->junctionIndex[junction]], __ATOMIC_RELAXED);
+}
+
+/**
+ * Segment the calling map actor publishes into
+ **/
+static struct RoadBoardSegment *getOwnSegment(struct RoadBoard *board)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return &board->segments[rank - MAP_ACTOR_RANK];
+}
+
+/**
+ * Segment of the map actor owning the junction, a replica is refreshed first if it is older than a simulated minute
+ **/
+static struct RoadBoardSegment *getJunctionSegment(struct RoadBoard *board, int junction)
+{
+    int m = board->partition->junctionOwner[junction] - MAP_ACTOR_RANK;
+    if (!board->segments[m].local)
+        refreshReplica(board, m);
+    return &board->segments[m];
+}
+
+/**
+ * Points the header and arrays of a segment holding this many junctions and roads into one block of memory
+ **/
+static void layoutSegment(struct RoadBoardSegment *segment, int num_junctions, int num_roads, char *base)
+{
+    segment->header = (struct RoadBoardHeader *)base;
+    int32_t *p = (int32_t *)(base + sizeof(struct RoadBoardHeader));
+    segment->roadSpeed = p;
+    p += num_roads;
+    segment->junctionVehicles = p;
+    p += num_junctions;
+    segment->lightRoad = p;
+}
+
+/**
+ * Seqlock write side, only the owning map actor writes a segment so the sequence does not need an atomic increment
+ **/
+static void beginPublish(struct RoadBoardSegment *segment)
+{
+    uint32_t sequence = __atomic_load_n(&segment->header->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&segment->header->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void endPublish(struct RoadBoardSegment *segment)
+{
+    uint32_t sequence = __atomic_load_n(&segment->header->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&segment->header->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Seqlock read side, waits while a publish is in progress and returns the sequence the read started at
+ **/
+static uint32_t beginRead(const struct RoadBoardSegment *segment)
+{
+    uint32_t sequence;
+    do
+    {
+        sequence = __atomic_load_n(&segment->header->sequence, __ATOMIC_ACQUIRE);
+    } while (sequence & 1);
+    return sequence;
+}
+
+// Returns zero if the map actor published while reading, in which case the read must be repeated
+static int endRead(const struct RoadBoardSegment *segment, uint32_t sequence)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&segment->header->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+/**
+ * Copies a map actor's segment into the private replica if it is older than a simulated minute. The segment only holds
+ * what the map actor owns, and it is fetched between two reads of the sequence and fetched again if the map actor was
+ * publishing
+ **/
+static void refreshReplica(struct RoadBoard *board, int m)
+{
+    struct RoadBoardSegment *segment = &board->segments[m];
+    double now = MPI_Wtime();
+    if (segment->lastRefresh >= 0 && now - segment->lastRefresh < MIN_LENGTH_SECONDS)
+        return;
+
+    int mapRank = MAP_ACTOR_RANK + m;
+    uint32_t before, after;
+    MPI_Win_lock(MPI_LOCK_SHARED, mapRank, 0, board->remoteWindow);
+    while (1 == 1)
+    {
+        MPI_Get(&before, 1, MPI_UINT32_T, mapRank, 0, 1, MPI_UINT32_T, board->remoteWindow);
+        MPI_Win_flush(mapRank, board->remoteWindow);
+        if (before & 1)
+            continue;
+        MPI_Get(segment->header, segment->size, MPI_BYTE, mapRank, 0, segment->size, MPI_BYTE, board->remoteWindow);
+        MPI_Win_flush(mapRank, board->remoteWindow);
+        MPI_Get(&after, 1, MPI_UINT32_T, mapRank, 0, 1, MPI_UINT32_T, board->remoteWindow);
+        MPI_Win_flush(mapRank, board->remoteWindow);
+        if (before == after)
+            break;
+    }
+    MPI_Win_unlock(mapRank, board->remoteWindow);
+    segment->lastRefresh = now;
+}
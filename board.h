@@ -0,0 +1,56 @@
+#ifndef BOARD_H_
+#define BOARD_H_
+
+#include <stdint.h>
+#include "mpi.h"
+#include "roadmap.h"
+
+struct RoadMapState;
+struct MapPartition;
+
+// Header of a map actor's board segment, the arrays follow it in the order current road speeds, junction occupancy and
+// the road enabled by each junction's traffic lights. The sequence is odd while the map actor is publishing
+struct RoadBoardHeader {
+	uint32_t sequence;
+	int32_t num_junctions, num_roads;
+	int32_t minute;
+};
+
+// Each map actor publishes into its own segment, which only holds the junctions and roads the map actor owns and is
+// indexed by the partition's local indices. Processes on the map actor's node read the segment directly through node
+// shared memory, processes on other nodes read a private replica refreshed over RMA once per simulated minute
+struct RoadBoardSegment {
+	char local;
+	size_t size;
+	struct RoadBoardHeader *header;
+	int32_t *roadSpeed, *junctionVehicles, *lightRoad;
+	double lastRefresh;
+};
+
+// Read mostly view of the map actors' state, reads go to the segment of the map actor owning the junction
+struct RoadBoard {
+	const struct RoadTopology *topology;
+	const struct MapPartition *partition;
+	int numSegments;
+	struct RoadBoardSegment *segments;
+	MPI_Win sharedWindow, remoteWindow;
+	MPI_Comm nodeComm;
+};
+
+// Collectively creates the board of the topology, called by every process before the pool starts
+void createRoadBoard(const struct RoadTopology *, const struct MapPartition *, struct RoadBoard *);
+// Collectively frees the board
+void freeRoadBoard(struct RoadBoard *);
+// Called by the map actor, publishes the speeds of the dirty roads and the occupancy of the dirty junctions, then
+// empties both dirty sets
+void publishRoadState(struct RoadBoard *, struct RoadMapState *);
+// Called by the map actor when the minute changes, publishes the traffic lights of every junction
+void publishTrafficLights(struct RoadBoard *, const struct RoadMapState *, int);
+// Copies the current speeds of the roads leaving a junction, in the order of the junction's roads
+void readRoadSpeeds(struct RoadBoard *, int, int *);
+// Returns the number of vehicles at a junction
+int readJunctionVehicles(struct RoadBoard *, int);
+// Returns the offset of the road enabled by a junction's traffic lights among the junction's roads
+int readTrafficLights(struct RoadBoard *, int);
+
+#endif /* BOARD_H_ */
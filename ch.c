@@ -0,0 +1,651 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mpi.h"
+#include "roadmap.h"
+#include "code.h"
+#include "function.h"
+#include "heap.h"
+#include "ch.h"
+
+// Witness searches give up after settling this many junctions, which may add a few unnecessary shortcuts
+#define CH_WITNESS_SETTLE_LIMIT 500
+
+// Growable list of the roads and shortcuts leaving (or entering) a junction during contraction
+struct EdgeList
+{
+    int size, capacity;
+    int *nodes;
+    int64_t *costs;
+};
+
+// Internal state of the contraction
+struct ContractionState
+{
+    int num_junctions;
+    struct EdgeList *out, *in;
+    char *contracted;
+    int *contractedNeighbours;
+    int64_t *priority;
+    int64_t *dist;
+    int *touched;
+    int numTouched;
+    struct IndexedHeap witnessHeap;
+};
+
+// Mapping of the hierarchy file, shared between all processes on a node by the page cache
+static void *mappedBase = NULL;
+static size_t mappedSize = 0;
+
+static int addOrLowerEdge(struct EdgeList *, int, int64_t);
+static void addShortcut(struct ContractionState *, int, int, int64_t);
+static void witnessSearch(struct ContractionState *, int, int, int64_t);
+static void resetWitnessSearch(struct ContractionState *);
+static int contractJunction(struct ContractionState *, int, int);
+static int64_t computePriority(struct ContractionState *, int);
+static size_t getHierarchySize(int32_t, int32_t, int32_t);
+static void layoutHierarchy(struct ContractionHierarchy *, char *);
+static int checkHierarchy(const struct ContractionHierarchy *);
+static void touchJunction(struct HierarchyQuery *, int);
+
+/**
+ * Builds the contraction hierarchy. Junctions are contracted in order of their edge difference (shortcuts needed
+ * minus roads removed) plus the number of already contracted neighbours, with priorities updated lazily and for
+ * the neighbours of each contracted junction. A shortcut u->x replaces u->v->x unless a witness search finds a
+ * route from u to x avoiding v that costs no more
+ **/
+void buildContractionHierarchy(const struct RoadTopology *topology, struct ContractionHierarchy *hierarchy)
+{
+    int num_junctions = topology->num_junctions;
+    struct ContractionState state;
+    state.num_junctions = num_junctions;
+    state.out = (struct EdgeList *)calloc(num_junctions, sizeof(struct EdgeList));
+    state.in = (struct EdgeList *)calloc(num_junctions, sizeof(struct EdgeList));
+    state.contracted = (char *)calloc(num_junctions, sizeof(char));
+    state.contractedNeighbours = (int *)calloc(num_junctions, sizeof(int));
+    state.priority = (int64_t *)malloc(sizeof(int64_t) * num_junctions);
+    state.dist = (int64_t *)malloc(sizeof(int64_t) * num_junctions);
+    state.touched = (int *)malloc(sizeof(int) * num_junctions);
+    state.numTouched = 0;
+    for (int i = 0; i < num_junctions; i++)
+    {
+        state.dist[i] = ROUTE_INFINITY;
+    }
+
+    // 用最大速度下的行驶代价初始化图，平行的道路只保留代价最小的一条
+    for (int road = 0; road < topology->num_roads; road++)
+    {
+        int from = topology->roadFrom[road], to = topology->roadTo[road];
+        if (from != to)
+            addShortcut(&state, from, to, getTravelCost(topology->roadLength[road], topology->roadMaxSpeed[road]));
+    }
+
+    heapInit(&state.witnessHeap, num_junctions, state.dist);
+    struct IndexedHeap order;
+    heapInit(&order, num_junctions, state.priority);
+    for (int i = 0; i < num_junctions; i++)
+    {
+        state.priority[i] = computePriority(&state, i);
+        heapPush(&order, i);
+    }
+
+    int32_t *rank = (int32_t *)malloc(sizeof(int32_t) * num_junctions);
+    int next_rank = 0;
+    while (order.size > 0)
+    {
+        int v = heapPop(&order);
+
+        // 惰性更新：如果重新计算后的优先级不再是最小的，放回队列
+        int64_t current = computePriority(&state, v);
+        if (order.size > 0 && current > state.priority[order.ids[0]])
+        {
+            state.priority[v] = current;
+            heapPush(&order, v);
+            continue;
+        }
+
+        contractJunction(&state, v, 0);
+        state.contracted[v] = 1;
+        rank[v] = next_rank++;
+
+        // 更新相邻的尚未收缩的路口的优先级
+        struct EdgeList *lists[2] = {&state.out[v], &state.in[v]};
+        for (int l = 0; l < 2; l++)
+        {
+            for (int i = 0; i < lists[l]->size; i++)
+            {
+                int w = lists[l]->nodes[i];
+                if (state.contracted[w])
+                    continue;
+                state.contractedNeighbours[w]++;
+                state.priority[w] = computePriority(&state, w);
+                heapPush(&order, w);
+            }
+        }
+    }
+    heapFree(&order);
+    heapFree(&state.witnessHeap);
+
+    // 向上的图保存指向更高等级的边，向下的图在终点保存来自更高等级的边
+    int32_t num_up = 0, num_down = 0;
+    for (int u = 0; u < num_junctions; u++)
+    {
+        for (int i = 0; i < state.out[u].size; i++)
+        {
+            if (rank[state.out[u].nodes[i]] > rank[u])
+                num_up++;
+        }
+        for (int i = 0; i < state.in[u].size; i++)
+        {
+            if (rank[state.in[u].nodes[i]] > rank[u])
+                num_down++;
+        }
+    }
+    hierarchy->num_junctions = num_junctions;
+    hierarchy->num_roads = topology->num_roads;
+    hierarchy->num_up = num_up;
+    hierarchy->num_down = num_down;
+    layoutHierarchy(hierarchy, (char *)malloc(getHierarchySize(num_junctions, num_up, num_down)));
+    memcpy(hierarchy->rank, rank, sizeof(int32_t) * num_junctions);
+    free(rank);
+
+    num_up = num_down = 0;
+    for (int u = 0; u < num_junctions; u++)
+    {
+        hierarchy->upOffsets[u] = num_up;
+        hierarchy->downOffsets[u] = num_down;
+        for (int i = 0; i < state.out[u].size; i++)
+        {
+            if (hierarchy->rank[state.out[u].nodes[i]] > hierarchy->rank[u])
+            {
+                hierarchy->upTo[num_up] = state.out[u].nodes[i];
+                hierarchy->upCost[num_up++] = state.out[u].costs[i];
+            }
+        }
+        for (int i = 0; i < state.in[u].size; i++)
+        {
+            if (hierarchy->rank[state.in[u].nodes[i]] > hierarchy->rank[u])
+            {
+                hierarchy->downFrom[num_down] = state.in[u].nodes[i];
+                hierarchy->downCost[num_down++] = state.in[u].costs[i];
+            }
+        }
+        free(state.out[u].nodes);
+        free(state.out[u].costs);
+        free(state.in[u].nodes);
+        free(state.in[u].costs);
+    }
+    hierarchy->upOffsets[num_junctions] = num_up;
+    hierarchy->downOffsets[num_junctions] = num_down;
+
+    free(state.out);
+    free(state.in);
+    free(state.contracted);
+    free(state.contractedNeighbours);
+    free(state.priority);
+    free(state.dist);
+    free(state.touched);
+}
+
+/**
+ * Frees a hierarchy created by buildContractionHierarchy, all arrays live in the one allocation
+ **/
+void freeContractionHierarchy(struct ContractionHierarchy *hierarchy)
+{
+    free(hierarchy->upCost);
+    hierarchy->upCost = NULL;
+}
+
+/**
+ * Writes the hierarchy to file in exactly the layout it has in memory (native byte order), along with the size and
+ * checksum of the topology and the cost scale it was built for so that a stale hierarchy is detected when loading it
+ **/
+void writeContractionHierarchy(char *filename, const struct ContractionHierarchy *hierarchy, const struct RoadTopology *topology)
+{
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Error opening contraction hierarchy file '%s' for writing\n", filename);
+        exit(-1);
+    }
+
+    struct HierarchyFileHeader header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, CH_FILE_MAGIC);
+    header.version = CH_FILE_VERSION;
+    header.num_junctions = hierarchy->num_junctions;
+    header.num_roads = hierarchy->num_roads;
+    header.num_up = hierarchy->num_up;
+    header.num_down = hierarchy->num_down;
+    header.costScale = ROUTE_COST_SCALE;
+    header.topologyChecksum = topology->checksum;
+
+    size_t size = getHierarchySize(hierarchy->num_junctions, hierarchy->num_up, hierarchy->num_down);
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(hierarchy->upCost, 1, size, f) == size;
+    if (fclose(f) != 0 || !ok)
+    {
+        fprintf(stderr, "Error writing contraction hierarchy file '%s'\n", filename);
+        exit(-1);
+    }
+}
+
+/**
+ * Maps the hierarchy stored next to the roadmap (with CH_FILE_SUFFIX) read only into memory. Returns zero if there
+ * is no hierarchy file, which just means that route planning does not use one. This is collective over MPI_COMM_WORLD,
+ * as every process on a node maps the same file and only the first one checks its edges
+ **/
+int mapContractionHierarchy(char *roadmapFilename, const struct RoadTopology *topology, struct ContractionHierarchy *hierarchy)
+{
+    char filename[strlen(roadmapFilename) + strlen(CH_FILE_SUFFIX) + 1];
+    sprintf(filename, "%s%s", roadmapFilename, CH_FILE_SUFFIX);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct HierarchyFileHeader header;
+    if (read(fd, &header, sizeof(header)) != sizeof(header) || memcmp(header.magic, CH_FILE_MAGIC, sizeof(CH_FILE_MAGIC)) != 0 ||
+        header.version != CH_FILE_VERSION)
+    {
+        fprintf(stderr, "Error: '%s' is not a version %d contraction hierarchy, rebuild it\n", filename, CH_FILE_VERSION);
+        exit(-1);
+    }
+    if (header.num_junctions != topology->num_junctions || header.num_roads != topology->num_roads || header.costScale != ROUTE_COST_SCALE ||
+        header.topologyChecksum != topology->checksum)
+    {
+        fprintf(stderr, "Error: Contraction hierarchy '%s' was built for a different roadmap or cost scale, rebuild it\n", filename);
+        exit(-1);
+    }
+
+    // 文件头中的边数决定映射的大小，负数或者溢出的大小会绕过下面的截断检查
+    if (header.num_up < 0 || header.num_down < 0 || (size_t)header.num_up + (size_t)header.num_down >
+        (SIZE_MAX - sizeof(header) - sizeof(int32_t) * ((size_t)header.num_junctions * 3 + 2)) / (sizeof(int64_t) + sizeof(int32_t)))
+    {
+        fprintf(stderr, "Error: Contraction hierarchy '%s' has an invalid header with %d up and %d down edges\n",
+                filename, header.num_up, header.num_down);
+        exit(-1);
+    }
+    struct stat st;
+    size_t size = sizeof(header) + getHierarchySize(header.num_junctions, header.num_up, header.num_down);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < size)
+    {
+        fprintf(stderr, "Error: Contraction hierarchy '%s' is truncated\n", filename);
+        exit(-1);
+    }
+
+    void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        fprintf(stderr, "Error mapping contraction hierarchy '%s'\n", filename);
+        exit(-1);
+    }
+    mappedBase = base;
+    mappedSize = size;
+
+    hierarchy->num_junctions = header.num_junctions;
+    hierarchy->num_roads = header.num_roads;
+    hierarchy->num_up = header.num_up;
+    hierarchy->num_down = header.num_down;
+    layoutHierarchy(hierarchy, (char *)base + sizeof(header));
+
+    MPI_Comm nodeComm;
+    int nodeRank;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nodeComm);
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    int valid = nodeRank != 0 || checkHierarchy(hierarchy);
+    MPI_Bcast(&valid, 1, MPI_INT, 0, nodeComm);
+    MPI_Comm_free(&nodeComm);
+    if (!valid)
+    {
+        if (nodeRank == 0)
+            fprintf(stderr, "Error: Contraction hierarchy '%s' is corrupt, its edges do not match its junctions\n", filename);
+        exit(-1);
+    }
+    return 1;
+}
+
+/**
+ * Unmaps a hierarchy that was mapped by mapContractionHierarchy
+ **/
+void unmapContractionHierarchy(struct ContractionHierarchy *hierarchy)
+{
+    munmap(mappedBase, mappedSize);
+    mappedBase = NULL;
+    mappedSize = 0;
+    hierarchy->upCost = NULL;
+}
+
+/**
+ * Allocates the scratch space of queries, this is the only part of a query that is proportional to the graph size
+ **/
+void initHierarchyQuery(struct HierarchyQuery *query, const struct ContractionHierarchy *hierarchy)
+{
+    int num_junctions = hierarchy->num_junctions;
+    query->hierarchy = hierarchy;
+    query->forwardDist = (int64_t *)malloc(sizeof(int64_t) * num_junctions);
+    query->backwardDist = (int64_t *)malloc(sizeof(int64_t) * num_junctions);
+    query->firstJunction = (int *)malloc(sizeof(int) * num_junctions);
+    query->touched = (int *)malloc(sizeof(int) * num_junctions);
+    query->numTouched = 0;
+    for (int i = 0; i < num_junctions; i++)
+    {
+        query->forwardDist[i] = query->backwardDist[i] = ROUTE_INFINITY;
+        query->firstJunction[i] = -1;
+    }
+    heapInit(&query->forwardHeap, num_junctions, query->forwardDist);
+    heapInit(&query->backwardHeap, num_junctions, query->backwardDist);
+}
+
+/**
+ * Frees the scratch space of queries
+ **/
+void freeHierarchyQuery(struct HierarchyQuery *query)
+{
+    heapFree(&query->forwardHeap);
+    heapFree(&query->backwardHeap);
+    free(query->forwardDist);
+    free(query->backwardDist);
+    free(query->firstJunction);
+    free(query->touched);
+}
+
+/**
+ * Bidirectional upward search. The forward search starts from all of the seeds at once (with their starting costs)
+ * and remembers which seed each junction was reached from, the backward search starts at the destination. Each side
+ * stops once its smallest queued cost can no longer improve on the best meeting junction found so far
+ **/
+int64_t queryHierarchy(struct HierarchyQuery *query, const int *seeds, const int64_t *seedCosts, int numSeeds, int dest, int *firstOut)
+{
+    const struct ContractionHierarchy *hierarchy = query->hierarchy;
+    int64_t *fdist = query->forwardDist, *bdist = query->backwardDist;
+    int64_t best = ROUTE_INFINITY;
+    int bestFirst = -1;
+
+    for (int i = 0; i < numSeeds; i++)
+    {
+        if (seedCosts[i] < fdist[seeds[i]])
+        {
+            touchJunction(query, seeds[i]);
+            fdist[seeds[i]] = seedCosts[i];
+            query->firstJunction[seeds[i]] = seeds[i];
+            heapPush(&query->forwardHeap, seeds[i]);
+        }
+    }
+    touchJunction(query, dest);
+    bdist[dest] = 0;
+    heapPush(&query->backwardHeap, dest);
+
+    while (query->forwardHeap.size > 0 || query->backwardHeap.size > 0)
+    {
+        int64_t fmin = query->forwardHeap.size > 0 ? fdist[query->forwardHeap.ids[0]] : ROUTE_INFINITY;
+        int64_t bmin = query->backwardHeap.size > 0 ? bdist[query->backwardHeap.ids[0]] : ROUTE_INFINITY;
+        if (fmin >= best && bmin >= best)
+            break;
+
+        if (fmin <= bmin)
+        {
+            int u = heapPop(&query->forwardHeap);
+            if (bdist[u] != ROUTE_INFINITY && fdist[u] + bdist[u] < best)
+            {
+                best = fdist[u] + bdist[u];
+                bestFirst = query->firstJunction[u];
+            }
+            for (int e = hierarchy->upOffsets[u]; e < hierarchy->upOffsets[u + 1]; e++)
+            {
+                int x = hierarchy->upTo[e];
+                int64_t alt = fdist[u] + hierarchy->upCost[e];
+                if (alt < fdist[x])
+                {
+                    touchJunction(query, x);
+                    fdist[x] = alt;
+                    query->firstJunction[x] = query->firstJunction[u];
+                    heapPush(&query->forwardHeap, x);
+                }
+            }
+        }
+        else
+        {
+            int u = heapPop(&query->backwardHeap);
+            if (fdist[u] != ROUTE_INFINITY && fdist[u] + bdist[u] < best)
+            {
+                best = fdist[u] + bdist[u];
+                bestFirst = query->firstJunction[u];
+            }
+            for (int e = hierarchy->downOffsets[u]; e < hierarchy->downOffsets[u + 1]; e++)
+            {
+                int x = hierarchy->downFrom[e];
+                int64_t alt = bdist[u] + hierarchy->downCost[e];
+                if (alt < bdist[x])
+                {
+                    touchJunction(query, x);
+                    bdist[x] = alt;
+                    heapPush(&query->backwardHeap, x);
+                }
+            }
+        }
+    }
+
+    // 只重置这次查询访问过的路口
+    for (int i = 0; i < query->numTouched; i++)
+    {
+        int x = query->touched[i];
+        fdist[x] = bdist[x] = ROUTE_INFINITY;
+        query->firstJunction[x] = -1;
+    }
+    query->numTouched = 0;
+    heapClear(&query->forwardHeap);
+    heapClear(&query->backwardHeap);
+
+    *firstOut = bestFirst;
+    return best;
+}
+
+/**
+ * Records that a query is about to give the junction a cost, so that it is reset afterwards
+ **/
+static void touchJunction(struct HierarchyQuery *query, int x)
+{
+    if (query->forwardDist[x] == ROUTE_INFINITY && query->backwardDist[x] == ROUTE_INFINITY)
+        query->touched[query->numTouched++] = x;
+}
+
+/**
+ * Adds an edge to the list, or lowers the cost of the existing edge to the same junction. Returns one if it was added
+ **/
+static int addOrLowerEdge(struct EdgeList *list, int node, int64_t cost)
+{
+    for (int i = 0; i < list->size; i++)
+    {
+        if (list->nodes[i] == node)
+        {
+            if (cost < list->costs[i])
+                list->costs[i] = cost;
+            return 0;
+        }
+    }
+    if (list->size == list->capacity)
+    {
+        list->capacity = list->capacity == 0 ? 4 : list->capacity * 2;
+        list->nodes = (int *)realloc(list->nodes, sizeof(int) * list->capacity);
+        list->costs = (int64_t *)realloc(list->costs, sizeof(int64_t) * list->capacity);
+    }
+    list->nodes[list->size] = node;
+    list->costs[list->size] = cost;
+    list->size++;
+    return 1;
+}
+
+/**
+ * Adds the edge u->x to both the out list of u and the in list of x
+ **/
+static void addShortcut(struct ContractionState *state, int u, int x, int64_t cost)
+{
+    addOrLowerEdge(&state->out[u], x, cost);
+    addOrLowerEdge(&state->in[x], u, cost);
+}
+
+/**
+ * Dijkstra from the source over the junctions not yet contracted, avoiding the excluded junction and stopping once
+ * the limit is exceeded or CH_WITNESS_SETTLE_LIMIT junctions have been settled. Results are left in state->dist
+ **/
+static void witnessSearch(struct ContractionState *state, int source, int excluded, int64_t limit)
+{
+    state->dist[source] = 0;
+    state->touched[state->numTouched++] = source;
+    heapPush(&state->witnessHeap, source);
+    int settled = 0;
+    while (state->witnessHeap.size > 0)
+    {
+        int u = heapPop(&state->witnessHeap);
+        if (state->dist[u] > limit || ++settled > CH_WITNESS_SETTLE_LIMIT)
+            break;
+        for (int i = 0; i < state->out[u].size; i++)
+        {
+            int x = state->out[u].nodes[i];
+            if (x == excluded || state->contracted[x])
+                continue;
+            int64_t alt = state->dist[u] + state->out[u].costs[i];
+            if (alt < state->dist[x])
+            {
+                if (state->dist[x] == ROUTE_INFINITY)
+                    state->touched[state->numTouched++] = x;
+                state->dist[x] = alt;
+                heapPush(&state->witnessHeap, x);
+            }
+        }
+    }
+    heapClear(&state->witnessHeap);
+}
+
+/**
+ * Resets the distances set by the last witness search
+ **/
+static void resetWitnessSearch(struct ContractionState *state)
+{
+    for (int i = 0; i < state->numTouched; i++)
+    {
+        state->dist[state->touched[i]] = ROUTE_INFINITY;
+    }
+    state->numTouched = 0;
+}
+
+/**
+ * Contracts junction v, returning the number of shortcuts this needs. When simulating the shortcuts are only counted
+ **/
+static int contractJunction(struct ContractionState *state, int v, int simulate)
+{
+    int shortcuts = 0;
+    struct EdgeList *in = &state->in[v], *out = &state->out[v];
+    for (int i = 0; i < in->size; i++)
+    {
+        int u = in->nodes[i];
+        if (state->contracted[u])
+            continue;
+
+        int64_t limit = -1;
+        for (int j = 0; j < out->size; j++)
+        {
+            int x = out->nodes[j];
+            if (x != u && !state->contracted[x] && in->costs[i] + out->costs[j] > limit)
+                limit = in->costs[i] + out->costs[j];
+        }
+        if (limit < 0)
+            continue;
+
+        witnessSearch(state, u, v, limit);
+        for (int j = 0; j < out->size; j++)
+        {
+            int x = out->nodes[j];
+            if (x == u || state->contracted[x])
+                continue;
+            int64_t cost = in->costs[i] + out->costs[j];
+            if (state->dist[x] > cost)
+            {
+                shortcuts++;
+                if (!simulate)
+                    addShortcut(state, u, x, cost);
+            }
+        }
+        resetWitnessSearch(state);
+    }
+    return shortcuts;
+}
+
+/**
+ * Priority of contracting junction v next, lower is contracted earlier
+ **/
+static int64_t computePriority(struct ContractionState *state, int v)
+{
+    int removed = 0;
+    for (int i = 0; i < state->in[v].size; i++)
+    {
+        if (!state->contracted[state->in[v].nodes[i]])
+            removed++;
+    }
+    for (int i = 0; i < state->out[v].size; i++)
+    {
+        if (!state->contracted[state->out[v].nodes[i]])
+            removed++;
+    }
+    return contractJunction(state, v, 1) - removed + state->contractedNeighbours[v];
+}
+
+/**
+ * Number of bytes needed to hold all the arrays of a hierarchy in one block
+ **/
+static size_t getHierarchySize(int32_t num_junctions, int32_t num_up, int32_t num_down)
+{
+    return sizeof(int64_t) * ((size_t)num_up + num_down) + sizeof(int32_t) * ((size_t)num_junctions * 3 + 2 + num_up + num_down);
+}
+
+/**
+ * Checks that the up and down offsets of a mapped hierarchy cover exactly its edges in order, that every edge leads
+ * to one of its junctions and that no edge has a negative cost, so queries never read outside the mapping
+ **/
+static int checkHierarchy(const struct ContractionHierarchy *hierarchy)
+{
+    int num_junctions = hierarchy->num_junctions;
+    if (hierarchy->upOffsets[0] != 0 || hierarchy->upOffsets[num_junctions] != hierarchy->num_up ||
+        hierarchy->downOffsets[0] != 0 || hierarchy->downOffsets[num_junctions] != hierarchy->num_down)
+        return 0;
+    for (int u = 0; u < num_junctions; u++)
+    {
+        if (hierarchy->upOffsets[u + 1] < hierarchy->upOffsets[u] || hierarchy->downOffsets[u + 1] < hierarchy->downOffsets[u])
+            return 0;
+    }
+    for (int e = 0; e < hierarchy->num_up; e++)
+    {
+        if (hierarchy->upTo[e] < 0 || hierarchy->upTo[e] >= num_junctions || hierarchy->upCost[e] < 0)
+            return 0;
+    }
+    for (int e = 0; e < hierarchy->num_down; e++)
+    {
+        if (hierarchy->downFrom[e] < 0 || hierarchy->downFrom[e] >= num_junctions || hierarchy->downCost[e] < 0)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Points the arrays of the hierarchy into one block of memory, the 64 bit costs come first so everything stays aligned
+ **/
+static void layoutHierarchy(struct ContractionHierarchy *hierarchy, char *base)
+{
+    hierarchy->upCost = (int64_t *)base;
+    hierarchy->downCost = hierarchy->upCost + hierarchy->num_up;
+    int32_t *p = (int32_t *)(hierarchy->downCost + hierarchy->num_down);
+    hierarchy->rank = p;
+    p += hierarchy->num_junctions;
+    hierarchy->upOffsets = p;
+    p += hierarchy->num_junctions + 1;
+    hierarchy->upTo = p;
+    p += hierarchy->num_up;
+    hierarchy->downOffsets = p;
+    p += hierarchy->num_junctions + 1;
+    hierarchy->downFrom = p;
+}
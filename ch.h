@@ -0,0 +1,60 @@
+#ifndef CH_H_
+#define CH_H_
+
+#include <stdint.h>
+#include "heap.h"
+
+// Contraction hierarchy over the maximum speed travel costs of a topology. Junctions are ranked by contraction order,
+// upward searches from the source use the up graph (roads and shortcuts towards higher ranks) and upward searches
+// from the destination use the down graph (roads and shortcuts arriving from higher ranks, stored at their end)
+struct ContractionHierarchy {
+	int32_t num_junctions, num_roads, num_up, num_down;
+	int32_t *rank;
+	int32_t *upOffsets, *upTo;
+	int32_t *downOffsets, *downFrom;
+	int64_t *upCost, *downCost;
+};
+
+// Files of a contraction hierarchy are stored next to the roadmap with this suffix
+#define CH_FILE_SUFFIX ".ch"
+#define CH_FILE_MAGIC "ROADCH"
+#define CH_FILE_VERSION 2
+
+struct HierarchyFileHeader {
+	char magic[8];
+	uint32_t version;
+	int32_t num_junctions, num_roads, num_up, num_down;
+	int32_t costScale;
+	// Checksum of the roadmap the hierarchy was built for
+	uint64_t topologyChecksum;
+};
+
+// Per actor scratch space of a hierarchy query, only the junctions touched by a query are reset afterwards
+struct HierarchyQuery {
+	const struct ContractionHierarchy *hierarchy;
+	int64_t *forwardDist, *backwardDist;
+	int *firstJunction, *touched;
+	int numTouched;
+	struct IndexedHeap forwardHeap, backwardHeap;
+};
+
+// Preprocesses the topology into a privately allocated contraction hierarchy
+void buildContractionHierarchy(const struct RoadTopology *, struct ContractionHierarchy *);
+// Frees a hierarchy created by buildContractionHierarchy
+void freeContractionHierarchy(struct ContractionHierarchy *);
+// Writes the hierarchy to file
+void writeContractionHierarchy(char *, const struct ContractionHierarchy *, const struct RoadTopology *);
+// Collectively maps the hierarchy stored next to the roadmap read only into memory, with one process per node checking
+// its edges, returns zero if there is none
+int mapContractionHierarchy(char *, const struct RoadTopology *, struct ContractionHierarchy *);
+// Unmaps a hierarchy mapped by mapContractionHierarchy
+void unmapContractionHierarchy(struct ContractionHierarchy *);
+// Allocates the scratch space of queries over the hierarchy
+void initHierarchyQuery(struct HierarchyQuery *, const struct ContractionHierarchy *);
+// Frees the scratch space of queries
+void freeHierarchyQuery(struct HierarchyQuery *);
+// Bidirectional upward search from several seed junctions (each with a starting cost) to the destination, returning
+// the cost of the best route and the seed it starts from, or ROUTE_INFINITY and -1 if there is none
+int64_t queryHierarchy(struct HierarchyQuery *, const int *, const int64_t *, int, int, int *);
+
+#endif /* CH_H_ */
@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "mpi.h"
+#include "roadmap.h"
+#include "code.h"
+#include "comm.h"
+#include "function.h"
+#include "migrate.h"
+#include "checkpoint.h"
+#include "partition.h"
+
+#define CHECKPOINT_MAGIC "TCKP"
+#define CHECKPOINT_VERSION 2
+// host写车辆时每次打包的车辆数量，避免为检查点分配整个车辆数组大小的缓冲区
+#define CHECKPOINT_CHUNK 256
+
+enum CheckpointKind
+{
+    CHECKPOINT_CONTROL,
+    CHECKPOINT_MAP,
+    CHECKPOINT_HOST
+};
+
+/*
+ * 每个演员的检查点文件的文件头，后面紧跟演员自己的数据：
+ * control没有其他数据，map为路口的车辆数量、碰撞总数和车辆总数以及道路的车辆数量、车辆总数和最大同时车辆数量，
+ * host为本地累加的统计数据和count辆序列化的车辆
+ */
+struct CheckpointHeader
+{
+    char magic[4];
+    int32_t version, kind, rank, numRanks;
+    int32_t minute, numJunctions, numRoads, count;
+    // map写检查点时的路网拓扑和路口划分，路口和道路数量相同的其他地图或划分文件不能用来恢复
+    uint64_t topologyChecksum, partitionChecksum;
+    // 写检查点时的时间，恢复时车辆的时间戳按经过的时间平移
+    int64_t wallSeconds;
+    char randomState[RANDOM_STATE_BYTES];
+};
+
+static const char *restartDirectory = NULL;
+// map已经收到的检查点标记数量，host在map写完之前不再发送消息，所以同时最多只有一个检查点在进行
+static int numMarkers = 0, markerMinute = -1;
+
+static FILE *createCheckpoint(int, char *, char *);
+static void commitCheckpoint(FILE *, const char *, const char *);
+static void fillHeader(struct CheckpointHeader *, int, int, const struct RoadMapState *, int);
+static FILE *openRestart(int, struct CheckpointHeader *);
+static void readRestart(FILE *, void *, size_t);
+static void writeMapCheckpoint(const struct RoadMapState *, int);
+
+/**
+ * 设置重启时读取的检查点目录，必须在进程池启动之前由所有进程调用
+ */
+void setRestartDirectory(const char *directory)
+{
+    restartDirectory = directory;
+}
+
+/**
+ * 是否从检查点恢复模拟
+ */
+int isRestarting()
+{
+    return restartDirectory != NULL;
+}
+
+/**
+ * 这一模拟分钟是否写检查点。只有vehicle host托管车辆时才写，每辆车一个进程时车辆的状态分散在工作进程中
+ */
+int isCheckpointMinute(int minute)
+{
+    if (!USE_VEHICLE_HOSTS || CHECKPOINT_FREQUENCY <= 0)
+        return 0;
+    // 检查点关闭时不能用0取模
+    int frequency = CHECKPOINT_FREQUENCY > 0 ? CHECKPOINT_FREQUENCY : 1;
+    return minute > 0 && minute < MAX_MINS && minute % frequency == 0;
+}
+
+/**
+ * control在发出这一分钟的新车辆并开始统计归约之后写检查点，只保存分钟数和随机数生成器的状态，
+ * 统计数据由vehicle host保存
+ */
+void writeControlCheckpoint(int minute)
+{
+    char path[256], tmpPath[256];
+    FILE *file = createCheckpoint(minute, path, tmpPath);
+    if (file == NULL)
+        return;
+    struct CheckpointHeader header;
+    fillHeader(&header, CHECKPOINT_CONTROL, minute, NULL, 0);
+    fwrite(&header, sizeof(header), 1, file);
+    commitCheckpoint(file, path, tmpPath);
+    printf("[Time: %d mins] Writing checkpoint to %s/minute_%d\n", minute, CHECKPOINT_DIRECTORY, minute);
+}
+
+/**
+ * control从检查点恢复，返回检查点的分钟数
+ */
+int readControlCheckpoint()
+{
+    struct CheckpointHeader header;
+    FILE *file = openRestart(CHECKPOINT_CONTROL, &header);
+    fclose(file);
+    resumeStatistics(header.minute, NULL);
+    printf("Restarting from checkpoint %s at %d mins\n", restartDirectory, header.minute);
+    return header.minute;
+}
+
+/**
+ * map接收探测到的检查点标记。每个host在它所有的转移消息之后发送标记，然后等待map写完，
+ * 所以收到所有host的标记时路网的状态正好包含检查点之前的所有转移，这时写检查点并通知所有host继续
+ */
+void receiveCheckpointMarker(const struct RoadMapState *roadMap, MPI_Message *message, MPI_Status *status)
+{
+    int minute;
+    MPI_Mrecv(&minute, 1, MPI_INT, message, MPI_STATUS_IGNORE);
+    if (numMarkers > 0 && minute != markerMinute)
+    {
+        fprintf(stderr, "Error: Map actor received a checkpoint marker for %d mins from %d during the checkpoint for %d mins\n",
+                minute, status->MPI_SOURCE, markerMinute);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    markerMinute = minute;
+    if (++numMarkers < NUM_VEHICLE_HOSTS)
+        return;
+
+    writeMapCheckpoint(roadMap, minute);
+    numMarkers = 0;
+    for (int h = 0; h < NUM_VEHICLE_HOSTS; h++)
+    {
+        MPI_Send(&minute, 1, MPI_INT, FIRST_VEHICLE_HOST_RANK + h, TAG_CHECKPOINT_DONE, MPI_COMM_WORLD);
+    }
+}
+
+/**
+ * map从检查点恢复路口和道路的计数，车辆数量不为零的路口和道路标记为需要重新计算限速并发布到公告板，
+ * 返回检查点的分钟数
+ */
+int readMapCheckpoint(struct RoadMapState *roadMap)
+{
+    int num_junctions = roadMap->num_junctions, num_roads = roadMap->num_roads;
+    struct CheckpointHeader header;
+    FILE *file = openRestart(CHECKPOINT_MAP, &header);
+    if (header.numJunctions != num_junctions || header.numRoads != num_roads)
+    {
+        fprintf(stderr, "Error: Checkpoint in %s is for a map actor with %d junctions and %d roads, not %d and %d\n",
+                restartDirectory, header.numJunctions, header.numRoads, num_junctions, num_roads);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (header.topologyChecksum != roadMap->topology->checksum)
+    {
+        fprintf(stderr, "Error: Checkpoint in %s was written for a different roadmap\n", restartDirectory);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (header.partitionChecksum != roadMap->partition->checksum)
+    {
+        fprintf(stderr, "Error: Checkpoint in %s was written with a different partition of the junctions between the map actors\n", restartDirectory);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    readRestart(file, roadMap->num_vehicles, sizeof(int) * num_junctions);
+    readRestart(file, roadMap->total_number_crashes, sizeof(int) * num_junctions);
+    readRestart(file, roadMap->total_number_vehicles, sizeof(int) * num_junctions);
+    readRestart(file, roadMap->numVehiclesOnRoad, sizeof(int) * num_roads);
+    readRestart(file, roadMap->road_total_number_vehicles, sizeof(int) * num_roads);
+    readRestart(file, roadMap->max_concurrent_vehicles, sizeof(int) * num_roads);
+    fclose(file);
+
+    for (int road = 0; road < num_roads; road++)
+    {
+        if (roadMap->numVehiclesOnRoad[road] != 0)
+        {
+            roadMap->roadDirty[road] = 1;
+            roadMap->dirtyRoads[roadMap->numDirtyRoads++] = road;
+        }
+    }
+    for (int junction = 0; junction < num_junctions; junction++)
+    {
+        if (roadMap->num_vehicles[junction] != 0)
+        {
+            roadMap->junctionDirty[junction] = 1;
+            roadMap->dirtyJunctions[roadMap->numDirtyJunctions++] = junction;
+        }
+    }
+    return header.minute;
+}
+
+/**
+ * vehicle host在完成迁移并激活了control在这一分钟之前发出的所有新车辆之后写检查点。先给每个map发送标记，
+ * 和map同时写各自的文件，然后等待所有map写完才继续推进车辆
+ */
+void writeHostCheckpoint(int minute, const struct VehicleStruct *vehicles, int num_vehicles)
+{
+    for (int m = 0; m < NUM_MAP_ACTORS; m++)
+    {
+        MPI_Send(&minute, 1, MPI_INT, MAP_ACTOR_RANK + m, TAG_CHECKPOINT, MPI_COMM_WORLD);
+    }
+
+    char path[256], tmpPath[256];
+    FILE *file = createCheckpoint(minute, path, tmpPath);
+    if (file != NULL)
+    {
+        struct CheckpointHeader header;
+        fillHeader(&header, CHECKPOINT_HOST, minute, NULL, num_vehicles);
+        int statistics[NUM_STATISTICS];
+        getLocalStatistics(statistics);
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(statistics, sizeof(int), NUM_STATISTICS, file);
+        struct PackedVehicle packed[CHECKPOINT_CHUNK];
+        for (int i = 0; i < num_vehicles; i += CHECKPOINT_CHUNK)
+        {
+            int n = num_vehicles - i < CHECKPOINT_CHUNK ? num_vehicles - i : CHECKPOINT_CHUNK;
+            for (int v = 0; v < n; v++)
+            {
+                packVehicle(&vehicles[i + v], &packed[v]);
+            }
+            fwrite(packed, sizeof(struct PackedVehicle), n, file);
+        }
+        commitCheckpoint(file, path, tmpPath);
+    }
+
+    for (int m = 0; m < NUM_MAP_ACTORS; m++)
+    {
+        int done;
+        MPI_Recv(&done, 1, MPI_INT, MAP_ACTOR_RANK + m, TAG_CHECKPOINT_DONE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+}
+
+/**
+ * vehicle host从检查点恢复车辆、本地统计数据以及统计归约和负载均衡的轮次，车辆的时间戳按写检查点之后经过的时间平移，
+ * 燃料和行驶距离从检查点时的状态继续计算。返回检查点的分钟数
+ */
+int readHostCheckpoint(struct VehicleStruct *vehicles, int capacity, int *num_vehicles)
+{
+    struct CheckpointHeader header;
+    FILE *file = openRestart(CHECKPOINT_HOST, &header);
+    if (header.count > capacity)
+    {
+        fprintf(stderr, "Error: Checkpoint in %s holds %d vehicles, more than 'MAX_VEHICLES_PER_HOST'\n", restartDirectory, header.count);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int statistics[NUM_STATISTICS];
+    readRestart(file, statistics, sizeof(int) * NUM_STATISTICS);
+    time_t shift = getCurrentSeconds() - (time_t)header.wallSeconds;
+    struct PackedVehicle packed[CHECKPOINT_CHUNK];
+    for (int i = 0; i < header.count; i += CHECKPOINT_CHUNK)
+    {
+        int n = header.count - i < CHECKPOINT_CHUNK ? header.count - i : CHECKPOINT_CHUNK;
+        readRestart(file, packed, sizeof(struct PackedVehicle) * n);
+        for (int v = 0; v < n; v++)
+        {
+            struct VehicleStruct *vehicle = &vehicles[i + v];
+            unpackVehicle(&packed[v], vehicle);
+            vehicle->start_t += shift;
+            if (vehicle->last_distance_check_secs != 0)
+                vehicle->last_distance_check_secs += shift;
+        }
+    }
+    fclose(file);
+    *num_vehicles = header.count;
+    resumeStatistics(header.minute, statistics);
+    resumeMigration(header.minute);
+    return header.minute;
+}
+
+/**
+ * map在收到所有host的标记时写出路口和道路的计数，信号灯和限速由分钟数和车辆数量决定，恢复时重新计算
+ */
+static void writeMapCheckpoint(const struct RoadMapState *roadMap, int minute)
+{
+    int num_junctions = roadMap->num_junctions, num_roads = roadMap->num_roads;
+    char path[256], tmpPath[256];
+    FILE *file = createCheckpoint(minute, path, tmpPath);
+    if (file == NULL)
+        return;
+    struct CheckpointHeader header;
+    fillHeader(&header, CHECKPOINT_MAP, minute, roadMap, 0);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(roadMap->num_vehicles, sizeof(int), num_junctions, file);
+    fwrite(roadMap->total_number_crashes, sizeof(int), num_junctions, file);
+    fwrite(roadMap->total_number_vehicles, sizeof(int), num_junctions, file);
+    fwrite(roadMap->numVehiclesOnRoad, sizeof(int), num_roads, file);
+    fwrite(roadMap->road_total_number_vehicles, sizeof(int), num_roads, file);
+    fwrite(roadMap->max_concurrent_vehicles, sizeof(int), num_roads, file);
+    commitCheckpoint(file, path, tmpPath);
+}
+
+/**
+ * 创建这一分钟的检查点目录，打开该进程的临时文件，写完之后才改名，中途失败不会留下不完整的检查点文件。
+ * 写检查点失败只给出警告，模拟继续
+ */
+static FILE *createCheckpoint(int minute, char *path, char *tmpPath)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    char directory[200];
+    snprintf(directory, sizeof(directory), "%s/minute_%d", CHECKPOINT_DIRECTORY, minute);
+    if ((mkdir(CHECKPOINT_DIRECTORY, 0755) != 0 && errno != EEXIST) || (mkdir(directory, 0755) != 0 && errno != EEXIST))
+    {
+        fprintf(stderr, "Warning: Could not create the checkpoint directory %s, skipping the checkpoint\n", directory);
+        return NULL;
+    }
+    snprintf(path, 256, "%s/rank_%d.ckpt", directory, rank);
+    snprintf(tmpPath, 256, "%s.tmp", path);
+    FILE *file = fopen(tmpPath, "wb");
+    if (file == NULL)
+        fprintf(stderr, "Warning: Could not open %s, skipping the checkpoint\n", tmpPath);
+    return file;
+}
+
+static void commitCheckpoint(FILE *file, const char *path, const char *tmpPath)
+{
+    int failed = ferror(file);
+    if (fclose(file) != 0 || failed || rename(tmpPath, path) != 0)
+    {
+        fprintf(stderr, "Warning: Could not write checkpoint file %s\n", path);
+        remove(tmpPath);
+    }
+}
+
+/**
+ * 文件头记录进程的rank和数量，map还记录它拥有的路口和道路的数量以及拓扑和划分的校验和，重启时检查检查点是否属于同样的进程布局、地图和划分
+ */
+static void fillHeader(struct CheckpointHeader *header, int kind, int minute, const struct RoadMapState *roadMap, int count)
+{
+    memset(header, 0, sizeof(struct CheckpointHeader));
+    memcpy(header->magic, CHECKPOINT_MAGIC, 4);
+    header->version = CHECKPOINT_VERSION;
+    header->kind = kind;
+    MPI_Comm_rank(MPI_COMM_WORLD, &header->rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &header->numRanks);
+    header->minute = minute;
+    header->count = count;
+    header->wallSeconds = (int64_t)getCurrentSeconds();
+    saveRandomState(header->randomState);
+    if (roadMap != NULL)
+    {
+        header->numJunctions = roadMap->num_junctions;
+        header->numRoads = roadMap->num_roads;
+        header->topologyChecksum = roadMap->topology->checksum;
+        header->partitionChecksum = roadMap->partition->checksum;
+    }
+}
+
+/**
+ * 打开该进程在重启目录中的检查点文件，读取并检查文件头，恢复随机数生成器的状态。检查点不可用时终止模拟
+ */
+static FILE *openRestart(int kind, struct CheckpointHeader *header)
+{
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    char path[256];
+    snprintf(path, sizeof(path), "%s/rank_%d.ckpt", restartDirectory, rank);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Could not open checkpoint file %s\n", path);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    readRestart(file, header, sizeof(struct CheckpointHeader));
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, 4) != 0 || header->version != CHECKPOINT_VERSION)
+    {
+        fprintf(stderr, "Error: %s is not a checkpoint file of this version\n", path);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (header->kind != kind || header->rank != rank || header->numRanks != size)
+    {
+        fprintf(stderr, "Error: Checkpoint file %s was written by a different actor or number of processes\n", path);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    restoreRandomState(header->randomState);
+    return file;
+}
+
+static void readRestart(FILE *file, void *data, size_t bytes)
+{
+    if (fread(data, 1, bytes, file) != bytes)
+    {
+        fprintf(stderr, "Error: Checkpoint file in %s is truncated\n", restartDirectory);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+}
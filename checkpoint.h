@@ -0,0 +1,19 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include "mpi.h"
+
+struct RoadMapState;
+struct VehicleStruct;
+
+void setRestartDirectory(const char *);
+int isRestarting();
+int isCheckpointMinute(int);
+void writeControlCheckpoint(int);
+int readControlCheckpoint();
+void receiveCheckpointMarker(const struct RoadMapState *, MPI_Message *, MPI_Status *);
+int readMapCheckpoint(struct RoadMapState *);
+void writeHostCheckpoint(int, const struct VehicleStruct *, int);
+int readHostCheckpoint(struct VehicleStruct *, int, int *);
+
+#endif /* CHECKPOINT_H_ */
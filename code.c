@@ -7,72 +7,138 @@
 #include <time.h>
 #include "pool.h"
 #include "mpi.h"
+#include "roadmap.h"
+#include "route.h"
 #include "code.h"
 #include "comm.h"
+#include "log.h"
+#include "partition.h"
+#include "board.h"
 #include "function.h"
 #include "worker.h"
+#include "migrate.h"
+#include "checkpoint.h"
 
-void printJunctionInfo(struct JunctionStruct *roadMap, int num_junctions)
+void printJunctionInfo(struct RoadMapState *state)
 {
-    for (int i = 0; i < num_junctions; i++)
+    const struct RoadTopology *topology = state->topology;
+    for (int local = 0; local < state->num_junctions; local++)
     {
-        printf("Junction %d:\n", roadMap[i].id);
-        printf("Number of roads: %d\n", roadMap[i].num_roads);
-        printf("Number of vehicles: %d\n", roadMap[i].num_vehicles);
-        printf("Has traffic lights: %s\n", roadMap[i].hasTrafficLights ? "Yes" : "No");
-        printf("Traffic lights road enabled: %d\n", roadMap[i].trafficLightsRoadEnabled);
-        printf("Total number of crashes: %d\n", roadMap[i].total_number_crashes);
-        printf("Total number of vehicles: %d\n", roadMap[i].total_number_vehicles);
+        int i = state->junctions[local];
+        printf("Junction %d:\n", i);
+        printf("Number of roads: %d\n", topology->roadOffsets[i + 1] - topology->roadOffsets[i]);
+        printf("Number of vehicles: %d\n", state->num_vehicles[local]);
+        printf("Has traffic lights: %s\n", topology->hasTrafficLights[i] ? "Yes" : "No");
+        printf("Traffic lights road enabled: %d\n", state->trafficLightsRoadEnabled[local]);
+        printf("Total number of crashes: %d\n", state->total_number_crashes[local]);
+        printf("Total number of vehicles: %d\n", state->total_number_vehicles[local]);
         printf("\n\n");
 
         printf("Roads:\n");
-        for (int j = 0; j < roadMap[i].num_roads; j++)
+        for (int road = topology->roadOffsets[i]; road < topology->roadOffsets[i + 1]; road++)
         {
-            printf("Road %d:\n", j);
-            printf("From Junction: %d\n", roadMap[i].roads[j].from->id);
-            printf("To Junction: %d\n", roadMap[i].roads[j].to->id);
-            printf("Road Length: %d\n", roadMap[i].roads[j].roadLength);
-            printf("Max Speed: %d\n", roadMap[i].roads[j].maxSpeed);
-            printf("Number of Vehicles on Road: %d\n", roadMap[i].roads[j].numVehiclesOnRoad);
-            printf("Current Speed: %d\n", roadMap[i].roads[j].currentSpeed);
-            printf("Total number of vehicles: %d\n", roadMap[i].roads[j].total_number_vehicles);
-            printf("Max concurrent vehicles: %d\n", roadMap[i].roads[j].max_concurrent_vehicles);
+            printf("Road %d:\n", road - topology->roadOffsets[i]);
+            printf("From Junction: %d\n", topology->roadFrom[road]);
+            printf("To Junction: %d\n", topology->roadTo[road]);
+            printf("Road Length: %d\n", topology->roadLength[road]);
+            printf("Max Speed: %d\n", topology->roadMaxSpeed[road]);
+            int localRoad = state->partition->roadIndex[road];
+            printf("Number of Vehicles on Road: %d\n", state->numVehiclesOnRoad[localRoad]);
+            printf("Current Speed: %d\n", state->currentSpeed[localRoad]);
+            printf("Total number of vehicles: %d\n", state->road_total_number_vehicles[localRoad]);
+            printf("Max concurrent vehicles: %d\n", state->max_concurrent_vehicles[localRoad]);
             printf("\n\n");
         }
     }
 }
 
-static void vehicle(char *);
-static void workerCode(char *);
-static void map(char *);
+static void vehicle(struct RoadTopology *, const struct ContractionHierarchy *, struct RoadBoard *);
+static void vehicleHost(struct RoadTopology *, const struct ContractionHierarchy *, struct RoadBoard *);
+static int activateHostedVehicles(struct VehicleStruct *, int, int, struct RoutePlanner *, struct VehicleScratch *);
+static void startVehicle(struct VehicleStruct *, struct RoutePlanner *, struct VehicleScratch *);
+static int planHostedRoutes(struct VehicleStruct *, int, struct RoutePlanner *, struct VehicleScratch *, struct RoadBoard *);
+static void setPlannedRoad(struct VehicleStruct *, int, const int *, const struct RoadTopology *);
+static int updateVehicle(struct VehicleStruct *, struct RoutePlanner *, struct VehicleScratch *, struct RoadBoard *, char);
+static void createVehicleScratch(struct VehicleScratch *, int, struct RoutePlanner *);
+static void freeVehicleScratch(struct VehicleScratch *);
+static void workerCode(struct RoadTopology *, const struct ContractionHierarchy *, struct RoadBoard *);
+static void map(struct RoadTopology *, struct RoadBoard *);
 static void control();
 
 int main(int argc, char *argv[])
 {
-    int rank, size;
-    MPI_Init(&argc, &argv);
+    int rank, size, provided;
+    // 路线规划的批量线程不调用MPI，只有主线程调用
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    initMessageTypes();
+    logInit();
 
-    if (argc != 2)
+    if (argc != 2 && argc != 3)
     {
-        fprintf(stderr, "Error: You need to provide the roadmap file as the only argument\n");
+        fprintf(stderr, "Error: You need to provide the roadmap file, and optionally a checkpoint directory to restart from, as arguments\n");
         exit(-1);
     }
-    srand(time(0));
-
+    if (argc == 3)
+    {
+        if (!USE_VEHICLE_HOSTS)
+        {
+            fprintf(stderr, "Error: Restarting from a checkpoint needs 'USE_VEHICLE_HOSTS'\n");
+            exit(-1);
+        }
+        // 每个演员从检查点目录中读取自己的文件
+        setRestartDirectory(argv[2]);
+    }
+    seedRandom(time(0));
+
+    // 每个节点只加载一次地图，放在节点共享内存中，必须在进程池启动之前由所有进程调用
+    struct RoadTopology topology;
+    loadSharedRoadTopology(argv[1], &topology);
+    // 如果地图旁边有预处理好的收缩层次（roadmap_ch生成），路径规划使用它
+    struct ContractionHierarchy hierarchy;
+    int hasHierarchy = mapContractionHierarchy(argv[1], &topology, &hierarchy);
+    // 路口和道路在多个map演员之间的划分
+    struct MapPartition partition;
+    createMapPartition(&topology, argv[1], NUM_MAP_ACTORS, &partition);
+    // map发布道路速度、路口车辆数量和信号灯的公告板，同一节点上的车辆直接读取
+    struct RoadBoard board;
+    createRoadBoard(&topology, &partition, &board);
+
+    // control和vehicle host之间每分钟归约统计信息的通信器
+    initStatistics();
+    // vehicle host之间迁移车辆的通信器
+    initMigration();
+
+    // 初始演员按启动顺序落在rank 1开始的固定rank上（control、map和vehicle host），这些rank不能成为子主进程
+    processPoolSetFixedRanks(USE_VEHICLE_HOSTS ? FIRST_VEHICLE_HOST_RANK + NUM_VEHICLE_HOSTS : MAP_ACTOR_RANK + NUM_MAP_ACTORS);
+    if (USE_WORK_STEALING)
+        processPoolSetScheduler(PP_STEALING_SCHEDULER);
     int statusCode = processPoolInit();
     if (statusCode == 1)
     {
-        workerCode(argv[1]);
+        workerCode(&topology, hasHierarchy ? &hierarchy : NULL, &board);
     }
     else if (statusCode == 2)
     {
         createInitialActor(0); // CONTROL_ACTOR_RANK
-        createInitialActor(1); // MAP_ACTOR_RANK
-        for (int i = 0; i < INITIAL_VEHICLES; i++)
+        for (int i = 0; i < NUM_MAP_ACTORS; i++)
         {
-            createInitialActor(2); // VEHICLE_ACTOR_RANK
+            createInitialActor(1); // MAP_ACTOR_RANK + i
+        }
+        if (USE_VEHICLE_HOSTS)
+        {
+            for (int i = 0; i < NUM_VEHICLE_HOSTS; i++)
+            {
+                createInitialActor(3); // FIRST_VEHICLE_HOST_RANK + i
+            }
+        }
+        else
+        {
+            for (int i = 0; i < INITIAL_VEHICLES; i++)
+            {
+                createInitialActor(2); // VEHICLE_ACTOR_RANK
+            }
         }
         printf("Initial actors created\n");
 
@@ -81,32 +147,61 @@ int main(int argc, char *argv[])
         {
             masterStatus = masterPoll();
         }
+        struct PP_Statistics poolStatistics;
+        getPoolStatistics(&poolStatistics);
+        printf("Process pool used at most %d of %d workers, %ld starts with %.1f us mean and %.1f us max start latency\n",
+               poolStatistics.highWaterMark, poolStatistics.numWorkers, poolStatistics.numStarts,
+               poolStatistics.numStarts > 0 ? 1e6 * poolStatistics.totalStartLatency / poolStatistics.numStarts : 0.0,
+               1e6 * poolStatistics.maxStartLatency);
+        long servedFromBacklog = poolStatistics.numQueued - poolStatistics.backlogDepth;
+        if (poolStatistics.numQueued > 0)
+        {
+            printf("Process pool backlog peaked at %d, %ld of %ld queued starts served after %.1f ms on average and at most %.1f ms\n",
+                   poolStatistics.maxBacklogDepth, servedFromBacklog, poolStatistics.numQueued,
+                   servedFromBacklog > 0 ? 1e3 * poolStatistics.totalQueueWait / servedFromBacklog : 0.0, 1e3 * poolStatistics.maxQueueWait);
+        }
+        if (USE_WORK_STEALING)
+        {
+            printf("Work stealing moved %ld tasks, %ld steal attempts found an empty deque\n", poolStatistics.numSteals, poolStatistics.numFailedSteals);
+        }
     }
 
     processPoolFinalise();
+    freeMigration();
+    freeStatistics();
+    freeRoadBoard(&board);
+    freeMapPartition(&partition);
+    if (hasHierarchy)
+        unmapContractionHierarchy(&hierarchy);
+    freeSharedRoadTopology(&topology);
+    freeMessageTypes();
+    logFlush();
     MPI_Finalize();
     return 0;
 }
 
-static void workerCode(char *filename)
+static void workerCode(struct RoadTopology *topology, const struct ContractionHierarchy *hierarchy, struct RoadBoard *board)
 {
-    int workerStatus = 1, data[1];
+    int workerStatus = 1;
     while (workerStatus)
     {
-        int parentId = getCommandData();
-        // 工作进程从创建它的进程接收data，从而知道自己是哪个actor
-        MPI_Recv(data, 1, MPI_INT, parentId, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        if (data[0] == 0)
+        // 唤醒命令携带的数据说明工作进程是哪个actor
+        int actorType = getCommandData();
+        if (actorType == 0)
         {
             control();
         }
-        else if (data[0] == 1)
+        else if (actorType == 1)
+        {
+            map(topology, board);
+        }
+        else if (actorType == 2)
         {
-            map(filename);
+            vehicle(topology, hierarchy, board);
         }
-        else if (data[0] == 2)
+        else if (actorType == 3)
         {
-            vehicle(filename);
+            vehicleHost(topology, hierarchy, board);
         }
         workerStatus = workerSleep();
     }
@@ -120,11 +215,19 @@ static void control()
     int elapsed_mins = 0;
     time_t start_seconds = getCurrentSeconds();
     time_t seconds = 0;
-    int total_vehicles = INITIAL_VEHICLES;
-    int passengers_delivered = 0;
-    int passengers_stranded = 0;
-    int vehicles_crashed = 0;
-    int vehicles_exhausted_fuel = 0;
+    // 统计数据在vehicle host本地累加，每分钟归约一次，车辆总数由车辆激活时的NEW_VEHICLE事件统计
+    int statistics[NUM_STATISTICS] = {0};
+    int reduced_mins = 0;
+    // 从检查点恢复时从检查点的分钟数继续，之前分钟的统计数据由vehicle host恢复
+    if (isRestarting())
+    {
+        elapsed_mins = readControlCheckpoint();
+        reduced_mins = elapsed_mins;
+    }
+    // 每辆车一个进程时每分钟的启动请求，新车辆可能在进程池的积压队列中等待空闲的进程
+    struct PP_StartRequest startRequests[MAX_MINS];
+    int startRanks[MAX_MINS][MAX_NEW_VEHICLES];
+    int num_start_requests = 0;
     while (1 == 1)
     {
         time_t current_seconds = getCurrentSeconds();
@@ -140,25 +243,59 @@ static void control()
                 {
                     // 每 MIN_LENGTH_SECONDS 秒意味着模拟时间过了一分钟
                     elapsed_mins++;
-                    // 每分钟随机生成 100-200 辆车
-                    int num_new_vehicles = getRandomInteger(100, 200);
-                    for (int i = 0; i < num_new_vehicles; i++)
+                    // 每分钟随机生成 MIN_NEW_VEHICLES 到 MAX_NEW_VEHICLES 辆车
+                    int num_new_vehicles = getRandomInteger(MIN_NEW_VEHICLES, MAX_NEW_VEHICLES);
+                    if (USE_VEHICLE_HOSTS)
+                    {
+                        // 新车辆作为数据平均分配给各个vehicle host，而不是为每辆车启动一个进程
+                        for (int i = 0; i < NUM_VEHICLE_HOSTS; i++)
+                        {
+                            int share = num_new_vehicles / NUM_VEHICLE_HOSTS + (i < num_new_vehicles % NUM_VEHICLE_HOSTS ? 1 : 0);
+                            sendNewVehicles(FIRST_VEHICLE_HOST_RANK + i, share);
+                        }
+                    }
+                    else if (isPoolBackpressured())
                     {
-                        int workerPid = startWorkerProcess();
-                        int new_ac_data = 3;
-                        MPI_Bsend(&new_ac_data, 1, MPI_INT, workerPid, 0, MPI_COMM_WORLD);
+                        // 进程池的积压队列过长，这一分钟不再加入新车辆
+                        printf("[Time: %d mins] Process pool backlog is full, no new vehicles this minute\n", elapsed_mins);
                     }
-                    total_vehicles += num_new_vehicles;
-                    // 每 SUMMARY_FREQUENCY 分钟输出一次状态
-                    if (elapsed_mins % SUMMARY_FREQUENCY == 0)
+                    else if (num_start_requests < MAX_MINS)
                     {
-                        printf("[Time: %d mins] %d vehicles, %d passengers delivered, %d stranded passengers, %d crashed vehicles, %d vehicles exhausted fuel\n",
-                               elapsed_mins, total_vehicles, passengers_delivered, passengers_stranded, vehicles_crashed, vehicles_exhausted_fuel);
+                        // 一次请求启动所有新车辆，车辆类型随唤醒命令一起发送，不等待它们启动
+                        int actorTypes[MAX_NEW_VEHICLES];
+                        for (int i = 0; i < num_new_vehicles; i++)
+                        {
+                            actorTypes[i] = 2;
+                        }
+                        startWorkerProcessesAsync(num_new_vehicles, startRanks[num_start_requests], actorTypes, &startRequests[num_start_requests]);
+                        num_start_requests++;
                     }
+                    // 开始这一分钟的统计归约
+                    reduceStatistics();
+                    if (isCheckpointMinute(elapsed_mins))
+                        writeControlCheckpoint(elapsed_mins);
                 }
             }
         }
 
+        /*
+         * 某一分钟的归约完成后，每 SUMMARY_FREQUENCY 分钟输出一次状态
+         */
+        int completed_mins = completeStatistics(statistics);
+        if (completed_mins > 0)
+        {
+            reduced_mins = completed_mins;
+            if (reduced_mins % SUMMARY_FREQUENCY == 0)
+            {
+                printf("[Time: %d mins] %d vehicles, %d passengers delivered, %d stranded passengers, %d crashed vehicles, %d vehicles exhausted fuel\n",
+                       reduced_mins, statistics[STAT_TOTAL_VEHICLES], statistics[STAT_PASSENGERS_DELIVERED], statistics[STAT_PASSENGERS_STRANDED],
+                       statistics[STAT_VEHICLES_CRASHED], statistics[STAT_VEHICLES_EXHAUSTED_FUEL]);
+            }
+        }
+
+        // 工作窃取调度时，其他进程从control的双端队列窃取它启动的车辆
+        processPoolProgress();
+
         /*
          * 接收消息，进行对应处理
          */
@@ -169,22 +306,28 @@ static void control()
         {
             if (status.MPI_TAG == TAG_STATISITIC)
             {
-                receiveControlMessage(&total_vehicles, &passengers_delivered, &passengers_stranded, &vehicles_crashed, &vehicles_exhausted_fuel);
+                receiveControlMessage();
             }
         }
 
         /*
-         * 检查是否模拟结束
+         * 检查是否模拟结束，最后一分钟的统计归约完成之后才停止
          */
-        if (elapsed_mins >= MAX_MINS)
+        if (elapsed_mins >= MAX_MINS && reduced_mins >= MAX_MINS)
         {
+            // 仍在积压队列中的车辆不再等待
+            for (int i = 0; i < num_start_requests; i++)
+            {
+                if (!testStartRequest(&startRequests[i]))
+                    cancelStartRequest(&startRequests[i]);
+            }
             shutdownPool();
             break;
         }
     }
 }
 
-static void map(char *filename)
+static void map(struct RoadTopology *topology, struct RoadBoard *board)
 {
     int elapsed_mins = 0;
     time_t start_seconds = getCurrentSeconds();
@@ -193,18 +336,33 @@ static void map(char *filename)
     /*
      * 初始化地图
      */
-    struct JunctionStruct *roadMap = NULL;
-    int num_junctions, num_roads = 0;
-    loadRoadMap(filename, &roadMap, &num_junctions, &num_roads);
-    // printf("Loaded road map from file\n");
-    // printJunctionInfo(roadMap, num_junctions);
-
+    int myRank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+    struct RoadMapState roadMap;
+    createRoadMapState(topology, board->partition, myRank, &roadMap);
+    if (isRestarting())
+        elapsed_mins = readMapCheckpoint(&roadMap);
+    updateTrafficLights(&roadMap, elapsed_mins);
+    publishTrafficLights(board, &roadMap, elapsed_mins);
+    // printJunctionInfo(&roadMap);
+
+    // 每次循环收到的读请求先排队，等所有更新处理完之后一起回答
+    QueuedRequest *requests = (QueuedRequest *)malloc(sizeof(QueuedRequest) * MAP_MAX_DRAIN);
+    MPI_Request *sendRequests = (MPI_Request *)malloc(sizeof(MPI_Request) * MAP_MAX_DRAIN);
+    // 启动之后map不应再有堆分配
+    long start_allocations = getAllocationCount();
+
+    // 收到停止指令后，需要等待所有vehicle host停止，否则host可能阻塞在对map的请求上
+    char stopping = 0;
+    int hosts_stopped = 0;
     while (1 == 1)
     {
         /*
          * 检测是否应该停止
          */
         if (shouldWorkerStop())
+            stopping = 1;
+        if (stopping && (!USE_VEHICLE_HOSTS || hosts_stopped == NUM_VEHICLE_HOSTS))
             break;
 
         /*
@@ -219,84 +377,92 @@ static void map(char *filename)
                 if ((seconds - start_seconds) % MIN_LENGTH_SECONDS == 0)
                 {
                     elapsed_mins++;
+                    // 信号灯只在模拟时间的分钟数变化时切换
+                    updateTrafficLights(&roadMap, elapsed_mins);
+                    publishTrafficLights(board, &roadMap, elapsed_mins);
+                    LOG_INFO(LOG_MAP_MINUTE, elapsed_mins, 0, 0, 0, 0);
                 }
             }
         }
 
         /*
-         * 更新信号灯和所有道路的限速
+         * 取出收件箱中所有待处理的消息（每次最多MAP_MAX_DRAIN条），用匹配探测保证探测到的消息就是接收到的消息。
+         * 车辆数量的更新立即生效，读请求排队
          */
-        for (int i = 0; i < num_junctions; i++)
+        int num_requests = 0, num_drained = 0;
+        while (num_drained < MAP_MAX_DRAIN)
         {
-
-            // 更新信号灯
-            if (roadMap[i].hasTrafficLights && roadMap[i].num_roads > 0)
+            int flag;
+            MPI_Message message;
+            MPI_Status status;
+            MPI_Improbe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &message, &status);
+            if (!flag)
+                break;
+            num_drained++;
+            if (status.MPI_TAG == TAG_TRANSITION)
             {
-                roadMap[i].trafficLightsRoadEnabled = elapsed_mins % roadMap[i].num_roads;
+                receiveTransition(&roadMap, &message);
             }
-
-            // 更新道路的限速
-            for (int j = 0; j < roadMap[i].num_roads; j++)
+            else if (status.MPI_TAG == TAG_REQUEST_ROAD_SPEED || status.MPI_TAG == TAG_REQUEST_INFO)
             {
-                struct RoadStruct *road = &roadMap[i].roads[j];
-                road->currentSpeed = road->maxSpeed - road->numVehiclesOnRoad;
-                if (road->currentSpeed < 10)
-                    road->currentSpeed = 10;
+                receiveRequest(&message, &status, &requests[num_requests++]);
             }
-        }
-
-        /*
-         * 接收消息，进行对应的处理
-         */
-        int flag;
-        MPI_Status status;
-        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
-        if (flag)
-        {
-            if (status.MPI_TAG == TAG_JUNCTION)
+            else if (status.MPI_TAG == TAG_STOP)
             {
-                receiveJunctionUpdate(roadMap);
+                receiveStopSignal(&message);
+                hosts_stopped++;
             }
-            else if (status.MPI_TAG == TAG_ROAD)
+            else if (status.MPI_TAG == TAG_MIGRATION_FENCE)
             {
-                receiveRoadUpdate(roadMap);
+                forwardMigrationFence(&message, &status);
             }
-            else if (status.MPI_TAG == TAG_REQUEST_ROAD_SPEED)
+            else if (status.MPI_TAG == TAG_CHECKPOINT)
             {
-                handleRoadSpeedRequest(roadMap);
+                receiveCheckpointMarker(&roadMap, &message, &status);
             }
-            else if (status.MPI_TAG == TAG_REQUEST_INFO)
+            else
             {
-                handleJunctionInfoRequest(roadMap);
+                fprintf(stderr, "Error: Map actor received a message with unexpected tag %d from %d\n", status.MPI_TAG, status.MPI_SOURCE);
+                MPI_Abort(MPI_COMM_WORLD, 1);
             }
         }
+
+        /*
+         * 所有更新处理完之后只重新计算车辆数量变化了的道路的限速
+         */
+        updateDirtyRoadSpeeds(&roadMap);
+        publishRoadState(board, &roadMap);
+
+        /*
+         * 一起回答排队的读请求
+         */
+        answerRequests(&roadMap, requests, num_requests, sendRequests);
     }
+    if (COUNT_ALLOCATIONS)
+        printf("Map actor %d made %ld heap allocations after start up\n", myRank - MAP_ACTOR_RANK, getAllocationCount() - start_allocations);
+    free(requests);
+    free(sendRequests);
+    freeRoadMapState(&roadMap);
 }
 
 /*
- * vehicle演员
+ * vehicle演员，每个进程只运行一辆车
  */
-static void vehicle(char *filename)
+static void vehicle(struct RoadTopology *topology, const struct ContractionHierarchy *hierarchy, struct RoadBoard *board)
 {
-    /*
-     * 初始化vehicle内部的静态地图
-     */
-    struct JunctionStruct *roadMap = NULL;
-    int num_junctions, num_roads = 0;
-    loadRoadMap(filename, &roadMap, &num_junctions, &num_roads);
-    // printf("Loaded road map from file\n");
-    // printJunctionInfo(roadMap, num_junctions);
+    struct RoutePlanner planner;
+    initRoutePlanner(&planner, topology, hierarchy);
+    struct VehicleScratch scratch;
+    createVehicleScratch(&scratch, 1, &planner);
+    initMapMessaging(board->partition);
 
     /*
      * 对vehicle进行初始化
      */
     struct VehicleStruct vehicle;
-    activateRandomVehicle(&vehicle, num_junctions, roadMap);
+    startVehicle(&vehicle, &planner, &scratch);
     // printf("Vehicle activated\n");
 
-    // 给map发送消息更新vehicle所在的路口的车辆数量
-    sendJunctionUpdate(&vehicle, ARRIVE_JUNCTION);
-
     while (1 == 1)
     {
         /*
@@ -305,183 +471,458 @@ static void vehicle(char *filename)
         if (shouldWorkerStop())
             break;
 
+        if (!updateVehicle(&vehicle, &planner, &scratch, board, 1))
+            break;
+    }
+    freeMapMessaging();
+    freeVehicleScratch(&scratch);
+    freeRoutePlanner(&planner);
+}
+
+/*
+ * vehicle host演员，一个进程在连续的数组中托管一批车辆，每次循环推进所有车辆。
+ * control不再为每辆新车启动一个进程，而是把新车的数量作为数据发送给host
+ */
+static void vehicleHost(struct RoadTopology *topology, const struct ContractionHierarchy *hierarchy, struct RoadBoard *board)
+{
+    // 路线表由host上所有车辆共享
+    struct RoutePlanner planner;
+    initRoutePlanner(&planner, topology, hierarchy);
+
+    /*
+     * 车辆保存在连续的数组中，[0, num_vehicles) 为活跃车辆
+     */
+    struct VehicleStruct *vehicles = (struct VehicleStruct *)malloc(sizeof(struct VehicleStruct) * MAX_VEHICLES_PER_HOST);
+    int num_vehicles = 0;
+    struct VehicleScratch scratch;
+    createVehicleScratch(&scratch, MAX_VEHICLES_PER_HOST, &planner);
+    initMapMessaging(board->partition);
+    // 启动之后的堆分配只应来自路线表缓存的填充
+    long start_allocations = getAllocationCount();
+
+    // 初始车辆平均分配到每个host上
+    int myRank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+    int hostIndex = myRank - FIRST_VEHICLE_HOST_RANK;
+    int num_initial = INITIAL_VEHICLES / NUM_VEHICLE_HOSTS + (hostIndex < INITIAL_VEHICLES % NUM_VEHICLE_HOSTS ? 1 : 0);
+    // 经过的模拟分钟数，control每分钟给每个host发送一条新车辆消息，检查点之前要接收到这一分钟为止的所有消息
+    int elapsed_mins = 0, new_vehicle_messages = 0;
+    if (isRestarting())
+    {
+        // 从检查点恢复的车辆已经计入了map的路口和道路，不再发送转移消息
+        elapsed_mins = readHostCheckpoint(vehicles, MAX_VEHICLES_PER_HOST, &num_vehicles);
+        new_vehicle_messages = elapsed_mins;
+    }
+    else
+    {
+        num_vehicles = activateHostedVehicles(vehicles, num_vehicles, num_initial, &planner, &scratch);
+    }
+
+    time_t start_seconds = getCurrentSeconds();
+    time_t seconds = 0;
+    while (1 == 1)
+    {
         /*
-         * 检查燃料是否耗尽
+         * 检测是否应该停止
          */
-        if (getCurrentSeconds() - vehicle.start_t > vehicle.fuel)
+        if (shouldWorkerStop())
         {
-            // 发送统计信息
-            sendControlMessage(&vehicle, NO_FUEL);
+            // 完成正在进行的迁移，然后通知map该host不会再发送任何请求，停止信号在所有转移消息之后发送
+            num_vehicles = finishMigration(vehicles, num_vehicles);
+            freeMapMessaging();
+            sendStopSignal();
+            finishStatistics();
+            break;
+        }
 
-            // 发送消息给map，更新对应的位置的计数
-            if (vehicle.roadOn != NULL)
-            {
-                sendRoadUpdate(&vehicle, LEAVE_ROAD);
-            }
-            if (vehicle.currentJunction != NULL)
+        /*
+         * 每过一个模拟分钟，把本地累加的统计信息归约到control
+         */
+        time_t current_seconds = getCurrentSeconds();
+        if (current_seconds != seconds)
+        {
+            seconds = current_seconds;
+            if (seconds - start_seconds > 0 && (seconds - start_seconds) % MIN_LENGTH_SECONDS == 0)
             {
-                sendJunctionUpdate(&vehicle, LEAVE_JUNCTION);
+                elapsed_mins++;
+                reduceStatistics();
+                startBalancing(num_vehicles);
+                if (isCheckpointMinute(elapsed_mins))
+                {
+                    // 检查点是一致的切面：先激活control到这一分钟为止发出的所有新车辆，完成所有已经开始的迁移，
+                    // 这样map在收到标记之前处理的正好是检查点之前的所有转移消息
+                    while (new_vehicle_messages < elapsed_mins)
+                    {
+                        num_vehicles = activateHostedVehicles(vehicles, num_vehicles, receiveNewVehicles(), &planner, &scratch);
+                        new_vehicle_messages++;
+                    }
+                    num_vehicles = quiesceMigration(vehicles, num_vehicles);
+                    writeHostCheckpoint(elapsed_mins, vehicles, num_vehicles);
+                }
             }
-
-            // 跳出循环
-            break;
         }
 
         /*
-         * 如果车辆在道路上且不在路口上，判断是否移动车辆到下一个路口
+         * 迁出负载均衡计划要求的车辆，激活迁入的车辆
          */
-        if (vehicle.roadOn != NULL && vehicle.currentJunction == NULL)
-        {
-            // 如果时间不足一秒，跳过后续所有计算
-            time_t sec = getCurrentSeconds();
-            int latest_time = sec - vehicle.last_distance_check_secs;
-            if (latest_time < 1)
-                continue;
+        num_vehicles = progressMigration(vehicles, num_vehicles);
 
-            // 更新最后一次被检查的时间
-            vehicle.last_distance_check_secs = sec;
+        /*
+         * 接收control发来的新车辆描述，激活对应数量的车辆
+         */
+        int flag;
+        MPI_Iprobe(CONTROL_ACTOR_RANK, TAG_NEW_VEHICLES, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
+        if (flag)
+        {
+            int num_new_vehicles = receiveNewVehicles();
+            num_vehicles = activateHostedVehicles(vehicles, num_vehicles, num_new_vehicles, &planner, &scratch);
+            new_vehicle_messages++;
+        }
 
-            // 更新到下一个路口的距离
-            double travelled_length = latest_time * vehicle.speed;
-            vehicle.remaining_distance -= travelled_length;
+        /*
+         * 为所有在路口等待的车辆一次性批量规划下一条道路，规划和推进车辆的时间作为host的负载
+         */
+        double work_start = MPI_Wtime();
+        planHostedRoutes(vehicles, num_vehicles, &planner, &scratch, board);
 
-            // 判断车辆是否到达下一个路口，如果是则移动车辆到下一个路口
-            if (vehicle.remaining_distance <= 0)
+        /*
+         * 在一个循环中推进所有车辆，被移除的车辆用数组末尾的车辆填补，保持数组紧凑
+         * 这次循环中刚到达路口的车辆在下一次循环中批量规划
+         */
+        int i = 0;
+        while (i < num_vehicles)
+        {
+            if (updateVehicle(&vehicles[i], &planner, &scratch, board, 0))
             {
-                // 发送消息给map，更新对应的位置的计数
-                sendRoadUpdate(&vehicle, LEAVE_ROAD);
-                sendJunctionUpdate(&vehicle, ARRIVE_JUNCTION);
-
-                // 更新车辆的位置
-                vehicle.roadOn = NULL;
-                vehicle.currentJunction = vehicle.roadOn->to;
-
-                // 更新其他信息
-                vehicle.remaining_distance = 0;
-                vehicle.arrived_road_time = 0;
-                vehicle.speed = 0;
-                vehicle.last_distance_check_secs = 0;
+                i++;
+            }
+            else
+            {
+                num_vehicles--;
+                vehicles[i] = vehicles[num_vehicles];
             }
         }
+        recordHostCost(MPI_Wtime() - work_start);
+    }
+    if (COUNT_ALLOCATIONS)
+    {
+        printf("Vehicle host %d made %ld heap allocations after start up (%d route tables cached)\n",
+               hostIndex, getAllocationCount() - start_allocations, planner.numCached);
+    }
+    long migrated_out, migrated_in;
+    getMigrationTotals(&migrated_out, &migrated_in);
+    if (migrated_out > 0 || migrated_in > 0)
+    {
+        printf("Vehicle host %d migrated %ld vehicles out and %ld in\n", hostIndex, migrated_out, migrated_in);
+    }
+    free(vehicles);
+    freeVehicleScratch(&scratch);
+    freeRoutePlanner(&planner);
+}
 
-        /*
-         * 如果车辆在路口上且不在道路上
-         */
-        if (vehicle.currentJunction != NULL && vehicle.roadOn == NULL)
+/*
+ * 在host的车辆数组末尾激活指定数量的车辆，返回激活后的车辆数量
+ */
+static int activateHostedVehicles(struct VehicleStruct *vehicles, int num_vehicles, int num_new_vehicles, struct RoutePlanner *planner, struct VehicleScratch *scratch)
+{
+    if (num_vehicles + num_new_vehicles > MAX_VEHICLES_PER_HOST)
+    {
+        fprintf(stderr, "Warning: Vehicle host is full, dropping %d new vehicles, increase 'MAX_VEHICLES_PER_HOST'\n", num_vehicles + num_new_vehicles - MAX_VEHICLES_PER_HOST);
+        num_new_vehicles = MAX_VEHICLES_PER_HOST - num_vehicles;
+    }
+
+    // 所有新车辆的路线一起批量检查，然后通知map车辆出现在起始路口
+    activateRandomVehicles(&vehicles[num_vehicles], num_new_vehicles, planner, scratch);
+    for (int i = num_vehicles; i < num_vehicles + num_new_vehicles; i++)
+    {
+        TransitionMessage transition = createTransition();
+        transition.enteredJunction = vehicles[i].currentJunction;
+        sendTransition(&transition);
+    }
+    return num_vehicles + num_new_vehicles;
+}
+
+/*
+ * 随机初始化一辆车，并通知map车辆出现在起始路口
+ */
+static void startVehicle(struct VehicleStruct *vehicle, struct RoutePlanner *planner, struct VehicleScratch *scratch)
+{
+    activateRandomVehicles(vehicle, 1, planner, scratch);
+
+    // 给map发送消息更新vehicle所在的路口的车辆数量
+    TransitionMessage transition = createTransition();
+    transition.enteredJunction = vehicle->currentJunction;
+    sendTransition(&transition);
+}
+
+/*
+ * 为host上所有在路口等待规划（不在目的地且燃料未耗尽）的车辆请求道路速度，然后用一次批量查询规划它们的下一条道路，
+ * 返回规划的车辆数量
+ */
+static int planHostedRoutes(struct VehicleStruct *vehicles, int num_vehicles, struct RoutePlanner *planner, struct VehicleScratch *scratch, struct RoadBoard *board)
+{
+    const struct RoadTopology *topology = planner->topology;
+    time_t now = getCurrentSeconds();
+
+    // 先找出等待规划的车辆
+    int num_queries = 0, num_speeds = 0;
+    for (int i = 0; i < num_vehicles; i++)
+    {
+        struct VehicleStruct *vehicle = &vehicles[i];
+        if (vehicle->currentJunction == -1 || vehicle->roadOn != -1 || vehicle->plannedRoad != -1 ||
+            vehicle->currentJunction == vehicle->dest || now - vehicle->start_t > vehicle->fuel)
+            continue;
+        scratch->vehicleIndex[num_queries++] = i;
+    }
+
+    // 读取每辆车所在路口的道路速度
+    for (int q = 0; q < num_queries; q++)
+    {
+        struct VehicleStruct *vehicle = &vehicles[scratch->vehicleIndex[q]];
+        int numRoads = topology->roadOffsets[vehicle->currentJunction + 1] - topology->roadOffsets[vehicle->currentJunction];
+        if (USE_ROAD_BOARD)
+            readRoadSpeeds(board, vehicle->currentJunction, &scratch->speeds[num_speeds]);
+        else
+            requestRoadSpeeds(vehicle, numRoads, &scratch->speeds[num_speeds]);
+        scratch->queries[q].junction = vehicle->currentJunction;
+        scratch->queries[q].dest = vehicle->dest;
+        scratch->queries[q].speeds = &scratch->speeds[num_speeds];
+        num_speeds += numRoads;
+    }
+
+    planNextJunctions(planner, scratch->queries, num_queries);
+    for (int q = 0; q < num_queries; q++)
+    {
+        setPlannedRoad(&vehicles[scratch->vehicleIndex[q]], scratch->queries[q].next, scratch->queries[q].speeds, topology);
+    }
+    return num_queries;
+}
+
+/*
+ * 记录车辆从当前路口前往下一个路口要走的道路，以及该道路的当前速度
+ */
+static void setPlannedRoad(struct VehicleStruct *vehicle, int next_junction_target, const int *speeds, const struct RoadTopology *topology)
+{
+    int road_to_take = findAppropriateRoad(next_junction_target, vehicle->currentJunction, topology);
+    assert(road_to_take != -1 && topology->roadTo[road_to_take] == next_junction_target);
+    vehicle->plannedRoad = road_to_take;
+    vehicle->plannedSpeed = speeds[road_to_take - topology->roadOffsets[vehicle->currentJunction]];
+}
+
+/*
+ * 推进一辆车的状态，返回1表示车辆仍然活跃，返回0表示车辆已被移除。
+ * 在路口上还没有规划下一条道路的车辆，如果planInline为0则等待批量规划，否则立即单独规划
+ */
+static int updateVehicle(struct VehicleStruct *vehicle, struct RoutePlanner *planner, struct VehicleScratch *scratch, struct RoadBoard *board, char planInline)
+{
+    const struct RoadTopology *topology = planner->topology;
+
+    /*
+     * 检查燃料是否耗尽
+     */
+    if (getCurrentSeconds() - vehicle->start_t > vehicle->fuel)
+    {
+        // 发送统计信息
+        sendControlMessage(vehicle, NO_FUEL);
+
+        // 发送消息给map，更新对应的位置的计数
+        TransitionMessage transition = createTransition();
+        transition.leftRoad = vehicle->roadOn;
+        transition.leftJunction = vehicle->currentJunction;
+        if (transition.leftRoad != -1 || transition.leftJunction != -1)
         {
-            /*
-             * 判断是否到达目的地
-             */
-            if (vehicle.currentJunction->id == vehicle.dest)
-            {
-                // 发送统计信息
-                sendControlMessage(&vehicle, ARRIVE_DESTINATION);
+            sendTransition(&transition);
+        }
 
-                // 发送消息给map，更新对应的位置的计数
-                sendJunctionUpdate(&vehicle, LEAVE_JUNCTION);
+        vehicle->active = 0;
+        return 0;
+    }
 
-                // 跳出循环
-                break;
-            }
+    /*
+     * 如果车辆在道路上且不在路口上，判断是否移动车辆到下一个路口
+     */
+    if (vehicle->roadOn != -1 && vehicle->currentJunction == -1)
+    {
+        // 如果时间不足一秒，跳过后续所有计算
+        time_t sec = getCurrentSeconds();
+        int latest_time = sec - vehicle->last_distance_check_secs;
+        if (latest_time < 1)
+            return 1;
 
-            /*
-             * 规划路线，寻找下一个道路
-             */
-            // 向map发送消息，请求所在路口的所有道路的速度
-            int numRoads = vehicle.currentJunction->num_roads;
-            int *speeds = (int *)malloc(numRoads * sizeof(int));
-            requestRoadSpeeds(&vehicle, numRoads, speeds);
+        // 更新最后一次被检查的时间
+        vehicle->last_distance_check_secs = sec;
 
-            // 更新本地地图对应的道路的当前速度
-            for (int i = 0; i < numRoads; i++)
-            {
-                vehicle.currentJunction->roads[i].currentSpeed = speeds[i];
-            }
-            free(speeds);
+        // 更新到下一个路口的距离
+        double travelled_length = latest_time * vehicle->speed;
+        vehicle->remaining_distance -= travelled_length;
 
-            // 规划路线
-            int next_junction_target = planRoute(vehicle.source, vehicle.dest, num_junctions, roadMap);
-            int road_to_take = findAppropriateRoad(next_junction_target, vehicle.currentJunction);
-            assert(vehicle.currentJunction->roads[road_to_take].to->id == next_junction_target);
+        // 判断车辆是否到达下一个路口，如果是则移动车辆到下一个路口
+        if (vehicle->remaining_distance <= 0)
+        {
+            // 更新车辆的位置，离开道路和到达路口在一条消息中发送给map
+            TransitionMessage transition = createTransition();
+            transition.leftRoad = vehicle->roadOn;
+            vehicle->currentJunction = topology->roadTo[vehicle->roadOn];
+            vehicle->roadOn = -1;
+            transition.enteredJunction = vehicle->currentJunction;
+            sendTransition(&transition);
+
+            // 更新其他信息
+            vehicle->remaining_distance = 0;
+            vehicle->arrived_road_time = 0;
+            vehicle->speed = 0;
+            vehicle->last_distance_check_secs = 0;
+        }
+    }
 
-            /*
-             * 移动车辆到目标道路上
-             */
-            vehicle.roadOn = &vehicle.currentJunction->roads[road_to_take];
+    /*
+     * 如果车辆在路口上且不在道路上
+     */
+    if (vehicle->currentJunction != -1 && vehicle->roadOn == -1)
+    {
+        /*
+         * 判断是否到达目的地
+         */
+        if (vehicle->currentJunction == vehicle->dest)
+        {
+            // 发送统计信息
+            sendControlMessage(vehicle, ARRIVE_DESTINATION);
 
             // 发送消息给map，更新对应的位置的计数
-            sendRoadUpdate(&vehicle, ARRIVE_ROAD);
+            TransitionMessage transition = createTransition();
+            transition.leftJunction = vehicle->currentJunction;
+            sendTransition(&transition);
 
-            // 更新车辆的其他信息
-            vehicle.remaining_distance = vehicle.roadOn->roadLength;
-            vehicle.speed = vehicle.roadOn->currentSpeed;
-            if (vehicle.speed > vehicle.maxSpeed)
-            {
-                vehicle.speed = vehicle.maxSpeed;
-            }
+            vehicle->active = 0;
+            return 0;
         }
 
         /*
-         * 如果车辆的道路和路口都不为空，判断车辆是否能从路口释放
+         * 规划路线，寻找下一个道路
          */
-        if (vehicle.roadOn != NULL && vehicle.currentJunction != NULL)
+        if (vehicle->plannedRoad == -1)
         {
-            char take_road = 0;
+            // 等待下一次批量规划
+            if (!planInline)
+                return 1;
 
-            /*
-             * 如果路口有信号灯，仅当信号灯允许时，车辆才能通过路口
-             */
-            if (vehicle.currentJunction->hasTrafficLights)
-            {
-                // 判断信号灯是否允许通过
-                int trafficLightsRoadEnabled;
-                requestJunctionInfo(&vehicle, REQUEST_AVAILABLE_ROAD, &trafficLightsRoadEnabled);
-                take_road = vehicle.roadOn == &vehicle.currentJunction->roads[trafficLightsRoadEnabled];
-            }
-
-            /*
-             * 如果没有信号灯，判断是否发生碰撞事件，如果没有则车辆可以通过路口
-             */
+            // 向map发送消息，请求所在路口的所有道路的速度
+            // 所在路口道路的当前速度是车辆私有的数据，共享的拓扑只读
+            int numRoads = topology->roadOffsets[vehicle->currentJunction + 1] - topology->roadOffsets[vehicle->currentJunction];
+            if (USE_ROAD_BOARD)
+                readRoadSpeeds(board, vehicle->currentJunction, scratch->speeds);
             else
-            {
-                // 计算碰撞概率
-                int num_vehicles;
-                requestJunctionInfo(&vehicle, REQUEST_JUNCTION_NUM_VEHICLES, &num_vehicles);
-                int collision = getRandomInteger(0, 8) * num_vehicles;
+                requestRoadSpeeds(vehicle, numRoads, scratch->speeds);
 
-                // 如果发生碰撞，车辆移除
-                if (collision > 40)
-                {
-                    // 发送统计信息
-                    sendControlMessage(&vehicle, VEHICLE_COLLISION);
+            // 从当前所在的路口规划路线
+            int next_junction_target = planNextJunction(planner, vehicle->currentJunction, vehicle->dest, scratch->speeds);
+            setPlannedRoad(vehicle, next_junction_target, scratch->speeds, topology);
+        }
 
-                    // 发送消息给map，更新对应的位置的计数
-                    if (vehicle.roadOn != NULL)
-                    {
-                        sendRoadUpdate(&vehicle, LEAVE_ROAD);
-                    }
-                    if (vehicle.currentJunction != NULL)
-                    {
-                        sendJunctionUpdate(&vehicle, LEAVE_JUNCTION);
-                    }
+        /*
+         * 移动车辆到目标道路上
+         */
+        vehicle->roadOn = vehicle->plannedRoad;
+        vehicle->plannedRoad = -1;
+
+        // 发送消息给map，更新对应的位置的计数
+        TransitionMessage transition = createTransition();
+        transition.enteredRoad = vehicle->roadOn;
+        sendTransition(&transition);
+
+        // 更新车辆的其他信息
+        vehicle->remaining_distance = topology->roadLength[vehicle->roadOn];
+        vehicle->speed = vehicle->plannedSpeed;
+        if (vehicle->speed > vehicle->maxSpeed)
+        {
+            vehicle->speed = vehicle->maxSpeed;
+        }
+    }
 
-                    // 跳出循环
-                    break;
-                }
+    /*
+     * 如果车辆的道路和路口都不为空，判断车辆是否能从路口释放
+     */
+    if (vehicle->roadOn != -1 && vehicle->currentJunction != -1)
+    {
+        char take_road = 0;
 
-                // 车辆可以通过路口
-                take_road = 1;
-            }
+        /*
+         * 如果路口有信号灯，仅当信号灯允许时，车辆才能通过路口
+         */
+        if (topology->hasTrafficLights[vehicle->currentJunction])
+        {
+            // 判断信号灯是否允许通过
+            int trafficLightsRoadEnabled;
+            if (USE_ROAD_BOARD)
+                trafficLightsRoadEnabled = readTrafficLights(board, vehicle->currentJunction);
+            else
+                requestJunctionInfo(vehicle, REQUEST_AVAILABLE_ROAD, &trafficLightsRoadEnabled);
+            take_road = vehicle->roadOn == topology->roadOffsets[vehicle->currentJunction] + trafficLightsRoadEnabled;
+        }
 
-            if (take_road)
+        /*
+         * 如果没有信号灯，判断是否发生碰撞事件，如果没有则车辆可以通过路口
+         */
+        else
+        {
+            // 计算碰撞概率
+            int num_vehicles;
+            if (USE_ROAD_BOARD)
+                num_vehicles = readJunctionVehicles(board, vehicle->currentJunction);
+            else
+                requestJunctionInfo(vehicle, REQUEST_JUNCTION_NUM_VEHICLES, &num_vehicles);
+            int collision = getRandomInteger(0, 8) * num_vehicles;
+
+            // 如果发生碰撞，车辆移除
+            if (collision > 40)
             {
+                // 发送统计信息
+                sendControlMessage(vehicle, VEHICLE_COLLISION);
+
                 // 发送消息给map，更新对应的位置的计数
-                sendJunctionUpdate(&vehicle, LEAVE_JUNCTION);
+                TransitionMessage transition = createTransition();
+                transition.leftRoad = vehicle->roadOn;
+                transition.leftJunction = vehicle->currentJunction;
+                sendTransition(&transition);
 
-                // 更新车辆的其他信息
-                vehicle.currentJunction = NULL;
-                vehicle.last_distance_check_secs = getCurrentSeconds();
+                vehicle->active = 0;
+                return 0;
             }
+
+            // 车辆可以通过路口
+            take_road = 1;
+        }
+
+        if (take_road)
+        {
+            // 发送消息给map，更新对应的位置的计数
+            TransitionMessage transition = createTransition();
+            transition.leftJunction = vehicle->currentJunction;
+            sendTransition(&transition);
+
+            // 更新车辆的其他信息
+            vehicle->currentJunction = -1;
+            vehicle->last_distance_check_secs = getCurrentSeconds();
         }
     }
+    return 1;
+}
+
+/*
+ * 按车辆容量和地图中道路最多的路口分配vehicle演员的缓冲区，并为同样大小的批量路线查询预留空间
+ */
+static void createVehicleScratch(struct VehicleScratch *scratch, int capacity, struct RoutePlanner *planner)
+{
+    scratch->capacity = capacity;
+    scratch->queries = (struct RouteQuery *)malloc(sizeof(struct RouteQuery) * capacity);
+    scratch->vehicleIndex = (int *)malloc(sizeof(int) * capacity);
+    scratch->speeds = (int *)malloc(sizeof(int) * capacity * planner->maxRoads);
+    reserveRouteBatch(planner, capacity);
+}
+
+static void freeVehicleScratch(struct VehicleScratch *scratch)
+{
+    free(scratch->queries);
+    free(scratch->vehicleIndex);
+    free(scratch->speeds);
 }
@@ -1,14 +1,26 @@
 
 #define VERBOSE_ROUTE_PLANNER 0
-#define LARGE_NUM 99999999.0
+// 路线规划使用定点数的行驶时间，单位为 1/ROUTE_COST_SCALE
+#define ROUTE_COST_SCALE 1000
+#define ROUTE_INFINITY INT64_MAX
+// 1表示使用每个目的地的反向最短路径表回答路线查询，0表示每次查询都运行planRoute
+#define USE_ROUTE_TABLES 1
+// 缓存的表的数量上限，超过时淘汰最早建的表；1表示启动时为每个路口建表，这时缓存容纳所有路口的表，内存为路口数的平方
+#define ROUTE_TABLE_CACHE_SIZE 256
+#define ROUTE_TABLES_UP_FRONT 0
+// 批量路线规划使用的线程数（包括调用线程），批量中不同的查询达到这个数量时才分给多个线程
+#define ROUTE_BATCH_THREADS 4
+#define ROUTE_BATCH_MIN_PARALLEL 64
 
 #define MAX_ROAD_LEN 100
 #define MAX_VEHICLES 4
 #define MAX_MINS 10
 #define MIN_LENGTH_SECONDS 2
-#define MAX_NUM_ROADS_PER_JUNCTION 50
 #define SUMMARY_FREQUENCY 5
 #define INITIAL_VEHICLES 1
+// control每分钟生成的新车辆数量的范围
+#define MIN_NEW_VEHICLES 100
+#define MAX_NEW_VEHICLES 200
 
 #define BUS_PASSENGERS 80
 #define BUS_MAX_SPEED 50
@@ -36,7 +48,36 @@
 #define BIKE_MAX_FUEL 10
 
 #define CONTROL_ACTOR_RANK 1
+// 路网按路口划分给多个map演员，rank从MAP_ACTOR_RANK开始连续排列，每个map演员拥有一部分路口和从这些路口出发的道路
 #define MAP_ACTOR_RANK 2
+#define NUM_MAP_ACTORS 2
+// map每次循环最多从收件箱取出的消息数量
+#define MAP_MAX_DRAIN 4096
+// 1表示车辆直接读取map发布在公告板（board.h）上的道路速度、路口车辆数量和信号灯，0表示每次读取都向map发送请求
+#define USE_ROAD_BOARD 1
+
+// 1表示车辆由vehicle host批量托管，0表示每辆车占用一个工作进程
+#define USE_VEHICLE_HOSTS 1
+#define NUM_VEHICLE_HOSTS 2
+#define FIRST_VEHICLE_HOST_RANK (MAP_ACTOR_RANK + NUM_MAP_ACTORS)
+#define MAX_VEHICLES_PER_HOST 100000
+// 1表示统计进程的所有堆分配，由Makefile定义（make COUNT_ALLOCATIONS=0 关闭）
+#ifndef COUNT_ALLOCATIONS
+#define COUNT_ALLOCATIONS 0
+#endif
+// 1表示vehicle host每个模拟分钟比较推进车辆的开销，把车辆从开销高的host迁移到开销低的host（migrate.c）
+#define USE_VEHICLE_MIGRATION 1
+// host的开销超过平均值的这一比例时才迁出车辆，每批最多迁移的车辆数量
+#define MIGRATION_IMBALANCE 0.2
+#define MIGRATION_MAX_BATCH 1000
+// 1表示进程池使用工作窃取调度（steal.c），每个进程从自己的双端队列运行演员，空闲进程向随机进程窃取，0表示由主进程启动每个演员
+#define USE_WORK_STEALING 0
+// 每隔多少个模拟分钟写一次协调检查点（checkpoint.c），0表示不写。每个演员把自己的状态并行写到
+// CHECKPOINT_DIRECTORY/minute_<分钟>/ 下自己的二进制文件中，./code <地图> <检查点目录> 从检查点（例如保存下来的预热好的状态）继续模拟
+#define CHECKPOINT_FREQUENCY 0
+#define CHECKPOINT_DIRECTORY "checkpoints"
+// 随机数生成器状态的字节数（initstate），随检查点保存
+#define RANDOM_STATE_BYTES 256
 
 enum ReadMode
 {
@@ -55,20 +96,32 @@ enum VehicleType
     BIKE
 };
 
-struct JunctionStruct
-{
-    int id, num_roads, num_vehicles;
-    char hasTrafficLights;
-    int trafficLightsRoadEnabled;
-    int total_number_crashes, total_number_vehicles;
-    struct RoadStruct *roads;
-};
+struct MapPartition;
 
-struct RoadStruct
+/*
+ * map演员持有的可变路网状态，只包含它拥有的路口和道路，数组按划分中的本地下标（junctionIndex和roadIndex）存放，
+ * 同一路口的道路下标连续，没有每个路口的道路数量上限
+ */
+struct RoadMapState
 {
-    struct JunctionStruct *from, *to;
-    int roadLength, maxSpeed, numVehiclesOnRoad, currentSpeed;
-    int total_number_vehicles, max_concurrent_vehicles;
+    const struct RoadTopology *topology;
+    const struct MapPartition *partition;
+    // 拥有的路口和道路的数量，以及每个本地下标对应的拓扑中的路口和道路
+    int num_junctions, num_roads;
+    int *junctions, *roads;
+    // 每个路口的状态
+    int *num_vehicles, *trafficLightsRoadEnabled;
+    int *total_number_crashes, *total_number_vehicles;
+    // 热数据：每次更新限速和回答请求都会访问（道路长度和最大速度在拓扑中）
+    int *numVehiclesOnRoad, *currentSpeed;
+    // 冷数据：仅用于统计
+    int *road_total_number_vehicles, *max_concurrent_vehicles;
+    // 车辆数量变化后限速需要重新计算的道路，每条道路在集合中最多出现一次
+    int *dirtyRoads, numDirtyRoads;
+    char *roadDirty;
+    // 车辆数量变化后需要发布到公告板的路口
+    int *dirtyJunctions, numDirtyJunctions;
+    char *junctionDirty;
 };
 
 struct VehicleStruct
@@ -79,7 +132,21 @@ struct VehicleStruct
     time_t last_distance_check_secs, start_t;
     double remaining_distance;
     char active;
-    struct JunctionStruct *currentJunction;
-    struct RoadStruct *roadOn;
+    // 所在路口和道路在拓扑中的下标，-1表示不在路口或道路上
+    int currentJunction, roadOn;
+    // 在路口上已经规划好的下一条道路及其速度，-1表示还没有规划
+    int plannedRoad, plannedSpeed;
 };
 
+
+/*
+ * vehicle和vehicle host演员的缓冲区，启动时按车辆容量和地图中道路最多的路口分配，之后整个生命周期重用：
+ * 等待规划的车辆的查询和它们在数组中的下标，以及所在路口道路的速度（每辆车最多maxRoads个）
+ */
+struct VehicleScratch
+{
+    int capacity;
+    struct RouteQuery *queries;
+    int *vehicleIndex;
+    int *speeds;
+};
@@ -7,111 +7,268 @@
 #include <time.h>
 #include "pool.h"
 #include "mpi.h"
+#include "roadmap.h"
+#include "route.h"
 #include "code.h"
 #include "comm.h"
 #include "function.h"
 #include "worker.h"
+#include "log.h"
+#include "partition.h"
+
+// 转移消息的派生数据类型，以及vehicle演员发往每个map演员的持久发送请求和它们的发送缓冲区
+static MPI_Datatype transitionType = MPI_DATATYPE_NULL;
+static TransitionMessage transitionBuffers[NUM_MAP_ACTORS][TRANSITION_SEND_SLOTS];
+static MPI_Request transitionRequests[NUM_MAP_ACTORS][TRANSITION_SEND_SLOTS];
+static int nextTransitionSlot[NUM_MAP_ACTORS];
+// 路口和道路属于哪个map演员，vehicle演员的消息和请求按它发送给对应的map演员
+static const struct MapPartition *mapPartition = NULL;
+
+// control和vehicle host组成的统计通信器，host本地累加的统计总数，以及每个模拟分钟的归约请求和缓冲区
+static MPI_Comm statisticsComm = MPI_COMM_NULL;
+static int localStatistics[NUM_STATISTICS];
+static int reduceBuffers[MAX_MINS][NUM_STATISTICS];
+static MPI_Request reduceRequests[MAX_MINS];
+static int numReductions = 0, numCompleted = 0;
+
+static void postTransition(int, const TransitionMessage *);
+static void addStatistic(int *, int, int);
+static void markRoadDirty(struct RoadMapState *, int);
+static void markJunctionDirty(struct RoadMapState *, int);
 
 /**
- * vehicle发送消息给map，更新路口的车辆数量
+ * 创建消息使用的MPI派生数据类型，每个进程在MPI初始化之后调用一次
  */
-void sendJunctionUpdate(struct VehicleStruct *vehicle, int messageType)
+void initMessageTypes()
 {
-    JunctionMessage msg;
-    msg.messageType = messageType;
-    msg.junctionId = vehicle->currentJunction->id;
-
-    printf("Sending Junction Update: MessageType=%d, JunctionId=%d\n", msg.messageType, msg.junctionId);
-
-    MPI_Send(&msg, 2, MPI_INT, MAP_ACTOR_RANK, TAG_JUNCTION, MPI_COMM_WORLD);
+    TransitionMessage msg = createTransition();
+    MPI_Aint msgAddress, addresses[4];
+    MPI_Get_address(&msg, &msgAddress);
+    MPI_Get_address(&msg.leftJunction, &addresses[0]);
+    MPI_Get_address(&msg.leftRoad, &addresses[1]);
+    MPI_Get_address(&msg.enteredJunction, &addresses[2]);
+    MPI_Get_address(&msg.enteredRoad, &addresses[3]);
+    int blocklengths[4] = {1, 1, 1, 1};
+    MPI_Datatype types[4] = {MPI_INT, MPI_INT, MPI_INT, MPI_INT};
+    MPI_Aint offsets[4];
+    for (int i = 0; i < 4; i++)
+    {
+        offsets[i] = addresses[i] - msgAddress;
+    }
+    MPI_Type_create_struct(4, blocklengths, offsets, types, &transitionType);
+    MPI_Type_commit(&transitionType);
 }
 
 /**
- * map接收vehicle发送的消息，更新路口的车辆数量
+ * 释放消息使用的MPI派生数据类型
  */
-void receiveJunctionUpdate(struct JunctionStruct *roadMap)
+void freeMessageTypes()
 {
-    JunctionMessage msg;
-    MPI_Status status;
-
-    MPI_Recv(&msg, 2, MPI_INT, MPI_ANY_SOURCE, TAG_JUNCTION, MPI_COMM_WORLD, &status);
-
-    printf("Received Junction Update: MessageType=%d, JunctionId=%d from Source=%d\n", msg.messageType, msg.junctionId, status.MPI_SOURCE);
+    MPI_Type_free(&transitionType);
+}
 
-    if (msg.messageType == ARRIVE_JUNCTION)
-    {
-        roadMap[msg.junctionId].num_vehicles++;
-        roadMap[msg.junctionId].total_number_vehicles++;
-    }
-    else if (msg.messageType == LEAVE_JUNCTION)
+/**
+ * vehicle演员启动时记录路网的划分，并为发往每个map演员的转移消息创建持久发送请求，整个演员生命周期中重复使用
+ */
+void initMapMessaging(const struct MapPartition *partition)
+{
+    mapPartition = partition;
+    for (int m = 0; m < NUM_MAP_ACTORS; m++)
     {
-        roadMap[msg.junctionId].num_vehicles--;
+        for (int i = 0; i < TRANSITION_SEND_SLOTS; i++)
+        {
+            MPI_Send_init(&transitionBuffers[m][i], 1, transitionType, MAP_ACTOR_RANK + m, TAG_TRANSITION, MPI_COMM_WORLD, &transitionRequests[m][i]);
+        }
+        nextTransitionSlot[m] = 0;
     }
 }
 
 /**
- * vehicle发送消息给map，更新道路的车辆数量
+ * vehicle演员结束时等待所有转移消息发送完成，然后释放持久发送请求
  */
-void sendRoadUpdate(struct VehicleStruct *vehicle, int messageType)
+void freeMapMessaging()
 {
-    RoadMessage msg;
-    int roadIndex = -1;
-
-    // 查找当前车辆所在道路的索引
-    for (int i = 0; i < vehicle->currentJunction->num_roads; i++)
+    for (int m = 0; m < NUM_MAP_ACTORS; m++)
     {
-        if (&vehicle->currentJunction->roads[i] == vehicle->roadOn)
+        MPI_Waitall(TRANSITION_SEND_SLOTS, transitionRequests[m], MPI_STATUSES_IGNORE);
+        for (int i = 0; i < TRANSITION_SEND_SLOTS; i++)
         {
-            roadIndex = i;
-            break;
+            MPI_Request_free(&transitionRequests[m][i]);
         }
     }
+    mapPartition = NULL;
+}
 
-    // 确保成功找到道路索引
-    if (roadIndex != -1)
-    {
-        msg.messageType = messageType;
-        msg.junctionId = vehicle->currentJunction->id;
-        msg.roadId = roadIndex;
+/**
+ * 创建一个空的转移消息，没有离开或到达任何路口和道路
+ */
+TransitionMessage createTransition()
+{
+    TransitionMessage msg;
+    msg.leftJunction = msg.leftRoad = msg.enteredJunction = msg.enteredRoad = -1;
+    return msg;
+}
 
-        MPI_Send(&msg, 3, MPI_INT, MAP_ACTOR_RANK, TAG_ROAD, MPI_COMM_WORLD);
-    }
-    else
+/**
+ * vehicle发送一次状态转移给拥有其中路口和道路的map演员。转移涉及的路口和道路属于同一个map演员时只发送一条消息，
+ * 否则每个map演员只收到自己拥有的部分
+ */
+void sendTransition(const TransitionMessage *msg)
+{
+    int owners[4];
+    owners[0] = msg->leftJunction != -1 ? mapPartition->junctionOwner[msg->leftJunction] : -1;
+    owners[1] = msg->leftRoad != -1 ? mapPartition->roadOwner[msg->leftRoad] : -1;
+    owners[2] = msg->enteredJunction != -1 ? mapPartition->junctionOwner[msg->enteredJunction] : -1;
+    owners[3] = msg->enteredRoad != -1 ? mapPartition->roadOwner[msg->enteredRoad] : -1;
+
+    for (int i = 0; i < 4; i++)
     {
-        fprintf(stderr, "Error: Unable to find roadIndex for the vehicle on the road.\n");
+        // 前面已经发送过给该map演员的部分
+        int sent = owners[i] == -1;
+        for (int j = 0; j < i && !sent; j++)
+            sent = owners[j] == owners[i];
+        if (sent)
+            continue;
+
+        TransitionMessage part = createTransition();
+        if (owners[0] == owners[i])
+            part.leftJunction = msg->leftJunction;
+        if (owners[1] == owners[i])
+            part.leftRoad = msg->leftRoad;
+        if (owners[2] == owners[i])
+            part.enteredJunction = msg->enteredJunction;
+        if (owners[3] == owners[i])
+            part.enteredRoad = msg->enteredRoad;
+        postTransition(owners[i], &part);
     }
 }
 
 /**
- * map接收vehicle发送的消息，更新道路的车辆数量
+ * 轮流使用发往该map演员的持久发送请求，只需等待该请求上一次的发送完成，同一进程发往同一个map演员的消息按启动的顺序到达
  */
-void receiveRoadUpdate(struct JunctionStruct *roadMap)
+static void postTransition(int mapRank, const TransitionMessage *msg)
 {
-    RoadMessage msg;
+    int m = mapRank - MAP_ACTOR_RANK;
+    int slot = nextTransitionSlot[m];
+    nextTransitionSlot[m] = (nextTransitionSlot[m] + 1) % TRANSITION_SEND_SLOTS;
+    MPI_Wait(&transitionRequests[m][slot], MPI_STATUS_IGNORE);
+    transitionBuffers[m][slot] = *msg;
+
+    LOG_DEBUG(LOG_TRANSITION_SENT, msg->leftJunction, msg->leftRoad, msg->enteredJunction, msg->enteredRoad, mapRank);
+
+    MPI_Start(&transitionRequests[m][slot]);
+}
+
+/**
+ * map接收探测到的转移消息，先处理离开再处理到达，更新路口和道路的车辆数量。消息中是拓扑中的下标，转换为map状态中的本地下标
+ */
+void receiveTransition(struct RoadMapState *roadMap, MPI_Message *message)
+{
+    TransitionMessage msg;
     MPI_Status status;
 
-    MPI_Recv(&msg, 3, MPI_INT, MPI_ANY_SOURCE, TAG_ROAD, MPI_COMM_WORLD, &status);
+    MPI_Mrecv(&msg, 1, transitionType, message, &status);
+
+    LOG_DEBUG(LOG_TRANSITION_RECEIVED, msg.leftJunction, msg.leftRoad, msg.enteredJunction, msg.enteredRoad, status.MPI_SOURCE);
 
-    if (msg.messageType == ARRIVE_ROAD)
+    const struct MapPartition *partition = roadMap->partition;
+    if (msg.leftRoad != -1)
+        msg.leftRoad = partition->roadIndex[msg.leftRoad];
+    if (msg.leftJunction != -1)
+        msg.leftJunction = partition->junctionIndex[msg.leftJunction];
+    if (msg.enteredJunction != -1)
+        msg.enteredJunction = partition->junctionIndex[msg.enteredJunction];
+    if (msg.enteredRoad != -1)
+        msg.enteredRoad = partition->roadIndex[msg.enteredRoad];
+
+    if (msg.leftRoad != -1)
     {
-        roadMap[msg.junctionId].roads[msg.roadId].numVehiclesOnRoad++;
-        roadMap[msg.junctionId].roads[msg.roadId].total_number_vehicles++;
-        if (roadMap[msg.junctionId].roads[msg.roadId].numVehiclesOnRoad > roadMap[msg.junctionId].roads[msg.roadId].max_concurrent_vehicles)
+        roadMap->numVehiclesOnRoad[msg.leftRoad]--;
+        markRoadDirty(roadMap, msg.leftRoad);
+    }
+    if (msg.leftJunction != -1)
+    {
+        roadMap->num_vehicles[msg.leftJunction]--;
+        markJunctionDirty(roadMap, msg.leftJunction);
+    }
+    if (msg.enteredJunction != -1)
+    {
+        roadMap->num_vehicles[msg.enteredJunction]++;
+        roadMap->total_number_vehicles[msg.enteredJunction]++;
+        markJunctionDirty(roadMap, msg.enteredJunction);
+    }
+    if (msg.enteredRoad != -1)
+    {
+        int road = msg.enteredRoad;
+        roadMap->numVehiclesOnRoad[road]++;
+        roadMap->road_total_number_vehicles[road]++;
+        if (roadMap->numVehiclesOnRoad[road] > roadMap->max_concurrent_vehicles[road])
         {
-            roadMap[msg.junctionId].roads[msg.roadId].max_concurrent_vehicles = roadMap[msg.junctionId].roads[msg.roadId].numVehiclesOnRoad;
+            roadMap->max_concurrent_vehicles[road] = roadMap->numVehiclesOnRoad[road];
         }
+        markRoadDirty(roadMap, road);
     }
-    else if (msg.messageType == LEAVE_ROAD)
+}
+
+/**
+ * 道路的限速在本次循环的所有更新处理完之后重新计算
+ */
+static void markRoadDirty(struct RoadMapState *roadMap, int road)
+{
+    if (!roadMap->roadDirty[road])
     {
-        roadMap[msg.junctionId].roads[msg.roadId].numVehiclesOnRoad--;
+        roadMap->roadDirty[road] = 1;
+        roadMap->dirtyRoads[roadMap->numDirtyRoads++] = road;
     }
 }
 
 /**
- * vehicle发送消息给control，更新统计信息
+ * 路口的车辆数量在本次循环的所有更新处理完之后发布到公告板
+ */
+static void markJunctionDirty(struct RoadMapState *roadMap, int junction)
+{
+    if (!roadMap->junctionDirty[junction])
+    {
+        roadMap->junctionDirty[junction] = 1;
+        roadMap->dirtyJunctions[roadMap->numDirtyJunctions++] = junction;
+    }
+}
+
+/**
+ * 创建control和所有vehicle host组成的统计通信器，必须在进程池启动之前由所有进程调用。
+ * 每辆车一个进程时不创建，统计信息仍然逐条发送给control
+ */
+void initStatistics()
+{
+    if (!USE_VEHICLE_HOSTS)
+        return;
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    int member = rank == CONTROL_ACTOR_RANK || (rank >= FIRST_VEHICLE_HOST_RANK && rank < FIRST_VEHICLE_HOST_RANK + NUM_VEHICLE_HOSTS);
+    // control的rank最小，在统计通信器中为归约的根
+    MPI_Comm_split(MPI_COMM_WORLD, member ? 0 : MPI_UNDEFINED, rank, &statisticsComm);
+}
+
+/**
+ * 释放统计通信器
+ */
+void freeStatistics()
+{
+    if (statisticsComm != MPI_COMM_NULL)
+        MPI_Comm_free(&statisticsComm);
+}
+
+/**
+ * vehicle更新统计信息。vehicle host在本地累加，每辆车一个进程时发送消息给control
  */
 void sendControlMessage(struct VehicleStruct *vehicle, int messageType)
 {
+    if (statisticsComm != MPI_COMM_NULL)
+    {
+        addStatistic(localStatistics, messageType, vehicle->passengers);
+        return;
+    }
+
     ControlMessage msg;
     msg.messageType = messageType;
     msg.passengers = vehicle->passengers;
@@ -120,108 +277,254 @@ void sendControlMessage(struct VehicleStruct *vehicle, int messageType)
 }
 
 /**
- * control接收vehicle发送的消息，更新统计信息
+ * control接收vehicle发来的统计信息，累加到本地的统计数据
  */
-void receiveControlMessage(int *total_vehicles, int *passengers_delivered, int *passengers_stranded, int *vehicles_crashed, int *vehicles_exhausted_fuel)
+void receiveControlMessage()
 {
     MPI_Status status;
     ControlMessage msg;
 
     MPI_Recv(&msg, 2, MPI_INT, MPI_ANY_SOURCE, TAG_STATISITIC, MPI_COMM_WORLD, &status);
 
-    if (msg.messageType == NO_FUEL)
+    addStatistic(localStatistics, msg.messageType, msg.passengers);
+}
+
+/**
+ * 开始下一个模拟分钟的非阻塞归约。vehicle host提交本地累加的总数，control在原地接收所有host的总和。
+ * 每个成员按相同的顺序发起归约，每个分钟的归约缓冲区在完成之前保持不变。
+ * 没有统计通信器时control只记录分钟数，统计数据已经逐条接收到本地
+ */
+void reduceStatistics()
+{
+    if (numReductions >= MAX_MINS)
+        return;
+    if (statisticsComm == MPI_COMM_NULL)
     {
-        (*vehicles_exhausted_fuel)++;
-        (*passengers_stranded) += msg.passengers;
+        numReductions++;
+        return;
     }
-    else if (msg.messageType == VEHICLE_COLLISION)
+
+    int rank;
+    MPI_Comm_rank(statisticsComm, &rank);
+    int *buffer = reduceBuffers[numReductions];
+    if (rank == 0)
     {
-        (*vehicles_crashed)++;
-        (passengers_stranded) += msg.passengers;
+        memset(buffer, 0, sizeof(int) * NUM_STATISTICS);
+        MPI_Ireduce(MPI_IN_PLACE, buffer, NUM_STATISTICS, MPI_INT, MPI_SUM, 0, statisticsComm, &reduceRequests[numReductions]);
     }
-    else if (msg.messageType == ARRIVE_DESTINATION)
+    else
     {
-        (*passengers_delivered) += msg.passengers;
+        memcpy(buffer, localStatistics, sizeof(int) * NUM_STATISTICS);
+        MPI_Ireduce(buffer, NULL, NUM_STATISTICS, MPI_INT, MPI_SUM, 0, statisticsComm, &reduceRequests[numReductions]);
     }
-    else if (msg.messageType == NEW_VEHICLE)
+    numReductions++;
+}
+
+/**
+ * control检查最早未完成的归约，如果已经完成则把总数复制到statistics，返回它对应的模拟分钟，否则返回0
+ */
+int completeStatistics(int *statistics)
+{
+    if (numCompleted >= numReductions)
+        return 0;
+    if (statisticsComm == MPI_COMM_NULL)
+    {
+        memcpy(statistics, localStatistics, sizeof(int) * NUM_STATISTICS);
+        return ++numCompleted;
+    }
+
+    int flag;
+    MPI_Test(&reduceRequests[numCompleted], &flag, MPI_STATUS_IGNORE);
+    if (!flag)
+        return 0;
+    memcpy(statistics, reduceBuffers[numCompleted], sizeof(int) * NUM_STATISTICS);
+    numCompleted++;
+    return numCompleted;
+}
+
+/**
+ * vehicle host停止时补齐剩余分钟的归约，然后等待所有归约完成
+ */
+void finishStatistics()
+{
+    if (statisticsComm == MPI_COMM_NULL)
+        return;
+    while (numReductions < MAX_MINS)
+    {
+        reduceStatistics();
+    }
+    MPI_Waitall(numReductions, reduceRequests, MPI_STATUSES_IGNORE);
+}
+
+/**
+ * vehicle host本地累加的统计数据，随检查点保存
+ */
+void getLocalStatistics(int *statistics)
+{
+    memcpy(statistics, localStatistics, sizeof(int) * NUM_STATISTICS);
+}
+
+/**
+ * 从检查点恢复时，前minute个分钟的归约已经在检查点之前完成，从下一分钟继续。statistics为host保存的本地统计数据，
+ * control传NULL
+ */
+void resumeStatistics(int minute, const int *statistics)
+{
+    numReductions = minute;
+    numCompleted = minute;
+    for (int i = 0; i < minute; i++)
     {
-        (*total_vehicles)++;
+        reduceRequests[i] = MPI_REQUEST_NULL;
     }
+    if (statistics != NULL)
+        memcpy(localStatistics, statistics, sizeof(int) * NUM_STATISTICS);
 }
 
 /**
- * vehicle请求map进程获取所在节点所有道路的速度
+ * 按事件类型把一辆车的统计信息加到总数上
+ */
+static void addStatistic(int *statistics, int messageType, int passengers)
+{
+    if (messageType == NO_FUEL)
+    {
+        statistics[STAT_VEHICLES_EXHAUSTED_FUEL]++;
+        statistics[STAT_PASSENGERS_STRANDED] += passengers;
+    }
+    else if (messageType == VEHICLE_COLLISION)
+    {
+        statistics[STAT_VEHICLES_CRASHED]++;
+        statistics[STAT_PASSENGERS_STRANDED] += passengers;
+    }
+    else if (messageType == ARRIVE_DESTINATION)
+    {
+        statistics[STAT_PASSENGERS_DELIVERED] += passengers;
+    }
+    else if (messageType == NEW_VEHICLE)
+    {
+        statistics[STAT_TOTAL_VEHICLES]++;
+    }
+}
+
+/**
+ * vehicle请求拥有所在路口的map进程获取所在节点所有道路的速度
  */
 void requestRoadSpeeds(struct VehicleStruct *vehicle, int numRoads, int *speeds)
 {
     RequestMessage reqMsg;
     reqMsg.messageType = REQUEST_ROAD_SPEED;
-    reqMsg.junctionId = vehicle->currentJunction->id;
+    reqMsg.junctionId = vehicle->currentJunction;
 
-    printf("Requesting Road Speeds: JunctionId=%d\n", reqMsg.junctionId);
+    LOG_DEBUG(LOG_ROAD_SPEEDS_REQUESTED, reqMsg.junctionId, numRoads, 0, 0, 0);
 
-    MPI_Send(&reqMsg, 2, MPI_INT, MAP_ACTOR_RANK, TAG_REQUEST_ROAD_SPEED, MPI_COMM_WORLD);
+    int mapRank = mapPartition->junctionOwner[reqMsg.junctionId];
+    MPI_Send(&reqMsg, 2, MPI_INT, mapRank, TAG_REQUEST_ROAD_SPEED, MPI_COMM_WORLD);
 
     MPI_Status status;
-    MPI_Recv(speeds, numRoads, MPI_INT, MAP_ACTOR_RANK, TAG_REQUEST_ROAD_SPEED, MPI_COMM_WORLD, &status);
+    MPI_Recv(speeds, numRoads, MPI_INT, mapRank, TAG_REQUEST_ROAD_SPEED, MPI_COMM_WORLD, &status);
 
-    printf("Received Road Speeds for JunctionId=%d\n", reqMsg.junctionId);
+    LOG_DEBUG(LOG_ROAD_SPEEDS_RECEIVED, reqMsg.junctionId, numRoads, 0, 0, 0);
 }
 
 /**
- * map接收vehicle发送的消息，返回所在节点所有道路的速度
+ * vehicle请求map进程获取所在节点的信息（仅获取一个int的信息）
  */
-void handleRoadSpeedRequest(struct JunctionStruct *roadMap)
+void requestJunctionInfo(struct VehicleStruct *vehicle, int messageType, int *info)
 {
     RequestMessage reqMsg;
+    reqMsg.messageType = messageType;
+    reqMsg.junctionId = vehicle->currentJunction;
+
+    int mapRank = mapPartition->junctionOwner[reqMsg.junctionId];
+    MPI_Send(&reqMsg, 2, MPI_INT, mapRank, TAG_REQUEST_INFO, MPI_COMM_WORLD);
+
     MPI_Status status;
+    MPI_Recv(info, 1, MPI_INT, mapRank, TAG_REQUEST_INFO, MPI_COMM_WORLD, &status);
+}
 
-    MPI_Recv(&reqMsg, 2, MPI_INT, MPI_ANY_SOURCE, TAG_REQUEST_ROAD_SPEED, MPI_COMM_WORLD, &status);
+/**
+ * map接收探测到的读请求（道路速度或路口信息），放入队列，等本次循环的所有更新处理完之后一起回答
+ */
+void receiveRequest(MPI_Message *message, MPI_Status *status, QueuedRequest *request)
+{
+    request->source = status->MPI_SOURCE;
+    request->tag = status->MPI_TAG;
 
-    int numRoads = roadMap[reqMsg.junctionId].num_roads;
-    int *speeds = (int *)malloc(numRoads * sizeof(int));
+    MPI_Mrecv(&request->request, 2, MPI_INT, message, MPI_STATUS_IGNORE);
+}
 
-    for (int i = 0; i < numRoads; i++)
+/**
+ * map一起回答队列中的所有读请求。回复直接从状态数组中发送，所有发送都完成之后才返回，期间状态不会被修改
+ */
+void answerRequests(struct RoadMapState *roadMap, QueuedRequest *requests, int numRequests, MPI_Request *sendRequests)
+{
+    const struct RoadTopology *topology = roadMap->topology;
+    const struct MapPartition *partition = roadMap->partition;
+    for (int i = 0; i < numRequests; i++)
     {
-        speeds[i] = roadMap[reqMsg.junctionId].roads[i].currentSpeed;
+        int junctionId = requests[i].request.junctionId;
+        int junction = partition->junctionIndex[junctionId];
+        if (requests[i].tag == TAG_REQUEST_ROAD_SPEED)
+        {
+            // 同一路口的道路速度在本地数组中也连续存放，可以直接发送
+            int numRoads = topology->roadOffsets[junctionId + 1] - topology->roadOffsets[junctionId];
+            int firstRoad = numRoads > 0 ? partition->roadIndex[topology->roadOffsets[junctionId]] : 0;
+            MPI_Isend(&roadMap->currentSpeed[firstRoad], numRoads, MPI_INT, requests[i].source, TAG_REQUEST_ROAD_SPEED, MPI_COMM_WORLD, &sendRequests[i]);
+        }
+        else if (requests[i].request.messageType == REQUEST_JUNCTION_NUM_VEHICLES)
+        {
+            MPI_Isend(&roadMap->num_vehicles[junction], 1, MPI_INT, requests[i].source, TAG_REQUEST_INFO, MPI_COMM_WORLD, &sendRequests[i]);
+        }
+        else
+        {
+            MPI_Isend(&roadMap->trafficLightsRoadEnabled[junction], 1, MPI_INT, requests[i].source, TAG_REQUEST_INFO, MPI_COMM_WORLD, &sendRequests[i]);
+        }
     }
+    MPI_Waitall(numRequests, sendRequests, MPI_STATUSES_IGNORE);
+}
 
-    MPI_Send(speeds, numRoads, MPI_INT, status.MPI_SOURCE, TAG_REQUEST_ROAD_SPEED, MPI_COMM_WORLD);
+/**
+ * control发送消息给vehicle host，要求其激活指定数量的新车辆
+ */
+void sendNewVehicles(int hostRank, int numVehicles)
+{
+    NewVehicleMessage msg;
+    msg.messageType = NEW_VEHICLE;
+    msg.numVehicles = numVehicles;
 
-    free(speeds);
+    MPI_Send(&msg, 2, MPI_INT, hostRank, TAG_NEW_VEHICLES, MPI_COMM_WORLD);
 }
 
 /**
- * vehicle请求map进程获取所在节点的信息（仅获取一个int的信息）
+ * vehicle host接收control发送的消息，返回需要激活的车辆数量
  */
-void requestJunctionInfo(struct VehicleStruct *vehicle, int messageType, int *info)
+int receiveNewVehicles()
 {
-    RequestMessage reqMsg;
-    reqMsg.messageType = messageType;
-    reqMsg.junctionId = vehicle->currentJunction->id;
+    NewVehicleMessage msg;
 
-    MPI_Send(&reqMsg, 2, MPI_INT, MAP_ACTOR_RANK, TAG_REQUEST_INFO, MPI_COMM_WORLD);
+    MPI_Recv(&msg, 2, MPI_INT, CONTROL_ACTOR_RANK, TAG_NEW_VEHICLES, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
-    MPI_Status status;
-    MPI_Recv(info, 1, MPI_INT, MAP_ACTOR_RANK, TAG_REQUEST_INFO, MPI_COMM_WORLD, &status);
+    return msg.numVehicles;
 }
 
 /**
- * map接收vehicle发送的消息，返回所在节点的信息（仅返回一个int的信息）
+ * vehicle host停止时发送消息给所有map，表示不会再有来自该host的请求
  */
-void handleJunctionInfoRequest(struct JunctionStruct *roadMap)
+void sendStopSignal()
 {
-    RequestMessage reqMsg;
-    MPI_Status status;
+    int msg = STOP_SIGNAL;
 
-    MPI_Recv(&reqMsg, 2, MPI_INT, MPI_ANY_SOURCE, TAG_REQUEST_INFO, MPI_COMM_WORLD, &status);
-
-    if (reqMsg.messageType == REQUEST_JUNCTION_NUM_VEHICLES)
-    {
-        MPI_Send(&roadMap[reqMsg.junctionId].num_vehicles, 1, MPI_INT, status.MPI_SOURCE, TAG_REQUEST_INFO, MPI_COMM_WORLD);
-    }
-    else if (reqMsg.messageType == REQUEST_AVAILABLE_ROAD)
+    for (int m = 0; m < NUM_MAP_ACTORS; m++)
     {
-        MPI_Send(&roadMap[reqMsg.junctionId].trafficLightsRoadEnabled, 1, MPI_INT, status.MPI_SOURCE, TAG_REQUEST_INFO, MPI_COMM_WORLD);
+        MPI_Send(&msg, 1, MPI_INT, MAP_ACTOR_RANK + m, TAG_STOP, MPI_COMM_WORLD);
     }
 }
+
+/**
+ * map接收探测到的vehicle host停止消息
+ */
+void receiveStopSignal(MPI_Message *message)
+{
+    int msg;
+
+    MPI_Mrecv(&msg, 1, MPI_INT, message, MPI_STATUS_IGNORE);
+}
@@ -1,9 +1,5 @@
 #define NO_FUEL 0
-#define LEAVE_ROAD 1
-#define ARRIVE_JUNCTION 2
 #define ARRIVE_DESTINATION 3
-#define ARRIVE_ROAD 4
-#define LEAVE_JUNCTION 5
 #define REQUEST_ROAD_SPEED 6
 #define VEHICLE_COLLISION 7
 #define REQUEST_AVAILABLE_ROAD 8
@@ -11,25 +7,33 @@
 #define NEW_VEHICLE 10
 #define STOP_SIGNAL 99
 
-#define TAG_JUNCTION 1
-#define TAG_ROAD 2
+#define TAG_TRANSITION 1
 #define TAG_REQUEST_ROAD_SPEED 3
 #define TAG_REQUEST_INFO 4
 #define TAG_STATISITIC 5
+#define TAG_NEW_VEHICLES 6
+// vehicle host之间迁移的车辆批次，发送批次之前发给每个map的栅栏，以及map转发给接收批次的host的确认
+#define TAG_MIGRATION 7
+#define TAG_MIGRATION_FENCE 8
+#define TAG_MIGRATION_ACK 9
+// vehicle host在检查点之前发给每个map的标记（排在它所有转移消息之后），以及map写完检查点之后发给每个host的完成消息
+#define TAG_CHECKPOINT 10
+#define TAG_CHECKPOINT_DONE 11
 #define TAG_STOP 98
 
-typedef struct
-{
-    int messageType; // 消息类型
-    int junctionId;  // 路口ID
-} JunctionMessage;
+// 每个vehicle演员发送转移消息时轮流使用的持久发送请求数量
+#define TRANSITION_SEND_SLOTS 4
 
+/*
+ * 车辆的一次状态转移，在一条消息中描述车辆离开和到达的路口和道路（拓扑中的下标），-1表示没有
+ */
 typedef struct
 {
-    int messageType; // 消息类型
-    int junctionId;  // 路口ID
-    int roadId;      // 道路ID
-} RoadMessage;
+    int leftJunction;    // 离开的路口
+    int leftRoad;        // 离开的道路
+    int enteredJunction; // 到达的路口
+    int enteredRoad;     // 进入的道路
+} TransitionMessage;
 
 typedef struct
 {
@@ -37,19 +41,59 @@ typedef struct
     int passengers;  // 乘客数量
 } ControlMessage;
 
+// control汇总的统计量，vehicle host在本地累加，每个模拟分钟归约到control一次
+enum Statistic
+{
+    STAT_TOTAL_VEHICLES,
+    STAT_PASSENGERS_DELIVERED,
+    STAT_PASSENGERS_STRANDED,
+    STAT_VEHICLES_CRASHED,
+    STAT_VEHICLES_EXHAUSTED_FUEL,
+    NUM_STATISTICS
+};
+
 typedef struct
 {
     int messageType; // 消息类型
     int junctionId;  // 请求的路口ID
 } RequestMessage;
 
-void sendJunctionUpdate(struct VehicleStruct *, int);
-void receiveJunctionUpdate(struct JunctionStruct *);
-void sendRoadUpdate(struct VehicleStruct *, int);
-void receiveRoadUpdate(struct JunctionStruct *);
+typedef struct
+{
+    int messageType; // 消息类型
+    int numVehicles; // 需要激活的车辆数量
+} NewVehicleMessage;
+
+typedef struct
+{
+    int source;             // 请求者的rank
+    int tag;                // 请求的标签（道路速度或路口信息）
+    RequestMessage request; // 请求内容
+} QueuedRequest;
+
+struct MapPartition;
+
+void initMessageTypes();
+void freeMessageTypes();
+void initMapMessaging(const struct MapPartition *);
+void freeMapMessaging();
+TransitionMessage createTransition();
+void sendTransition(const TransitionMessage *);
+void receiveTransition(struct RoadMapState *, MPI_Message *);
+void initStatistics();
+void freeStatistics();
 void sendControlMessage(struct VehicleStruct *, int);
-void receiveControlMessage(int *, int *, int *, int *, int *);
+void receiveControlMessage();
+void reduceStatistics();
+int completeStatistics(int *);
+void finishStatistics();
+void getLocalStatistics(int *);
+void resumeStatistics(int, const int *);
 void requestRoadSpeeds(struct VehicleStruct *, int, int *);
-void handleRoadSpeedRequest(struct JunctionStruct *);
 void requestJunctionInfo(struct VehicleStruct *, int, int *);
-void handleJunctionInfoRequest(struct JunctionStruct *);
+void receiveRequest(MPI_Message *, MPI_Status *, QueuedRequest *);
+void answerRequests(struct RoadMapState *, QueuedRequest *, int, MPI_Request *);
+void sendNewVehicles(int, int);
+int receiveNewVehicles();
+void sendStopSignal();
+void receiveStopSignal(MPI_Message *);
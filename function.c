@@ -7,196 +7,211 @@
 #include <time.h>
 #include "pool.h"
 #include "mpi.h"
+#include "roadmap.h"
 #include "code.h"
+#include "partition.h"
 #include "comm.h"
 #include "function.h"
+#include "heap.h"
+#include "route.h"
 #include "worker.h"
 
+// Number of heap allocations made by this process, counted by the malloc, calloc and realloc wrappers below
+static long allocationCount = 0;
+// The random number generator's state, which is owned here so that a checkpoint can save and restore it. Restoring
+// switches to the other buffer, as setstate saves the position of the current state into it before loading the new one
+static char randomStates[2][RANDOM_STATE_BYTES];
+static int currentRandomState = 0;
+
 /**
- * Parses the provided roadmap file and uses this to build the graph of
- * junctions and roads, as well as reading traffic light information
+ * Creates the map actor's private state of the junctions and roads it owns over the shared topology, this holds
+ * all of the mutable occupancy and traffic light state in arrays indexed by the partition's local indices, so
+ * its size is that of the map actor's part rather than the whole map
  **/
-void loadRoadMap(char *filename, struct JunctionStruct **roadMap, int *num_junctions, int *num_roads)
+void createRoadMapState(const struct RoadTopology *topology, const struct MapPartition *partition, int mapRank, struct RoadMapState *state)
 {
-    enum ReadMode currentMode = NONE;
-    char buffer[MAX_ROAD_LEN];
-    FILE *f = fopen(filename, "r");
-    if (f == NULL)
+    int part = mapRank - MAP_ACTOR_RANK;
+    int num_junctions = partition->partOffsets[part + 1] - partition->partOffsets[part], num_roads = partition->partRoads[part];
+    state->topology = topology;
+    state->partition = partition;
+    state->num_junctions = num_junctions;
+    state->num_roads = num_roads;
+    state->junctions = (int *)malloc(sizeof(int) * num_junctions);
+    state->roads = (int *)malloc(sizeof(int) * num_roads);
+    for (int i = 0; i < num_junctions; i++)
+    {
+        int junction = partition->partJunctions[partition->partOffsets[part] + i];
+        state->junctions[i] = junction;
+        for (int road = topology->roadOffsets[junction]; road < topology->roadOffsets[junction + 1]; road++)
+        {
+            state->roads[partition->roadIndex[road]] = road;
+        }
+    }
+    state->num_vehicles = (int *)calloc(num_junctions, sizeof(int));
+    state->trafficLightsRoadEnabled = (int *)calloc(num_junctions, sizeof(int));
+    state->total_number_crashes = (int *)calloc(num_junctions, sizeof(int));
+    state->total_number_vehicles = (int *)calloc(num_junctions, sizeof(int));
+    state->numVehiclesOnRoad = (int *)calloc(num_roads, sizeof(int));
+    state->currentSpeed = (int *)malloc(sizeof(int) * num_roads);
+    state->road_total_number_vehicles = (int *)calloc(num_roads, sizeof(int));
+    state->max_concurrent_vehicles = (int *)calloc(num_roads, sizeof(int));
+    for (int i = 0; i < num_roads; i++)
     {
-        fprintf(stderr, "Error opening roadmap file '%s'\n", filename);
-        exit(-1);
+        state->currentSpeed[i] = topology->roadMaxSpeed[state->roads[i]];
     }
+    state->dirtyRoads = (int *)malloc(sizeof(int) * num_roads);
+    state->roadDirty = (char *)calloc(num_roads, sizeof(char));
+    state->numDirtyRoads = 0;
+    state->dirtyJunctions = (int *)malloc(sizeof(int) * num_junctions);
+    state->junctionDirty = (char *)calloc(num_junctions, sizeof(char));
+    state->numDirtyJunctions = 0;
+}
 
-    *num_junctions = 0; // 确保开始时交叉口数量为0
-    *num_roads = 0;     // 确保开始时道路数量为0
+/**
+ * Frees the map actor's state created by createRoadMapState
+ **/
+void freeRoadMapState(struct RoadMapState *state)
+{
+    free(state->junctions);
+    free(state->roads);
+    free(state->num_vehicles);
+    free(state->trafficLightsRoadEnabled);
+    free(state->total_number_crashes);
+    free(state->total_number_vehicles);
+    free(state->numVehiclesOnRoad);
+    free(state->currentSpeed);
+    free(state->road_total_number_vehicles);
+    free(state->max_concurrent_vehicles);
+    free(state->dirtyRoads);
+    free(state->roadDirty);
+    free(state->dirtyJunctions);
+    free(state->junctionDirty);
+}
 
-    while (fgets(buffer, MAX_ROAD_LEN, f))
+/**
+ * Recomputes the current speed of the roads whose occupancy changed since the dirty set was last emptied,
+ * so the cost scales with the traffic rather than the size of the map. publishRoadState empties the set
+ **/
+void updateDirtyRoadSpeeds(struct RoadMapState *state)
+{
+    for (int i = 0; i < state->numDirtyRoads; i++)
     {
-        if (buffer[0] == '%')
-            continue;
-        if (buffer[0] == '#')
-        {
-            if (strncmp("# Road layout:", buffer, 14) == 0)
-            {
-                char *s = strstr(buffer, ":");
-                *num_junctions = atoi(&s[1]);
-                *roadMap = (struct JunctionStruct *)malloc(sizeof(struct JunctionStruct) * *num_junctions);
-                for (int i = 0; i < *num_junctions; i++)
-                {
-                    (*roadMap)[i].id = i;
-                    (*roadMap)[i].num_roads = 0;
-                    (*roadMap)[i].num_vehicles = 0;
-                    (*roadMap)[i].hasTrafficLights = 0;
-                    (*roadMap)[i].total_number_crashes = 0;
-                    (*roadMap)[i].total_number_vehicles = 0;
-                    // Not ideal to allocate all roads size here
-                    (*roadMap)[i].roads = (struct RoadStruct *)malloc(sizeof(struct RoadStruct) * MAX_NUM_ROADS_PER_JUNCTION);
-                }
-                currentMode = ROADMAP;
-            }
-            if (strncmp("# Traffic lights:", buffer, 17) == 0)
-            {
-                currentMode = TRAFFICLIGHTS;
-            }
-        }
-        else
+        int road = state->dirtyRoads[i];
+        state->currentSpeed[road] = state->topology->roadMaxSpeed[state->roads[road]] - state->numVehiclesOnRoad[road];
+        if (state->currentSpeed[road] < 10)
+            state->currentSpeed[road] = 10;
+    }
+}
+
+/**
+ * Sets the road enabled by each junction's traffic lights for the simulated minute, the lights only change
+ * when the minute does
+ **/
+void updateTrafficLights(struct RoadMapState *state, int elapsed_mins)
+{
+    const struct RoadTopology *topology = state->topology;
+    for (int i = 0; i < state->num_junctions; i++)
+    {
+        int junction = state->junctions[i];
+        int num_roads = topology->roadOffsets[junction + 1] - topology->roadOffsets[junction];
+        if (topology->hasTrafficLights[junction] && num_roads > 0)
         {
-            if (currentMode == ROADMAP)
-            {
-                char *space = strstr(buffer, " ");
-                *space = '\0';
-                int from_id = atoi(buffer);
-                char *nextspace = strstr(&space[1], " ");
-                *nextspace = '\0';
-                int to_id = atoi(&space[1]);
-                char *nextspace2 = strstr(&nextspace[1], " ");
-                *nextspace = '\0';
-                int roadlength = atoi(&nextspace[1]);
-                int speed = atoi(&nextspace2[1]);
-                if ((*roadMap)[from_id].num_roads >= MAX_NUM_ROADS_PER_JUNCTION)
-                {
-                    fprintf(stderr, "Error: Tried to create road %d at junction %d, but maximum number of roads is %d, increase 'MAX_NUM_ROADS_PER_JUNCTION'",
-                            (*roadMap)[from_id].num_roads, from_id, MAX_NUM_ROADS_PER_JUNCTION);
-                    exit(-1);
-                }
-                (*roadMap)[from_id].roads[(*roadMap)[from_id].num_roads].from = &(*roadMap)[from_id];
-                (*roadMap)[from_id].roads[(*roadMap)[from_id].num_roads].to = &(*roadMap)[to_id];
-                (*roadMap)[from_id].roads[(*roadMap)[from_id].num_roads].roadLength = roadlength;
-                (*roadMap)[from_id].roads[(*roadMap)[from_id].num_roads].maxSpeed = speed;
-                (*roadMap)[from_id].roads[(*roadMap)[from_id].num_roads].numVehiclesOnRoad = 0;
-                (*roadMap)[from_id].roads[(*roadMap)[from_id].num_roads].currentSpeed = speed;
-                (*roadMap)[from_id].roads[(*roadMap)[from_id].num_roads].total_number_vehicles = 0;
-                (*roadMap)[from_id].roads[(*roadMap)[from_id].num_roads].max_concurrent_vehicles = 0;
-                (*roadMap)[from_id].num_roads++;
-                (*num_roads)++;
-            }
-            else if (currentMode == TRAFFICLIGHTS)
-            {
-                int id = atoi(buffer);
-                if ((*roadMap)[id].num_roads > 0)
-                    (*roadMap)[id].hasTrafficLights = 1;
-            }
+            state->trafficLightsRoadEnabled[i] = elapsed_mins % num_roads;
         }
     }
-    fclose(f);
 }
 
 /**
  * Plans a route from the source to destination junction, returning the junction after
  * the source junction. This will be called to plan a route from A (where the vehicle
  * is currently) to B (the destination), so will return the junction that most be travelled
- * to next. -1 is returned if no route is found
+ * to next. -1 is returned if no route is found. The roads leaving the source junction use the
+ * provided current speeds (in the order of the junction's roads), or their maximum speed if NULL.
+ * This is Dijkstra's algorithm over a binary heap with fixed point travel time costs, amongst
+ * equal distances the lowest junction is settled first and the first road to reach a junction is kept.
+ * The search runs in the caller's scratch space and only resets the junctions it reached, so it
+ * does not allocate
  **/
-int planRoute(int source_id, int dest_id, int num_junctions, struct JunctionStruct *roadMap)
+int planRoute(int source_id, int dest_id, const struct RoadTopology *topology, const int *sourceSpeeds, struct RouteSearch *search)
 {
     if (VERBOSE_ROUTE_PLANNER)
         printf("Search for route from %d to %d\n", source_id, dest_id);
-    double *dist = (double *)malloc(sizeof(double) * num_junctions);
-    char *active = (char *)malloc(sizeof(char) * num_junctions);
-    struct JunctionStruct **prev = (struct JunctionStruct **)malloc(sizeof(struct JunctionStruct *) * num_junctions);
-
-    int activeJunctions = num_junctions;
-    for (int i = 0; i < num_junctions; i++)
-    {
-        active[i] = 1;
-        prev[i] = NULL;
-        if (i != source_id)
-        {
-            dist[i] = LARGE_NUM;
-        }
-    }
+    int64_t *dist = search->dist;
+    char *settled = search->settled;
+    int *prev = search->prev;
     dist[source_id] = 0;
-    while (activeJunctions > 0)
+    search->touched[search->numTouched++] = source_id;
+    heapPush(&search->heap, source_id);
+    while (search->heap.size > 0)
     {
-        int v_idx = findIndexOfMinimum(dist, active, num_junctions);
+        int v_idx = heapPop(&search->heap);
         if (v_idx == dest_id)
             break;
-        struct JunctionStruct *v = &roadMap[v_idx];
-        active[v_idx] = 0;
-        activeJunctions--;
+        settled[v_idx] = 1;
 
-        for (int i = 0; i < v->num_roads; i++)
+        for (int road = topology->roadOffsets[v_idx]; road < topology->roadOffsets[v_idx + 1]; road++)
         {
-            if (active[v->roads[i].to->id] && dist[v_idx] != LARGE_NUM)
+            int to_idx = topology->roadTo[road];
+            if (!settled[to_idx])
             {
-                double alt = dist[v_idx] + v->roads[i].roadLength / (v->id == source_id ? v->roads[i].currentSpeed : v->roads[i].maxSpeed);
-                if (alt < dist[v->roads[i].to->id])
+                // 只有出发路口的道路使用当前速度，其他道路使用最大速度
+                int speed = topology->roadMaxSpeed[road];
+                if (v_idx == source_id && sourceSpeeds != NULL)
+                    speed = sourceSpeeds[road - topology->roadOffsets[v_idx]];
+                int64_t alt = dist[v_idx] + getTravelCost(topology->roadLength[road], speed);
+                if (alt < dist[to_idx])
                 {
-                    dist[v->roads[i].to->id] = alt;
-                    prev[v->roads[i].to->id] = v;
+                    if (dist[to_idx] == ROUTE_INFINITY)
+                        search->touched[search->numTouched++] = to_idx;
+                    dist[to_idx] = alt;
+                    prev[to_idx] = v_idx;
+                    heapPush(&search->heap, to_idx);
                 }
             }
         }
     }
-    free(dist);
-    free(active);
-    int u_idx = dest_id;
-    int *route = (int *)malloc(sizeof(int) * num_junctions);
-    int route_len = 0;
-    if (prev[u_idx] != NULL || u_idx == source_id)
+
+    // 从目的地沿着前驱回溯，找到出发路口之后的第一个路口
+    int next_jnct = -1;
+    if (dest_id != source_id && prev[dest_id] != -1)
     {
-        if (VERBOSE_ROUTE_PLANNER)
-            printf("Start at %d\n", u_idx);
-        while (prev[u_idx] != NULL)
+        next_jnct = dest_id;
+        while (prev[next_jnct] != source_id)
         {
-            route[route_len] = u_idx;
-            u_idx = prev[u_idx]->id;
             if (VERBOSE_ROUTE_PLANNER)
-                printf("Route %d\n", u_idx);
-            route_len++;
+                printf("Route %d\n", next_jnct);
+            next_jnct = prev[next_jnct];
         }
     }
-    free(prev);
-    if (route_len > 0)
+
+    // 只重置这次搜索访问过的路口
+    for (int i = 0; i < search->numTouched; i++)
     {
-        int next_jnct = route[route_len - 1];
-        if (VERBOSE_ROUTE_PLANNER)
-            printf("Found next junction is %d\n", next_jnct);
-        free(route);
-        return next_jnct;
+        int x = search->touched[i];
+        dist[x] = ROUTE_INFINITY;
+        settled[x] = 0;
+        prev[x] = -1;
     }
+    search->numTouched = 0;
+    heapClear(&search->heap);
     if (VERBOSE_ROUTE_PLANNER)
-        printf("Failed to find route between %d and %d\n", source_id, dest_id);
-    free(route);
-    return -1;
+    {
+        if (next_jnct != -1)
+            printf("Found next junction is %d\n", next_jnct);
+        else
+            printf("Failed to find route between %d and %d\n", source_id, dest_id);
+    }
+    return next_jnct;
 }
 
 /**
- * Finds the index of the input array that is active and has the smallest number
+ * The fixed point cost of travelling a road, i.e. its travel time in units of 1/ROUTE_COST_SCALE
  **/
-int findIndexOfMinimum(double *dist, char *active, int num_junctions)
+int64_t getTravelCost(int roadLength, int speed)
 {
-    double min_dist = LARGE_NUM + 1;
-    int current_min = -1;
-    for (int i = 0; i < num_junctions; i++)
-    {
-        if (active[i] && dist[i] < min_dist)
-        {
-            min_dist = dist[i];
-            current_min = i;
-        }
-    }
-    return current_min;
+    if (speed < 1)
+        speed = 1;
+    return (int64_t)roadLength * ROUTE_COST_SCALE / speed;
 }
 
 /**
@@ -205,7 +220,35 @@ int findIndexOfMinimum(double *dist, char *active, int num_junctions)
  **/
 int getRandomInteger(int from, int to)
 {
-    return (rand() % (to - from)) + from;
+    return (random() % (to - from)) + from;
+}
+
+/**
+ * Seeds the random number generator of this process
+ **/
+void seedRandom(unsigned int seed)
+{
+    initstate(seed, randomStates[currentRandomState], RANDOM_STATE_BYTES);
+}
+
+/**
+ * Copies the random number generator's state, so that restoring it continues the same sequence of numbers
+ **/
+void saveRandomState(char *state)
+{
+    // Switching to the current state stores its position in the buffer
+    setstate(randomStates[currentRandomState]);
+    memcpy(state, randomStates[currentRandomState], RANDOM_STATE_BYTES);
+}
+
+/**
+ * Restores a random number generator state copied by saveRandomState
+ **/
+void restoreRandomState(const char *state)
+{
+    currentRandomState = 1 - currentRandomState;
+    memcpy(randomStates[currentRandomState], state, RANDOM_STATE_BYTES);
+    setstate(randomStates[currentRandomState]);
 }
 
 /**
@@ -220,16 +263,54 @@ time_t getCurrentSeconds()
 }
 
 /**
- * Finds the road index out of the junction's roads that leads to a specific
- * destination junction
+ * Finds the road out of the junction's roads that leads to a specific destination
+ * junction, returning its index in the topology or -1 if there is none
  **/
-int findAppropriateRoad(int dest_junction, struct JunctionStruct *junction)
+int findAppropriateRoad(int dest_junction, int junction, const struct RoadTopology *topology)
 {
     // 遍历该路口连接的所有道路，检查每一条道路的终点是否是目的地路口
-    for (int j = 0; j < junction->num_roads; j++)
+    for (int road = topology->roadOffsets[junction]; road < topology->roadOffsets[junction + 1]; road++)
     {
-        if (junction->roads[j].to->id == dest_junction)
-            return j;
+        if (topology->roadTo[road] == dest_junction)
+            return road;
     }
     return -1;
-}
\ No newline at end of file
+}
+
+#if COUNT_ALLOCATIONS
+/*
+ * The counting build links with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc (see the Makefile), so every call
+ * to these from the simulation's own code, in any module or thread, comes here and is counted. Allocations made
+ * inside the MPI library or libc itself are not counted
+ */
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+
+void *__wrap_malloc(size_t size)
+{
+    __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+#endif
+
+/**
+ * Retrieves the number of heap allocations made by this process (from any thread), so a count that stops growing
+ * shows that the steady state simulation does not allocate. Always zero unless built with COUNT_ALLOCATIONS
+ **/
+long getAllocationCount()
+{
+    return __atomic_load_n(&allocationCount, __ATOMIC_RELAXED);
+}
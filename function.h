@@ -1,6 +1,15 @@
+struct RouteSearch;
+
 time_t getCurrentSeconds();
 int getRandomInteger(int, int);
-int planRoute(int, int, int, struct JunctionStruct *);
-void loadRoadMap(char *, struct JunctionStruct **, int *, int *);
-int findAppropriateRoad(int, struct JunctionStruct *);
-int findIndexOfMinimum(double *, char *, int);
\ No newline at end of file
+void seedRandom(unsigned int);
+void saveRandomState(char *);
+void restoreRandomState(const char *);
+int planRoute(int, int, const struct RoadTopology *, const int *, struct RouteSearch *);
+void createRoadMapState(const struct RoadTopology *, const struct MapPartition *, int, struct RoadMapState *);
+void freeRoadMapState(struct RoadMapState *);
+void updateDirtyRoadSpeeds(struct RoadMapState *);
+void updateTrafficLights(struct RoadMapState *, int);
+int findAppropriateRoad(int, int, const struct RoadTopology *);
+int64_t getTravelCost(int, int);
+long getAllocationCount();
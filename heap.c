@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include "heap.h"
+
+static int heapLess(struct IndexedHeap *, int, int);
+static void heapSwap(struct IndexedHeap *, int, int);
+static void siftUp(struct IndexedHeap *, int);
+static void siftDown(struct IndexedHeap *, int);
+
+/**
+ * Allocates a heap for ids [0, capacity), the keys array is read on every comparison so the caller
+ * updates a key and then calls heapPush to restore the order
+ **/
+void heapInit(struct IndexedHeap *heap, int capacity, const int64_t *keys)
+{
+    heap->size = 0;
+    heap->ids = (int *)malloc(sizeof(int) * capacity);
+    heap->position = (int *)malloc(sizeof(int) * capacity);
+    heap->keys = keys;
+    for (int i = 0; i < capacity; i++)
+    {
+        heap->position[i] = -1;
+    }
+}
+
+/**
+ * Frees the memory held by the heap
+ **/
+void heapFree(struct IndexedHeap *heap)
+{
+    free(heap->ids);
+    free(heap->position);
+    heap->ids = heap->position = NULL;
+    heap->size = 0;
+}
+
+/**
+ * Inserts the id into the heap, or if it is already queued moves it to its place after its key was changed
+ **/
+void heapPush(struct IndexedHeap *heap, int id)
+{
+    if (heap->position[id] == -1)
+    {
+        heap->ids[heap->size] = id;
+        heap->position[id] = heap->size;
+        heap->size++;
+    }
+    siftUp(heap, heap->position[id]);
+    siftDown(heap, heap->position[id]);
+}
+
+/**
+ * Removes and returns the id with the smallest key (the lowest id amongst equal keys), or -1 if empty
+ **/
+int heapPop(struct IndexedHeap *heap)
+{
+    if (heap->size == 0)
+        return -1;
+    int id = heap->ids[0];
+    heap->size--;
+    if (heap->size > 0)
+    {
+        heapSwap(heap, 0, heap->size);
+        siftDown(heap, 0);
+    }
+    heap->position[id] = -1;
+    return id;
+}
+
+/**
+ * Empties the heap, only touching the ids that are still queued so it can be reused cheaply between searches
+ **/
+void heapClear(struct IndexedHeap *heap)
+{
+    for (int i = 0; i < heap->size; i++)
+    {
+        heap->position[heap->ids[i]] = -1;
+    }
+    heap->size = 0;
+}
+
+/**
+ * Whether the entry at heap index a should be above the one at heap index b
+ **/
+static int heapLess(struct IndexedHeap *heap, int a, int b)
+{
+    int id_a = heap->ids[a], id_b = heap->ids[b];
+    if (heap->keys[id_a] != heap->keys[id_b])
+        return heap->keys[id_a] < heap->keys[id_b];
+    return id_a < id_b;
+}
+
+static void heapSwap(struct IndexedHeap *heap, int a, int b)
+{
+    int id = heap->ids[a];
+    heap->ids[a] = heap->ids[b];
+    heap->ids[b] = id;
+    heap->position[heap->ids[a]] = a;
+    heap->position[heap->ids[b]] = b;
+}
+
+static void siftUp(struct IndexedHeap *heap, int i)
+{
+    while (i > 0 && heapLess(heap, i, (i - 1) / 2))
+    {
+        heapSwap(heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void siftDown(struct IndexedHeap *heap, int i)
+{
+    while (1 == 1)
+    {
+        int smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < heap->size && heapLess(heap, left, smallest))
+            smallest = left;
+        if (right < heap->size && heapLess(heap, right, smallest))
+            smallest = right;
+        if (smallest == i)
+            break;
+        heapSwap(heap, i, smallest);
+        i = smallest;
+    }
+}
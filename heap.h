@@ -0,0 +1,26 @@
+#ifndef HEAP_H_
+#define HEAP_H_
+
+#include <stdint.h>
+
+// Indexed binary min-heap of junction ids ordered by an external array of keys, ties are broken by the lower id.
+// Each id is in the heap at most once, so pushing an id that is already queued just moves it to its new key
+struct IndexedHeap {
+	int size;
+	int *ids;
+	int *position;
+	const int64_t *keys;
+};
+
+// Allocates a heap able to hold ids [0, capacity) ordered by the provided keys
+void heapInit(struct IndexedHeap *, int, const int64_t *);
+// Frees the memory held by the heap
+void heapFree(struct IndexedHeap *);
+// Inserts the id, or restores heap order after its key has been changed if it is already queued
+void heapPush(struct IndexedHeap *, int);
+// Removes and returns the id with the smallest key
+int heapPop(struct IndexedHeap *);
+// Empties the heap in time proportional to the number of queued ids
+void heapClear(struct IndexedHeap *);
+
+#endif /* HEAP_H_ */
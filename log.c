@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <string.h>
+#include "mpi.h"
+#include "log.h"
+
+// Ring buffer of the rank, logRecord only copies into it so that logging never does any I/O on the hot paths
+static struct LogRecord ring[LOG_RING_RECORDS];
+static int64_t numLogged = 0;
+static int logRank = -1;
+
+/**
+ * Remembers the rank, which names the log file written at shutdown
+ **/
+void logInit()
+{
+    MPI_Comm_rank(MPI_COMM_WORLD, &logRank);
+    numLogged = 0;
+}
+
+/**
+ * Appends a record, overwriting the oldest one once the ring buffer is full. Only the thread calling MPI logs
+ **/
+void logRecord(int level, int event, int a, int b, int c, int d, int e)
+{
+    struct LogRecord *record = &ring[numLogged % LOG_RING_RECORDS];
+    record->time = MPI_Wtime();
+    record->level = level;
+    record->event = event;
+    record->args[0] = a;
+    record->args[1] = b;
+    record->args[2] = c;
+    record->args[3] = d;
+    record->args[4] = e;
+    numLogged++;
+}
+
+/**
+ * Writes the records still held in the ring buffer, oldest first. Ranks that logged nothing do not create a file
+ **/
+void logFlush()
+{
+    if (numLogged == 0)
+        return;
+
+    char filename[64];
+    snprintf(filename, sizeof(filename), "%s%d.bin", LOG_FILE_PREFIX, logRank);
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Error opening log file '%s' for writing\n", filename);
+        return;
+    }
+
+    struct LogFileHeader header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, LOG_FILE_MAGIC, sizeof(header.magic));
+    header.version = LOG_FILE_VERSION;
+    header.rank = logRank;
+    header.numLogged = numLogged;
+    header.numRecords = numLogged < LOG_RING_RECORDS ? numLogged : LOG_RING_RECORDS;
+
+    // Once the ring buffer has wrapped around the oldest record is the one that would be overwritten next
+    int64_t first = numLogged - header.numRecords;
+    int64_t start = first % LOG_RING_RECORDS;
+    int64_t numTail = header.numRecords < LOG_RING_RECORDS - start ? header.numRecords : LOG_RING_RECORDS - start;
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(&ring[start], sizeof(struct LogRecord), numTail, f) == (size_t)numTail;
+    ok = ok && fwrite(ring, sizeof(struct LogRecord), header.numRecords - numTail, f) == (size_t)(header.numRecords - numTail);
+    if (fclose(f) != 0 || !ok)
+    {
+        fprintf(stderr, "Error writing log file '%s'\n", filename);
+    }
+    numLogged = 0;
+}
@@ -0,0 +1,84 @@
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdint.h>
+
+// Log levels, records above the compiled LOG_LEVEL are removed by the preprocessor and cost nothing.
+// Build with e.g. `make LOG_LEVEL=4` to keep the per message records
+#define LOG_LEVEL_OFF 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Records are kept in a per rank ring buffer of this many records, once it is full the oldest records are overwritten
+#define LOG_RING_RECORDS 65536
+#define LOG_NUM_ARGS 5
+
+// Each rank flushes its ring buffer at shutdown into LOG_FILE_PREFIX<rank>.bin, read them with log_decode
+#define LOG_FILE_PREFIX "simulation_log."
+#define LOG_FILE_MAGIC "SIMLOG"
+#define LOG_FILE_VERSION 1
+
+// Events of the log records, the meaning of their arguments is described by the decoder
+enum LogEvent {
+	LOG_TRANSITION_SENT,
+	LOG_TRANSITION_RECEIVED,
+	LOG_ROAD_SPEEDS_REQUESTED,
+	LOG_ROAD_SPEEDS_RECEIVED,
+	LOG_MAP_MINUTE,
+	LOG_NUM_EVENTS
+};
+
+struct LogRecord {
+	double time;
+	int16_t level;
+	int16_t event;
+	int32_t args[LOG_NUM_ARGS];
+};
+
+struct LogFileHeader {
+	char magic[8];
+	uint32_t version;
+	int32_t rank;
+	// Number of records logged by the rank, more than numRecords if the ring buffer wrapped around
+	int64_t numLogged;
+	int64_t numRecords;
+};
+
+// Must be called after MPI has been initialised and before any record is logged
+void logInit();
+// Writes the records still held in the ring buffer, oldest first, to the rank's log file
+void logFlush();
+// Appends a record to the ring buffer, use the LOG_* macros instead so that disabled levels are compiled out
+void logRecord(int, int, int, int, int, int, int);
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(event, a, b, c, d, e) logRecord(LOG_LEVEL_ERROR, event, a, b, c, d, e)
+#else
+#define LOG_ERROR(event, a, b, c, d, e) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(event, a, b, c, d, e) logRecord(LOG_LEVEL_WARN, event, a, b, c, d, e)
+#else
+#define LOG_WARN(event, a, b, c, d, e) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(event, a, b, c, d, e) logRecord(LOG_LEVEL_INFO, event, a, b, c, d, e)
+#else
+#define LOG_INFO(event, a, b, c, d, e) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(event, a, b, c, d, e) logRecord(LOG_LEVEL_DEBUG, event, a, b, c, d, e)
+#else
+#define LOG_DEBUG(event, a, b, c, d, e) ((void)0)
+#endif
+
+#endif /* LOG_H_ */
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+
+// A decoded record together with the rank that logged it and its position in that rank's log
+struct DecodedRecord
+{
+    struct LogRecord record;
+    int rank;
+    int64_t sequence;
+};
+
+// Printed form of each event, the format consumes the record's arguments in order
+static const char *eventNames[LOG_NUM_EVENTS] = {
+    "Sending Transition",
+    "Received Transition",
+    "Requesting Road Speeds",
+    "Received Road Speeds",
+    "Map Minute",
+};
+static const char *eventFormats[LOG_NUM_EVENTS] = {
+    "LeftJunction=%d, LeftRoad=%d, EnteredJunction=%d, EnteredRoad=%d to Map=%d",
+    "LeftJunction=%d, LeftRoad=%d, EnteredJunction=%d, EnteredRoad=%d from Source=%d",
+    "JunctionId=%d, NumRoads=%d",
+    "JunctionId=%d, NumRoads=%d",
+    "Minute=%d",
+};
+static const char *levelNames[] = {"OFF", "ERROR", "WARN", "INFO", "DEBUG"};
+
+static int compareRecords(const void *, const void *);
+
+/**
+ * Decodes the binary log files flushed by the ranks of a simulation and prints their records merged by time.
+ * Times are MPI_Wtime values, which are only comparable across nodes if the MPI clocks are synchronised.
+ * Usage: log_decode <log file>...
+ **/
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Error: You need to provide one or more log files (%s<rank>.bin) as arguments\n", LOG_FILE_PREFIX);
+        exit(-1);
+    }
+
+    struct DecodedRecord *records = NULL;
+    int64_t numRecords = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *f = fopen(argv[i], "rb");
+        if (f == NULL)
+        {
+            fprintf(stderr, "Error opening log file '%s'\n", argv[i]);
+            exit(-1);
+        }
+        struct LogFileHeader header;
+        if (fread(&header, sizeof(header), 1, f) != 1 || strncmp(header.magic, LOG_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != LOG_FILE_VERSION)
+        {
+            fprintf(stderr, "Error: '%s' is not a version %d log file\n", argv[i], LOG_FILE_VERSION);
+            exit(-1);
+        }
+        if (header.numLogged > header.numRecords)
+        {
+            fprintf(stderr, "Warning: Rank %d overwrote its %ld oldest records, increase 'LOG_RING_RECORDS'\n", header.rank, (long)(header.numLogged - header.numRecords));
+        }
+
+        records = (struct DecodedRecord *)realloc(records, sizeof(struct DecodedRecord) * (numRecords + header.numRecords));
+        for (int64_t r = 0; r < header.numRecords; r++)
+        {
+            struct DecodedRecord *decoded = &records[numRecords + r];
+            if (fread(&decoded->record, sizeof(struct LogRecord), 1, f) != 1)
+            {
+                fprintf(stderr, "Error: Log file '%s' is truncated\n", argv[i]);
+                exit(-1);
+            }
+            decoded->rank = header.rank;
+            decoded->sequence = r;
+        }
+        numRecords += header.numRecords;
+        fclose(f);
+    }
+
+    qsort(records, numRecords, sizeof(struct DecodedRecord), compareRecords);
+    for (int64_t r = 0; r < numRecords; r++)
+    {
+        const struct LogRecord *record = &records[r].record;
+        const char *level = record->level >= LOG_LEVEL_OFF && record->level <= LOG_LEVEL_DEBUG ? levelNames[record->level] : "?";
+        if (record->event < 0 || record->event >= LOG_NUM_EVENTS)
+        {
+            printf("%.6f [%d] %s Unknown event %d\n", record->time, records[r].rank, level, record->event);
+            continue;
+        }
+        printf("%.6f [%d] %s %s: ", record->time, records[r].rank, level, eventNames[record->event]);
+        printf(eventFormats[record->event], record->args[0], record->args[1], record->args[2], record->args[3], record->args[4]);
+        printf("\n");
+    }
+    free(records);
+    return 0;
+}
+
+/**
+ * Orders records by time, records of the same rank with equal times keep the order they were logged in
+ **/
+static int compareRecords(const void *a, const void *b)
+{
+    const struct DecodedRecord *x = (const struct DecodedRecord *)a, *y = (const struct DecodedRecord *)b;
+    if (x->record.time != y->record.time)
+        return x->record.time < y->record.time ? -1 : 1;
+    if (x->rank != y->rank)
+        return x->rank < y->rank ? -1 : 1;
+    return x->sequence < y->sequence ? -1 : (x->sequence > y->sequence);
+}
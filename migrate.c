@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "mpi.h"
+#include "roadmap.h"
+#include "code.h"
+#include "comm.h"
+#include "migrate.h"
+
+// 每轮负载均衡时每个host贡献的负载：上一轮推进车辆花费的时间和车辆数量，stopping表示host已经停止，这一轮不迁移
+struct HostLoad
+{
+    double cost;
+    int numVehicles;
+    int stopping;
+};
+
+// vehicle host组成的通信器，每个模拟分钟交换一次负载，所有host按相同的负载算出相同的迁移计划
+static MPI_Comm hostComm = MPI_COMM_NULL;
+static int myHost, numHosts;
+static struct HostLoad myLoads[MAX_MINS];
+static struct HostLoad hostLoads[MAX_MINS][NUM_VEHICLE_HOSTS];
+static MPI_Request loadRequests[MAX_MINS];
+static int numRounds = 0, numCompleted = 0, numExecuted = 0;
+static double busySeconds = 0;
+static char stopping = 0;
+// 发往每个host的批次的发送缓冲区和请求，一个批次发送完成之前不执行下一轮计划
+static struct PackedVehicle *sendBuffers[NUM_VEHICLE_HOSTS];
+static MPI_Request sendRequests[NUM_VEHICLE_HOSTS];
+// 从每个host收到的批次，在所有map确认之前不激活。acks按来源host和map计数，来自某个host的第k个批次在每个map都确认了
+// 至少k个批次之后激活
+static struct PackedVehicle *receiveBuffers[NUM_VEHICLE_HOSTS];
+static int receiveCounts[NUM_VEHICLE_HOSTS];
+static int acks[NUM_VEHICLE_HOSTS][NUM_MAP_ACTORS];
+static int expected[NUM_VEHICLE_HOSTS], released[NUM_VEHICLE_HOSTS];
+static long totalSent = 0, totalReceived = 0;
+
+static void planRound(const struct HostLoad *, int[NUM_VEHICLE_HOSTS][NUM_VEHICLE_HOSTS]);
+static int executeRound(struct VehicleStruct *, int);
+static int releaseBatch(struct VehicleStruct *, int, int);
+static int migrationDone(int);
+
+/**
+ * 把车辆写成序列化形式
+ */
+void packVehicle(const struct VehicleStruct *vehicle, struct PackedVehicle *packed)
+{
+    packed->passengers = vehicle->passengers;
+    packed->source = vehicle->source;
+    packed->dest = vehicle->dest;
+    packed->maxSpeed = vehicle->maxSpeed;
+    packed->speed = vehicle->speed;
+    packed->arrived_road_time = vehicle->arrived_road_time;
+    packed->fuel = vehicle->fuel;
+    packed->currentJunction = vehicle->currentJunction;
+    packed->roadOn = vehicle->roadOn;
+    packed->plannedRoad = vehicle->plannedRoad;
+    packed->plannedSpeed = vehicle->plannedSpeed;
+    packed->active = vehicle->active;
+    packed->last_distance_check_secs = vehicle->last_distance_check_secs;
+    packed->start_t = vehicle->start_t;
+    packed->remaining_distance = vehicle->remaining_distance;
+}
+
+/**
+ * 从序列化形式恢复车辆
+ */
+void unpackVehicle(const struct PackedVehicle *packed, struct VehicleStruct *vehicle)
+{
+    vehicle->passengers = packed->passengers;
+    vehicle->source = packed->source;
+    vehicle->dest = packed->dest;
+    vehicle->maxSpeed = packed->maxSpeed;
+    vehicle->speed = packed->speed;
+    vehicle->arrived_road_time = packed->arrived_road_time;
+    vehicle->fuel = packed->fuel;
+    vehicle->currentJunction = packed->currentJunction;
+    vehicle->roadOn = packed->roadOn;
+    vehicle->plannedRoad = packed->plannedRoad;
+    vehicle->plannedSpeed = packed->plannedSpeed;
+    vehicle->active = (char)packed->active;
+    vehicle->last_distance_check_secs = (time_t)packed->last_distance_check_secs;
+    vehicle->start_t = (time_t)packed->start_t;
+    vehicle->remaining_distance = packed->remaining_distance;
+}
+
+/**
+ * 创建vehicle host之间的通信器和迁移缓冲区，必须在进程池启动之前由所有进程调用
+ */
+void initMigration()
+{
+    if (!USE_VEHICLE_HOSTS || !USE_VEHICLE_MIGRATION || NUM_VEHICLE_HOSTS < 2)
+        return;
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    int member = rank >= FIRST_VEHICLE_HOST_RANK && rank < FIRST_VEHICLE_HOST_RANK + NUM_VEHICLE_HOSTS;
+    MPI_Comm_split(MPI_COMM_WORLD, member ? 0 : MPI_UNDEFINED, rank, &hostComm);
+    if (hostComm == MPI_COMM_NULL)
+        return;
+    MPI_Comm_rank(hostComm, &myHost);
+    MPI_Comm_size(hostComm, &numHosts);
+    for (int h = 0; h < numHosts; h++)
+    {
+        sendBuffers[h] = (struct PackedVehicle *)malloc(sizeof(struct PackedVehicle) * MIGRATION_MAX_BATCH);
+        receiveBuffers[h] = (struct PackedVehicle *)malloc(sizeof(struct PackedVehicle) * MIGRATION_MAX_BATCH);
+        sendRequests[h] = MPI_REQUEST_NULL;
+        receiveCounts[h] = -1;
+    }
+}
+
+/**
+ * 释放迁移使用的通信器和缓冲区
+ */
+void freeMigration()
+{
+    if (hostComm == MPI_COMM_NULL)
+        return;
+    for (int h = 0; h < numHosts; h++)
+    {
+        free(sendBuffers[h]);
+        free(receiveBuffers[h]);
+    }
+    MPI_Comm_free(&hostComm);
+}
+
+/**
+ * vehicle host记录推进车辆花费的时间，作为下一轮负载均衡的负载
+ */
+void recordHostCost(double seconds)
+{
+    busySeconds += seconds;
+}
+
+/**
+ * vehicle host每个模拟分钟开始一轮负载均衡，非阻塞地交换负载，不等待其他host
+ */
+void startBalancing(int num_vehicles)
+{
+    if (hostComm == MPI_COMM_NULL || numRounds >= MAX_MINS)
+        return;
+    struct HostLoad *load = &myLoads[numRounds];
+    load->cost = busySeconds;
+    load->numVehicles = num_vehicles;
+    load->stopping = stopping;
+    busySeconds = 0;
+    MPI_Iallgather(load, sizeof(struct HostLoad), MPI_BYTE, hostLoads[numRounds], sizeof(struct HostLoad), MPI_BYTE, hostComm, &loadRequests[numRounds]);
+    numRounds++;
+}
+
+/**
+ * vehicle host每次循环调用，按顺序执行已经交换完负载的轮次的迁移计划，接收其他host迁移来的批次和map的确认，
+ * 激活已经被所有map确认的批次。返回迁移之后的车辆数量
+ */
+int progressMigration(struct VehicleStruct *vehicles, int num_vehicles)
+{
+    if (hostComm == MPI_COMM_NULL)
+        return num_vehicles;
+
+    while (numCompleted < numRounds)
+    {
+        int flag;
+        MPI_Test(&loadRequests[numCompleted], &flag, MPI_STATUS_IGNORE);
+        if (!flag)
+            break;
+        numCompleted++;
+    }
+
+    // 上一轮的批次都发送完成之后才执行下一轮计划，发送缓冲区可以重用
+    while (numExecuted < numCompleted)
+    {
+        int flag;
+        MPI_Testall(numHosts, sendRequests, &flag, MPI_STATUSES_IGNORE);
+        if (!flag)
+            break;
+        num_vehicles = executeRound(vehicles, num_vehicles);
+    }
+
+    // 接收迁移来的批次，每个来源host同时最多保存一个等待确认的批次
+    for (int h = 0; h < numHosts; h++)
+    {
+        if (h == myHost || receiveCounts[h] != -1)
+            continue;
+        int flag;
+        MPI_Message message;
+        MPI_Status status;
+        MPI_Improbe(FIRST_VEHICLE_HOST_RANK + h, TAG_MIGRATION, MPI_COMM_WORLD, &flag, &message, &status);
+        if (!flag)
+            continue;
+        int bytes;
+        MPI_Get_count(&status, MPI_BYTE, &bytes);
+        MPI_Mrecv(receiveBuffers[h], bytes, MPI_BYTE, &message, MPI_STATUS_IGNORE);
+        receiveCounts[h] = bytes / (int)sizeof(struct PackedVehicle);
+    }
+
+    // map的确认说明来源host在迁移之前发给这个map的转移消息都已经处理完
+    int flag;
+    MPI_Status status;
+    MPI_Iprobe(MPI_ANY_SOURCE, TAG_MIGRATION_ACK, MPI_COMM_WORLD, &flag, &status);
+    while (flag)
+    {
+        int sourceRank;
+        MPI_Recv(&sourceRank, 1, MPI_INT, status.MPI_SOURCE, TAG_MIGRATION_ACK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        acks[sourceRank - FIRST_VEHICLE_HOST_RANK][status.MPI_SOURCE - MAP_ACTOR_RANK]++;
+        MPI_Iprobe(MPI_ANY_SOURCE, TAG_MIGRATION_ACK, MPI_COMM_WORLD, &flag, &status);
+    }
+
+    for (int h = 0; h < numHosts; h++)
+    {
+        if (receiveCounts[h] == -1)
+            continue;
+        int confirmed = 1;
+        for (int m = 0; m < NUM_MAP_ACTORS && confirmed; m++)
+            confirmed = acks[h][m] > released[h];
+        if (confirmed)
+            num_vehicles = releaseBatch(vehicles, num_vehicles, h);
+    }
+    return num_vehicles;
+}
+
+/**
+ * vehicle host停止时调用，和统计归约一样补齐剩余的轮次（这些轮次不迁移），然后完成所有迁移，
+ * 保证每个批次都被接收，每条确认都被接收。必须在向map发送停止信号之前调用，map要转发停止之前的所有确认
+ */
+int finishMigration(struct VehicleStruct *vehicles, int num_vehicles)
+{
+    if (hostComm == MPI_COMM_NULL)
+        return num_vehicles;
+    stopping = 1;
+    while (numRounds < MAX_MINS)
+    {
+        startBalancing(num_vehicles);
+    }
+    while (!migrationDone(MAX_MINS))
+    {
+        num_vehicles = progressMigration(vehicles, num_vehicles);
+    }
+    return num_vehicles;
+}
+
+/**
+ * vehicle host写检查点之前调用，等待所有host都已经开始的轮次交换完负载，然后执行这些轮次的计划，直到每个批次都被接收并激活，
+ * 这时没有车辆在host之间传输。所有host在同一分钟写检查点，已经开始的轮次相同
+ */
+int quiesceMigration(struct VehicleStruct *vehicles, int num_vehicles)
+{
+    if (hostComm == MPI_COMM_NULL)
+        return num_vehicles;
+    while (!migrationDone(numRounds))
+    {
+        num_vehicles = progressMigration(vehicles, num_vehicles);
+    }
+    return num_vehicles;
+}
+
+/**
+ * 从检查点恢复时，前minute轮负载均衡在检查点之前已经全部完成，从下一轮继续
+ */
+void resumeMigration(int minute)
+{
+    numRounds = minute;
+    numCompleted = minute;
+    numExecuted = minute;
+}
+
+/**
+ * map收到host的迁移栅栏时，该host在迁移之前发给这个map的转移消息都已经处理完，把确认转发给接收批次的host
+ */
+void forwardMigrationFence(MPI_Message *message, MPI_Status *status)
+{
+    int destination;
+    MPI_Mrecv(&destination, 1, MPI_INT, message, MPI_STATUS_IGNORE);
+    MPI_Send(&status->MPI_SOURCE, 1, MPI_INT, destination, TAG_MIGRATION_ACK, MPI_COMM_WORLD);
+}
+
+/**
+ * 该host迁出和迁入的车辆总数
+ */
+void getMigrationTotals(long *sent, long *received)
+{
+    *sent = totalSent;
+    *received = totalReceived;
+}
+
+/**
+ * 按一轮的负载算出迁移计划，counts[i][j]为host i迁移到host j的车辆数量。开销超过平均值一定比例的host按顺序
+ * 把车辆迁移给开销低于平均值的host，迁移的数量按该host每辆车的平均开销估算
+ */
+static void planRound(const struct HostLoad *loads, int counts[NUM_VEHICLE_HOSTS][NUM_VEHICLE_HOSTS])
+{
+    memset(counts, 0, sizeof(int) * NUM_VEHICLE_HOSTS * NUM_VEHICLE_HOSTS);
+    double total = 0;
+    for (int h = 0; h < numHosts; h++)
+    {
+        if (loads[h].stopping)
+            return;
+        total += loads[h].cost;
+    }
+    if (total <= 0)
+        return;
+
+    double mean = total / numHosts, surplus[NUM_VEHICLE_HOSTS];
+    int remaining[NUM_VEHICLE_HOSTS];
+    for (int h = 0; h < numHosts; h++)
+    {
+        surplus[h] = loads[h].cost - mean;
+        remaining[h] = loads[h].numVehicles;
+    }
+    for (int i = 0; i < numHosts; i++)
+    {
+        if (surplus[i] <= MIGRATION_IMBALANCE * mean || remaining[i] == 0)
+            continue;
+        double perVehicle = loads[i].cost / loads[i].numVehicles;
+        for (int j = 0; j < numHosts && surplus[i] > 0; j++)
+        {
+            if (surplus[j] >= 0)
+                continue;
+            double move = surplus[i] < -surplus[j] ? surplus[i] : -surplus[j];
+            int n = (int)(move / perVehicle);
+            if (n > MIGRATION_MAX_BATCH)
+                n = MIGRATION_MAX_BATCH;
+            if (n > remaining[i])
+                n = remaining[i];
+            if (n <= 0)
+                continue;
+            counts[i][j] = n;
+            remaining[i] -= n;
+            surplus[i] -= n * perVehicle;
+            surplus[j] += n * perVehicle;
+        }
+    }
+}
+
+/**
+ * 执行最早一轮的迁移计划。迁出的车辆从数组末尾取出，先给每个map发送栅栏，排在这些车辆之前所有转移消息之后，
+ * 再把批次发给接收的host。计划要求的批次总是发送，即使车辆已经不够，接收方按计划数批次
+ */
+static int executeRound(struct VehicleStruct *vehicles, int num_vehicles)
+{
+    int counts[NUM_VEHICLE_HOSTS][NUM_VEHICLE_HOSTS];
+    planRound(hostLoads[numExecuted], counts);
+    numExecuted++;
+    for (int j = 0; j < numHosts; j++)
+    {
+        if (counts[j][myHost] > 0)
+            expected[j]++;
+        int n = counts[myHost][j];
+        if (n == 0)
+            continue;
+        if (n > num_vehicles)
+            n = num_vehicles;
+        for (int v = 0; v < n; v++)
+        {
+            packVehicle(&vehicles[num_vehicles - n + v], &sendBuffers[j][v]);
+        }
+        num_vehicles -= n;
+        totalSent += n;
+
+        int destination = FIRST_VEHICLE_HOST_RANK + j;
+        for (int m = 0; m < NUM_MAP_ACTORS; m++)
+        {
+            MPI_Send(&destination, 1, MPI_INT, MAP_ACTOR_RANK + m, TAG_MIGRATION_FENCE, MPI_COMM_WORLD);
+        }
+        MPI_Isend(sendBuffers[j], n * (int)sizeof(struct PackedVehicle), MPI_BYTE, destination, TAG_MIGRATION, MPI_COMM_WORLD, &sendRequests[j]);
+    }
+    return num_vehicles;
+}
+
+/**
+ * 把来自host h的已确认批次加到车辆数组末尾。数组放不下的车辆被丢弃，并通知map它们离开了所在的路口或道路
+ */
+static int releaseBatch(struct VehicleStruct *vehicles, int num_vehicles, int h)
+{
+    for (int v = 0; v < receiveCounts[h]; v++)
+    {
+        if (num_vehicles < MAX_VEHICLES_PER_HOST)
+        {
+            unpackVehicle(&receiveBuffers[h][v], &vehicles[num_vehicles++]);
+            continue;
+        }
+        fprintf(stderr, "Warning: Vehicle host is full, dropping a migrated vehicle, increase 'MAX_VEHICLES_PER_HOST'\n");
+        TransitionMessage transition = createTransition();
+        transition.leftRoad = receiveBuffers[h][v].roadOn;
+        transition.leftJunction = receiveBuffers[h][v].currentJunction;
+        if (transition.leftRoad != -1 || transition.leftJunction != -1)
+        {
+            sendTransition(&transition);
+        }
+    }
+    totalReceived += receiveCounts[h];
+    receiveCounts[h] = -1;
+    released[h]++;
+    return num_vehicles;
+}
+
+/**
+ * 前rounds轮的计划都已执行，发出的批次都已发送完成，计划中的批次都已激活
+ */
+static int migrationDone(int rounds)
+{
+    if (numExecuted < rounds)
+        return 0;
+    int flag;
+    MPI_Testall(numHosts, sendRequests, &flag, MPI_STATUSES_IGNORE);
+    if (!flag)
+        return 0;
+    for (int h = 0; h < numHosts; h++)
+    {
+        if (released[h] < expected[h])
+            return 0;
+    }
+    return 1;
+}
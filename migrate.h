@@ -0,0 +1,33 @@
+#ifndef MIGRATE_H_
+#define MIGRATE_H_
+
+#include <stdint.h>
+#include "mpi.h"
+
+struct VehicleStruct;
+
+// 车辆在进程之间传输时的序列化形式，只包含定长的字段，所在路口和道路以及规划的道路都是拓扑中的下标
+struct PackedVehicle
+{
+    int32_t passengers, source, dest, maxSpeed;
+    int32_t speed, arrived_road_time, fuel;
+    int32_t currentJunction, roadOn, plannedRoad, plannedSpeed;
+    int32_t active;
+    int64_t last_distance_check_secs, start_t;
+    double remaining_distance;
+};
+
+void packVehicle(const struct VehicleStruct *, struct PackedVehicle *);
+void unpackVehicle(const struct PackedVehicle *, struct VehicleStruct *);
+void initMigration();
+void freeMigration();
+void recordHostCost(double);
+void startBalancing(int);
+int progressMigration(struct VehicleStruct *, int);
+int finishMigration(struct VehicleStruct *, int);
+int quiesceMigration(struct VehicleStruct *, int);
+void resumeMigration(int);
+void forwardMigrationFence(MPI_Message *, MPI_Status *);
+void getMigrationTotals(long *, long *);
+
+#endif /* MIGRATE_H_ */
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "roadmap.h"
+#include "code.h"
+#include "partition.h"
+
+static int loadMapPartition(char *, const struct RoadTopology *, struct MapPartition *);
+static void assignRoadOwners(const struct RoadTopology *, struct MapPartition *);
+static void assignLocalIndices(const struct RoadTopology *, struct MapPartition *);
+static uint64_t computePartitionChecksum(const struct RoadTopology *, const struct MapPartition *);
+
+/**
+ * Uses the partition file of the roadmap for this number of map actors if roadmap_partition has written one. Otherwise
+ * the junctions are split into contiguous blocks of ids, balancing the number of roads (plus one per junction) in each
+ * block as these are what the map actors update. Junctions with neighbouring ids are usually close in the roadmap
+ * file, so this also keeps many roads within one block
+ **/
+void createMapPartition(const struct RoadTopology *topology, char *roadmapFilename, int numParts, struct MapPartition *partition)
+{
+    partition->numParts = numParts;
+    partition->junctionOwner = (int32_t *)malloc(sizeof(int32_t) * topology->num_junctions);
+    partition->roadOwner = (int32_t *)malloc(sizeof(int32_t) * topology->num_roads);
+
+    char filename[strlen(roadmapFilename) + strlen(PARTITION_FILE_SUFFIX) + 16];
+    sprintf(filename, "%s%s.%d", roadmapFilename, PARTITION_FILE_SUFFIX, numParts);
+    if (!loadMapPartition(filename, topology, partition))
+    {
+        int64_t totalWeight = (int64_t)topology->num_roads + topology->num_junctions, weight = 0;
+        for (int i = 0; i < topology->num_junctions; i++)
+        {
+            int part = (int)(weight * numParts / totalWeight);
+            partition->junctionOwner[i] = MAP_ACTOR_RANK + part;
+            weight += topology->roadOffsets[i + 1] - topology->roadOffsets[i] + 1;
+        }
+    }
+    assignRoadOwners(topology, partition);
+    assignLocalIndices(topology, partition);
+    partition->checksum = computePartitionChecksum(topology, partition);
+}
+
+/**
+ * Frees the memory held by the partition
+ **/
+void freeMapPartition(struct MapPartition *partition)
+{
+    free(partition->junctionOwner);
+    free(partition->roadOwner);
+    free(partition->junctionIndex);
+    free(partition->roadIndex);
+    free(partition->partOffsets);
+    free(partition->partJunctions);
+    free(partition->partRoads);
+    partition->junctionOwner = partition->roadOwner = NULL;
+}
+
+/**
+ * Writes the header describing the roadmap and then the part of every junction on its own line
+ **/
+void writeMapPartition(char *filename, const struct RoadTopology *topology, const int *parts)
+{
+    FILE *f = fopen(filename, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Error opening partition file '%s' for writing\n", filename);
+        exit(-1);
+    }
+    int ok = fprintf(f, PARTITION_FILE_HEADER "\n", topology->num_junctions, topology->num_roads,
+                     (unsigned long long)topology->checksum) > 0;
+    for (int i = 0; i < topology->num_junctions && ok; i++)
+    {
+        ok = fprintf(f, "%d\n", parts[i]) > 0;
+    }
+    if (fclose(f) != 0 || !ok)
+    {
+        fprintf(stderr, "Error writing partition file '%s'\n", filename);
+        exit(-1);
+    }
+}
+
+/**
+ * Reads the junction owners from a partition file, returns zero if there is no such file. The file must have been
+ * written for this roadmap and hold exactly one part per junction
+ **/
+static int loadMapPartition(char *filename, const struct RoadTopology *topology, struct MapPartition *partition)
+{
+    FILE *f = fopen(filename, "r");
+    if (f == NULL)
+        return 0;
+
+    int num_junctions, num_roads;
+    unsigned long long checksum;
+    if (fscanf(f, PARTITION_FILE_HEADER, &num_junctions, &num_roads, &checksum) != 3 ||
+        num_junctions != topology->num_junctions || num_roads != topology->num_roads || checksum != topology->checksum)
+    {
+        fprintf(stderr, "Error: Partition file '%s' was not written for this roadmap, rerun roadmap_partition\n", filename);
+        exit(-1);
+    }
+    for (int i = 0; i < topology->num_junctions; i++)
+    {
+        int part;
+        if (fscanf(f, "%d", &part) != 1 || part < 0 || part >= partition->numParts)
+        {
+            fprintf(stderr, "Error: Partition file '%s' does not match the roadmap, rerun roadmap_partition\n", filename);
+            exit(-1);
+        }
+        partition->junctionOwner[i] = MAP_ACTOR_RANK + part;
+    }
+    char extra;
+    if (fscanf(f, " %c", &extra) == 1)
+    {
+        fprintf(stderr, "Error: Partition file '%s' has more parts than the roadmap has junctions, rerun roadmap_partition\n", filename);
+        exit(-1);
+    }
+    fclose(f);
+    return 1;
+}
+
+/**
+ * A road is owned by the map actor owning the junction it leaves, so all the roads of a junction have one owner
+ **/
+static void assignRoadOwners(const struct RoadTopology *topology, struct MapPartition *partition)
+{
+    for (int road = 0; road < topology->num_roads; road++)
+    {
+        partition->roadOwner[road] = partition->junctionOwner[topology->roadFrom[road]];
+    }
+}
+
+/**
+ * Numbers the junctions of each part in increasing id order and the roads of each part in the order of their junctions,
+ * so a part's state and board segment hold only what it owns whether or not its junctions are contiguous ids
+ **/
+static void assignLocalIndices(const struct RoadTopology *topology, struct MapPartition *partition)
+{
+    int numParts = partition->numParts;
+    partition->junctionIndex = (int32_t *)malloc(sizeof(int32_t) * topology->num_junctions);
+    partition->roadIndex = (int32_t *)malloc(sizeof(int32_t) * topology->num_roads);
+    partition->partOffsets = (int32_t *)calloc(numParts + 1, sizeof(int32_t));
+    partition->partJunctions = (int32_t *)malloc(sizeof(int32_t) * topology->num_junctions);
+    partition->partRoads = (int32_t *)calloc(numParts, sizeof(int32_t));
+
+    // 统计每个部分的路口数量，得到每个部分的路口在partJunctions中的起始位置
+    for (int i = 0; i < topology->num_junctions; i++)
+    {
+        partition->partOffsets[partition->junctionOwner[i] - MAP_ACTOR_RANK + 1]++;
+    }
+    for (int p = 0; p < numParts; p++)
+    {
+        partition->partOffsets[p + 1] += partition->partOffsets[p];
+    }
+    int32_t *next = (int32_t *)malloc(sizeof(int32_t) * numParts);
+    memcpy(next, partition->partOffsets, sizeof(int32_t) * numParts);
+    for (int i = 0; i < topology->num_junctions; i++)
+    {
+        partition->partJunctions[next[partition->junctionOwner[i] - MAP_ACTOR_RANK]++] = i;
+    }
+    free(next);
+
+    // 本地下标为路口在部分中的位置，道路按路口的顺序连续编号
+    for (int p = 0; p < numParts; p++)
+    {
+        for (int k = partition->partOffsets[p]; k < partition->partOffsets[p + 1]; k++)
+        {
+            int junction = partition->partJunctions[k];
+            partition->junctionIndex[junction] = k - partition->partOffsets[p];
+            for (int road = topology->roadOffsets[junction]; road < topology->roadOffsets[junction + 1]; road++)
+            {
+                partition->roadIndex[road] = partition->partRoads[p]++;
+            }
+        }
+    }
+}
+
+/**
+ * FNV-1a hash of the number of parts and the owner of every junction, the road owners and local indices follow from these
+ **/
+static uint64_t computePartitionChecksum(const struct RoadTopology *topology, const struct MapPartition *partition)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    hash ^= (uint64_t)partition->numParts;
+    hash *= 1099511628211ULL;
+    const unsigned char *bytes = (const unsigned char *)partition->junctionOwner;
+    for (size_t i = 0; i < (size_t)topology->num_junctions * sizeof(int32_t); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,55 @@
+#ifndef PARTITION_H_
+#define PARTITION_H_
+
+#include <stdint.h>
+#include "roadmap.h"
+
+// Assignment of junctions to the map actors. Each map actor owns a subset of the junctions and the roads leaving them,
+// junctionOwner and roadOwner hold the rank of the owning map actor and are indexed like the topology. A map actor
+// keeps the state of only what it owns, in arrays indexed by junctionIndex and roadIndex. The owned junctions of part p
+// are partJunctions[partOffsets[p]] to partJunctions[partOffsets[p+1]-1] in the order of their local index, partRoads[p]
+// is the number of roads it owns, and the roads of a junction have consecutive local indices
+struct MapPartition {
+	int numParts;
+	int32_t *junctionOwner;
+	int32_t *roadOwner;
+	int32_t *junctionIndex, *roadIndex;
+	int32_t *partOffsets, *partJunctions, *partRoads;
+	// Hash of junctionOwner, identifies the assignment so state saved under one partition is not restored under another
+	uint64_t checksum;
+};
+
+// Partition files (written by roadmap_partition) are stored next to the roadmap as <roadmap>.part.<number of parts>,
+// with the part of each junction on its own line as in METIS. They start with a comment line holding the number of
+// junctions and roads and the checksum of the roadmap they were written for
+#define PARTITION_FILE_SUFFIX ".part"
+// Format of the header line, used both to write and to read it
+#define PARTITION_FILE_HEADER "%% roadmap %d %d %llx"
+
+// Undirected weighted graph of the junctions used by the partitioner, the neighbours of vertex v are
+// adjacent[offsets[v]] to adjacent[offsets[v+1]-1]
+struct PartitionGraph {
+	int n;
+	int *offsets, *adjacent;
+	int64_t *edgeWeight, *vertexWeight;
+	int64_t totalWeight;
+};
+
+// Loads the partition file of the roadmap for this number of map actors if there is one, otherwise splits the
+// junctions into contiguous blocks with roughly the same number of roads, one block per map actor
+void createMapPartition(const struct RoadTopology *, char *, int, struct MapPartition *);
+// Frees the memory held by the partition
+void freeMapPartition(struct MapPartition *);
+// Writes the part (counted from zero) of every junction as a partition file
+void writeMapPartition(char *, const struct RoadTopology *, const int *);
+
+// Builds the graph of the topology weighted by the traffic of the given number of sampled shortest path trees
+void buildPartitionGraph(const struct RoadTopology *, int, struct PartitionGraph *);
+// Frees the memory held by a graph
+void freePartitionGraph(struct PartitionGraph *);
+// Multilevel recursive bisection of the graph into parts of roughly equal weight, reproducible for a given seed
+void partitionGraph(const struct PartitionGraph *, int, unsigned int, int *);
+// Computes the weight of the cut edges and the weight of the heaviest part relative to the average
+void evaluatePartition(const struct PartitionGraph *, int, const int *, int64_t *, double *);
+
+#endif /* PARTITION_H_ */
@@ -0,0 +1,697 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "roadmap.h"
+#include "code.h"
+#include "function.h"
+#include "heap.h"
+#include "partition.h"
+
+// Coarsening stops once a graph has this few vertices or a level removes less than 1/PARTITION_MIN_SHRINK of them
+#define PARTITION_COARSEST 64
+#define PARTITION_MIN_SHRINK 20
+// Number of random seeds tried for the initial bisection of the coarsest graph
+#define PARTITION_INITIAL_TRIES 8
+// Refinement passes per level, and moves without improving the cut after which a pass gives up
+#define PARTITION_REFINE_PASSES 8
+#define PARTITION_REFINE_PATIENCE 64
+// Allowed imbalance of a bisection, in percent of its target weight
+#define PARTITION_IMBALANCE_PERCENT 3
+
+// One level of the multilevel hierarchy, coarseMap maps the vertices of the finer level to the vertices of this one
+struct CoarseLevel
+{
+    struct PartitionGraph graph;
+    int *coarseMap;
+};
+
+static uint32_t randomState = 1;
+
+static int nextRandom(int);
+static void estimateTraffic(const struct RoadTopology *, int, int64_t *, int64_t *);
+static int compareEdges(const void *, const void *);
+static void coarsenGraph(const struct PartitionGraph *, struct PartitionGraph *, int *);
+static void bisectGraph(const struct PartitionGraph *, int64_t, char *);
+static void initialBisection(const struct PartitionGraph *, int64_t, char *);
+static int64_t refineBisection(const struct PartitionGraph *, int64_t, char *);
+static int64_t computeCut(const struct PartitionGraph *, const char *);
+static void inducedSubgraph(const struct PartitionGraph *, const int *, int, int *, struct PartitionGraph *);
+static void recursiveBisectionParts(const struct PartitionGraph *, int *, int, int, int, int *, int *);
+static void recursiveBisection(const struct PartitionGraph *, int *, int, int, int *);
+
+/**
+ * Builds the undirected graph to partition from the topology. Junctions are weighted by the number of sampled trips
+ * passing through them and roads by the number of sampled trips crossing them (both plus one, so quiet parts of the
+ * map still count), which approximates the messages each junction and road costs its map actor. Roads in both
+ * directions between two junctions become a single edge
+ **/
+void buildPartitionGraph(const struct RoadTopology *topology, int samples, struct PartitionGraph *graph)
+{
+    int n = topology->num_junctions, m = topology->num_roads;
+    int64_t *visits = (int64_t *)calloc(n, sizeof(int64_t));
+    int64_t *crossings = (int64_t *)calloc(m, sizeof(int64_t));
+    estimateTraffic(topology, samples, visits, crossings);
+
+    graph->n = n;
+    graph->vertexWeight = (int64_t *)malloc(sizeof(int64_t) * n);
+    graph->totalWeight = 0;
+    for (int i = 0; i < n; i++)
+    {
+        graph->vertexWeight[i] = visits[i] + 1;
+        graph->totalWeight += graph->vertexWeight[i];
+    }
+
+    // 按两个端点排序后合并同一对路口之间的道路，自环不影响划分
+    int64_t (*edges)[3] = malloc(sizeof(int64_t[3]) * m);
+    int numEdges = 0;
+    for (int road = 0; road < m; road++)
+    {
+        int u = topology->roadFrom[road], v = topology->roadTo[road];
+        if (u == v)
+            continue;
+        edges[numEdges][0] = u < v ? u : v;
+        edges[numEdges][1] = u < v ? v : u;
+        edges[numEdges][2] = crossings[road] + 1;
+        numEdges++;
+    }
+    qsort(edges, numEdges, sizeof(int64_t[3]), compareEdges);
+    int merged = 0;
+    for (int e = 0; e < numEdges; e++)
+    {
+        if (merged > 0 && edges[merged - 1][0] == edges[e][0] && edges[merged - 1][1] == edges[e][1])
+        {
+            edges[merged - 1][2] += edges[e][2];
+        }
+        else
+        {
+            memcpy(edges[merged++], edges[e], sizeof(int64_t[3]));
+        }
+    }
+
+    graph->offsets = (int *)calloc(n + 1, sizeof(int));
+    for (int e = 0; e < merged; e++)
+    {
+        graph->offsets[edges[e][0] + 1]++;
+        graph->offsets[edges[e][1] + 1]++;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        graph->offsets[i + 1] += graph->offsets[i];
+    }
+    graph->adjacent = (int *)malloc(sizeof(int) * 2 * merged);
+    graph->edgeWeight = (int64_t *)malloc(sizeof(int64_t) * 2 * merged);
+    int *fill = (int *)malloc(sizeof(int) * n);
+    memcpy(fill, graph->offsets, sizeof(int) * n);
+    for (int e = 0; e < merged; e++)
+    {
+        int u = edges[e][0], v = edges[e][1];
+        graph->adjacent[fill[u]] = v;
+        graph->edgeWeight[fill[u]++] = edges[e][2];
+        graph->adjacent[fill[v]] = u;
+        graph->edgeWeight[fill[v]++] = edges[e][2];
+    }
+    free(fill);
+    free(edges);
+    free(visits);
+    free(crossings);
+}
+
+/**
+ * Frees the memory held by a graph
+ **/
+void freePartitionGraph(struct PartitionGraph *graph)
+{
+    free(graph->offsets);
+    free(graph->adjacent);
+    free(graph->edgeWeight);
+    free(graph->vertexWeight);
+    graph->offsets = graph->adjacent = NULL;
+    graph->edgeWeight = graph->vertexWeight = NULL;
+}
+
+/**
+ * Splits the graph into numParts parts of roughly equal vertex weight with a small weight of cut edges, by multilevel
+ * recursive bisection. The seed makes the result reproducible
+ **/
+void partitionGraph(const struct PartitionGraph *graph, int numParts, unsigned int seed, int *parts)
+{
+    randomState = seed != 0 ? seed : 1;
+    int *vertices = (int *)malloc(sizeof(int) * graph->n);
+    for (int i = 0; i < graph->n; i++)
+    {
+        vertices[i] = i;
+    }
+    recursiveBisection(graph, vertices, graph->n, numParts, parts);
+    free(vertices);
+}
+
+/**
+ * Reports the weight of the cut edges and the heaviest part relative to a perfectly balanced one
+ **/
+void evaluatePartition(const struct PartitionGraph *graph, int numParts, const int *parts, int64_t *cut, double *imbalance)
+{
+    int64_t *partWeight = (int64_t *)calloc(numParts, sizeof(int64_t));
+    *cut = 0;
+    for (int v = 0; v < graph->n; v++)
+    {
+        partWeight[parts[v]] += graph->vertexWeight[v];
+        for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; e++)
+        {
+            if (graph->adjacent[e] > v && parts[graph->adjacent[e]] != parts[v])
+                *cut += graph->edgeWeight[e];
+        }
+    }
+    int64_t heaviest = 0;
+    for (int p = 0; p < numParts; p++)
+    {
+        if (partWeight[p] > heaviest)
+            heaviest = partWeight[p];
+    }
+    *imbalance = (double)heaviest * numParts / graph->totalWeight;
+    free(partWeight);
+}
+
+/**
+ * Small deterministic generator, so that partitions do not depend on the C library's rand
+ **/
+static int nextRandom(int bound)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return (int)(randomState % (uint32_t)bound);
+}
+
+/**
+ * Counts the trips of random vehicles through each junction and road, assuming they follow the fastest route at
+ * maximum speed. For each sampled source a shortest path tree is built and every junction is a destination once,
+ * so the trips using a tree road are the junctions below it in the tree
+ **/
+static void estimateTraffic(const struct RoadTopology *topology, int samples, int64_t *visits, int64_t *crossings)
+{
+    int n = topology->num_junctions;
+    int64_t *dist = (int64_t *)malloc(sizeof(int64_t) * n);
+    int *prevRoad = (int *)malloc(sizeof(int) * n);
+    int *order = (int *)malloc(sizeof(int) * n);
+    int64_t *below = (int64_t *)malloc(sizeof(int64_t) * n);
+    for (int i = 0; i < n; i++)
+    {
+        dist[i] = ROUTE_INFINITY;
+    }
+    struct IndexedHeap heap;
+    heapInit(&heap, n, dist);
+
+    for (int s = 0; s < samples && n > 0; s++)
+    {
+        int source = nextRandom(n), numSettled = 0;
+        for (int i = 0; i < n; i++)
+        {
+            dist[i] = ROUTE_INFINITY;
+            prevRoad[i] = -1;
+        }
+        dist[source] = 0;
+        heapPush(&heap, source);
+        while (heap.size > 0)
+        {
+            int v = heapPop(&heap);
+            order[numSettled++] = v;
+            for (int road = topology->roadOffsets[v]; road < topology->roadOffsets[v + 1]; road++)
+            {
+                int to = topology->roadTo[road];
+                int64_t alt = dist[v] + getTravelCost(topology->roadLength[road], topology->roadMaxSpeed[road]);
+                if (alt < dist[to])
+                {
+                    dist[to] = alt;
+                    prevRoad[to] = road;
+                    heapPush(&heap, to);
+                }
+            }
+        }
+
+        // 按完成顺序的逆序把每个路口下面的行程数累加到树中的父路口
+        for (int i = 0; i < numSettled; i++)
+        {
+            below[order[i]] = 1;
+        }
+        for (int i = numSettled - 1; i >= 0; i--)
+        {
+            int v = order[i];
+            visits[v] += below[v];
+            if (prevRoad[v] != -1)
+            {
+                crossings[prevRoad[v]] += below[v];
+                below[topology->roadFrom[prevRoad[v]]] += below[v];
+            }
+        }
+    }
+    heapFree(&heap);
+    free(dist);
+    free(prevRoad);
+    free(order);
+    free(below);
+}
+
+static int compareEdges(const void *a, const void *b)
+{
+    const int64_t *x = (const int64_t *)a, *y = (const int64_t *)b;
+    if (x[0] != y[0])
+        return x[0] < y[0] ? -1 : 1;
+    return x[1] < y[1] ? -1 : (x[1] > y[1]);
+}
+
+/**
+ * Builds the next coarser graph by heavy edge matching, visiting the vertices in random order and matching each with
+ * the unmatched neighbour it shares the heaviest edge with. Vertices heavier than a fraction of the total weight are
+ * not matched further so that the coarsest graph can still be balanced
+ **/
+static void coarsenGraph(const struct PartitionGraph *fine, struct PartitionGraph *coarse, int *coarseMap)
+{
+    int n = fine->n;
+    int *match = (int *)malloc(sizeof(int) * n);
+    int *visit = (int *)malloc(sizeof(int) * n);
+    for (int i = 0; i < n; i++)
+    {
+        match[i] = -1;
+        visit[i] = i;
+    }
+    for (int i = n - 1; i > 0; i--)
+    {
+        int j = nextRandom(i + 1), t = visit[i];
+        visit[i] = visit[j];
+        visit[j] = t;
+    }
+
+    int64_t maxWeight = fine->totalWeight / PARTITION_COARSEST + 1;
+    int cn = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int v = visit[i];
+        if (match[v] != -1)
+            continue;
+        int best = v;
+        int64_t bestWeight = -1;
+        for (int e = fine->offsets[v]; e < fine->offsets[v + 1]; e++)
+        {
+            int u = fine->adjacent[e];
+            if (match[u] == -1 && u != v && fine->edgeWeight[e] > bestWeight && fine->vertexWeight[u] + fine->vertexWeight[v] <= maxWeight)
+            {
+                best = u;
+                bestWeight = fine->edgeWeight[e];
+            }
+        }
+        match[v] = best;
+        match[best] = v;
+        coarseMap[v] = coarseMap[best] = cn++;
+    }
+
+    // 合并每对匹配的路口的邻居，marker记录粗图中邻居在当前邻接表中的位置
+    coarse->n = cn;
+    coarse->offsets = (int *)malloc(sizeof(int) * (cn + 1));
+    coarse->adjacent = (int *)malloc(sizeof(int) * fine->offsets[n]);
+    coarse->edgeWeight = (int64_t *)malloc(sizeof(int64_t) * fine->offsets[n]);
+    coarse->vertexWeight = (int64_t *)calloc(cn, sizeof(int64_t));
+    coarse->totalWeight = fine->totalWeight;
+    int *marker = (int *)malloc(sizeof(int) * cn);
+    for (int c = 0; c < cn; c++)
+    {
+        marker[c] = -1;
+    }
+    int numAdjacent = 0, c = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int v = visit[i];
+        if (coarseMap[v] != c)
+            continue;
+        coarse->offsets[c] = numAdjacent;
+        int pair[2] = {v, match[v]};
+        for (int k = 0; k < (pair[1] == v ? 1 : 2); k++)
+        {
+            int w = pair[k];
+            coarse->vertexWeight[c] += fine->vertexWeight[w];
+            for (int e = fine->offsets[w]; e < fine->offsets[w + 1]; e++)
+            {
+                int cu = coarseMap[fine->adjacent[e]];
+                if (cu == c)
+                    continue;
+                if (marker[cu] < coarse->offsets[c])
+                {
+                    marker[cu] = numAdjacent;
+                    coarse->adjacent[numAdjacent] = cu;
+                    coarse->edgeWeight[numAdjacent++] = fine->edgeWeight[e];
+                }
+                else
+                {
+                    coarse->edgeWeight[marker[cu]] += fine->edgeWeight[e];
+                }
+            }
+        }
+        c++;
+    }
+    coarse->offsets[cn] = numAdjacent;
+    free(marker);
+    free(match);
+    free(visit);
+}
+
+/**
+ * Multilevel bisection: the graph is coarsened until it is small, bisected there, and the bisection is projected back
+ * through every level and refined at each one. Side 0 gets a vertex weight close to target0
+ **/
+static void bisectGraph(const struct PartitionGraph *graph, int64_t target0, char *side)
+{
+    struct CoarseLevel levels[64];
+    int numLevels = 0;
+    const struct PartitionGraph *current = graph;
+    while (current->n > PARTITION_COARSEST && numLevels < 64)
+    {
+        struct CoarseLevel *level = &levels[numLevels];
+        level->coarseMap = (int *)malloc(sizeof(int) * current->n);
+        coarsenGraph(current, &level->graph, level->coarseMap);
+        if (level->graph.n > current->n - current->n / PARTITION_MIN_SHRINK)
+        {
+            freePartitionGraph(&level->graph);
+            free(level->coarseMap);
+            break;
+        }
+        current = &level->graph;
+        numLevels++;
+    }
+
+    char *coarseSide = (char *)malloc(current->n);
+    initialBisection(current, target0, coarseSide);
+    for (int l = numLevels - 1; l >= 0; l--)
+    {
+        const struct PartitionGraph *finer = l > 0 ? &levels[l - 1].graph : graph;
+        char *finerSide = (char *)malloc(finer->n);
+        for (int v = 0; v < finer->n; v++)
+        {
+            finerSide[v] = coarseSide[levels[l].coarseMap[v]];
+        }
+        free(coarseSide);
+        coarseSide = finerSide;
+        refineBisection(finer, target0, coarseSide);
+        freePartitionGraph(&levels[l].graph);
+        free(levels[l].coarseMap);
+    }
+    memcpy(side, coarseSide, graph->n);
+    free(coarseSide);
+}
+
+/**
+ * Bisects the coarsest graph by growing side 0 breadth first from random seeds until it reaches its target weight,
+ * refining each attempt and keeping the one with the smallest cut
+ **/
+static void initialBisection(const struct PartitionGraph *graph, int64_t target0, char *side)
+{
+    int n = graph->n;
+    char *trial = (char *)malloc(n);
+    int *queue = (int *)malloc(sizeof(int) * n);
+    int64_t bestCut = -1;
+    for (int t = 0; t < PARTITION_INITIAL_TRIES; t++)
+    {
+        memset(trial, 1, n);
+        int64_t weight = 0;
+        int head = 0, tail = 0;
+        while (weight < target0)
+        {
+            // 队列为空（图不连通）时从一个随机的未分配的顶点继续
+            if (head == tail)
+            {
+                int seed = nextRandom(n);
+                while (trial[seed] == 0)
+                    seed = (seed + 1) % n;
+                trial[seed] = 0;
+                weight += graph->vertexWeight[seed];
+                queue[tail++] = seed;
+                continue;
+            }
+            int v = queue[head++];
+            for (int e = graph->offsets[v]; e < graph->offsets[v + 1] && weight < target0; e++)
+            {
+                int u = graph->adjacent[e];
+                if (trial[u] == 1)
+                {
+                    trial[u] = 0;
+                    weight += graph->vertexWeight[u];
+                    queue[tail++] = u;
+                }
+            }
+        }
+        int64_t cut = refineBisection(graph, target0, trial);
+        if (bestCut == -1 || cut < bestCut)
+        {
+            bestCut = cut;
+            memcpy(side, trial, n);
+        }
+    }
+    free(trial);
+    free(queue);
+}
+
+/**
+ * Fiduccia-Mattheyses refinement. Each pass repeatedly moves the unlocked vertex with the highest gain (reduction of
+ * the cut) whose move keeps the destination side within its allowed weight, locks it and updates the gains of its
+ * neighbours, then rolls back to the best balanced state seen. Only vertices on the boundary are candidates. Returns
+ * the cut of the refined bisection
+ **/
+static int64_t refineBisection(const struct PartitionGraph *graph, int64_t target0, char *side)
+{
+    int n = graph->n;
+    int64_t target[2] = {target0, graph->totalWeight - target0};
+    int64_t maxVertex = 0;
+    for (int v = 0; v < n; v++)
+    {
+        if (graph->vertexWeight[v] > maxVertex)
+            maxVertex = graph->vertexWeight[v];
+    }
+    int64_t limit[2];
+    for (int s = 0; s < 2; s++)
+    {
+        limit[s] = target[s] + target[s] * PARTITION_IMBALANCE_PERCENT / 100 + maxVertex;
+    }
+
+    // 堆按 -gain 排序，两边各一个堆，共用同一个键数组
+    int64_t *key = (int64_t *)malloc(sizeof(int64_t) * n);
+    char *locked = (char *)malloc(n);
+    int *moves = (int *)malloc(sizeof(int) * n);
+    struct IndexedHeap heaps[2];
+    heapInit(&heaps[0], n, key);
+    heapInit(&heaps[1], n, key);
+
+    int64_t cut = computeCut(graph, side);
+    for (int pass = 0; pass < PARTITION_REFINE_PASSES; pass++)
+    {
+        int64_t weight[2] = {0, 0};
+        for (int v = 0; v < n; v++)
+        {
+            weight[(int)side[v]] += graph->vertexWeight[v];
+            locked[v] = 0;
+            int64_t external = 0, internal = 0, boundary = 0;
+            for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; e++)
+            {
+                if (side[graph->adjacent[e]] != side[v])
+                {
+                    external += graph->edgeWeight[e];
+                    boundary = 1;
+                }
+                else
+                {
+                    internal += graph->edgeWeight[e];
+                }
+            }
+            key[v] = internal - external;
+            if (boundary)
+                heapPush(&heaps[(int)side[v]], v);
+        }
+
+        // 最好的状态先看是否平衡，再看切割的大小
+        int64_t startCut = cut, bestCut = cut;
+        int64_t bestExcess = 0;
+        for (int s = 0; s < 2; s++)
+        {
+            if (weight[s] > limit[s])
+                bestExcess += weight[s] - limit[s];
+        }
+        int numMoves = 0, bestMoves = 0;
+        while (numMoves - bestMoves < PARTITION_REFINE_PATIENCE)
+        {
+            // 选择收益更高且移动后目标一侧不超重的顶点，超重的一侧优先移出
+            int from = -1;
+            for (int s = 0; s < 2; s++)
+            {
+                if (heaps[s].size == 0)
+                    continue;
+                int v = heaps[s].ids[0];
+                if (weight[1 - s] + graph->vertexWeight[v] > limit[1 - s] && weight[s] <= limit[s])
+                    continue;
+                if (from == -1 || weight[s] > limit[s] || (weight[from] <= limit[from] && key[v] < key[heaps[from].ids[0]]))
+                    from = s;
+            }
+            if (from == -1)
+                break;
+
+            int v = heapPop(&heaps[from]);
+            cut += key[v];
+            side[v] = 1 - from;
+            weight[from] -= graph->vertexWeight[v];
+            weight[1 - from] += graph->vertexWeight[v];
+            locked[v] = 1;
+            moves[numMoves++] = v;
+            for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; e++)
+            {
+                int u = graph->adjacent[e];
+                if (locked[u])
+                    continue;
+                // v移到了另一侧：与v同侧的邻居收益增加，另一侧的邻居收益减少
+                key[u] += side[u] == from ? -2 * graph->edgeWeight[e] : 2 * graph->edgeWeight[e];
+                heapPush(&heaps[(int)side[u]], u);
+            }
+
+            int64_t excess = 0;
+            for (int s = 0; s < 2; s++)
+            {
+                if (weight[s] > limit[s])
+                    excess += weight[s] - limit[s];
+            }
+            if (excess < bestExcess || (excess == bestExcess && cut < bestCut))
+            {
+                bestExcess = excess;
+                bestCut = cut;
+                bestMoves = numMoves;
+            }
+        }
+
+        // 撤销最好状态之后的移动
+        for (int i = numMoves - 1; i >= bestMoves; i--)
+        {
+            side[moves[i]] = 1 - side[moves[i]];
+        }
+        cut = bestCut;
+        heapClear(&heaps[0]);
+        heapClear(&heaps[1]);
+        if (bestMoves == 0 || cut >= startCut)
+            break;
+    }
+    heapFree(&heaps[0]);
+    heapFree(&heaps[1]);
+    free(key);
+    free(locked);
+    free(moves);
+    return cut;
+}
+
+static int64_t computeCut(const struct PartitionGraph *graph, const char *side)
+{
+    int64_t cut = 0;
+    for (int v = 0; v < graph->n; v++)
+    {
+        for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; e++)
+        {
+            if (graph->adjacent[e] > v && side[graph->adjacent[e]] != side[v])
+                cut += graph->edgeWeight[e];
+        }
+    }
+    return cut;
+}
+
+/**
+ * Extracts the subgraph of the listed vertices, index maps the vertices of the graph to the subgraph (-1 if absent)
+ **/
+static void inducedSubgraph(const struct PartitionGraph *graph, const int *vertices, int n, int *index, struct PartitionGraph *sub)
+{
+    for (int i = 0; i < n; i++)
+    {
+        index[vertices[i]] = i;
+    }
+    int numAdjacent = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int v = vertices[i];
+        for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; e++)
+        {
+            if (index[graph->adjacent[e]] != -1)
+                numAdjacent++;
+        }
+    }
+    sub->n = n;
+    sub->offsets = (int *)malloc(sizeof(int) * (n + 1));
+    sub->adjacent = (int *)malloc(sizeof(int) * (numAdjacent > 0 ? numAdjacent : 1));
+    sub->edgeWeight = (int64_t *)malloc(sizeof(int64_t) * (numAdjacent > 0 ? numAdjacent : 1));
+    sub->vertexWeight = (int64_t *)malloc(sizeof(int64_t) * (n > 0 ? n : 1));
+    sub->totalWeight = 0;
+    numAdjacent = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int v = vertices[i];
+        sub->offsets[i] = numAdjacent;
+        sub->vertexWeight[i] = graph->vertexWeight[v];
+        sub->totalWeight += graph->vertexWeight[v];
+        for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; e++)
+        {
+            int u = index[graph->adjacent[e]];
+            if (u != -1)
+            {
+                sub->adjacent[numAdjacent] = u;
+                sub->edgeWeight[numAdjacent++] = graph->edgeWeight[e];
+            }
+        }
+    }
+    sub->offsets[n] = numAdjacent;
+    for (int i = 0; i < n; i++)
+    {
+        index[vertices[i]] = -1;
+    }
+}
+
+/**
+ * Splits the listed vertices into numParts parts numbered from firstPart, bisecting them in proportion to the number
+ * of parts on each side and recursing into both sides
+ **/
+static void recursiveBisectionParts(const struct PartitionGraph *graph, int *vertices, int n, int numParts, int firstPart, int *index, int *parts)
+{
+    if (numParts == 1 || n == 0)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            parts[vertices[i]] = firstPart;
+        }
+        return;
+    }
+
+    struct PartitionGraph sub;
+    inducedSubgraph(graph, vertices, n, index, &sub);
+    int leftParts = numParts / 2;
+    char *side = (char *)malloc(n);
+    bisectGraph(&sub, sub.totalWeight * leftParts / numParts, side);
+    freePartitionGraph(&sub);
+
+    // 左边的顶点移到数组前面
+    int numLeft = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (side[i] == 0)
+        {
+            int t = vertices[numLeft];
+            vertices[numLeft] = vertices[i];
+            vertices[i] = t;
+            char s = side[numLeft];
+            side[numLeft] = side[i];
+            side[i] = s;
+            numLeft++;
+        }
+    }
+    free(side);
+    recursiveBisectionParts(graph, vertices, numLeft, leftParts, firstPart, index, parts);
+    recursiveBisectionParts(graph, vertices + numLeft, n - numLeft, numParts - leftParts, firstPart + leftParts, index, parts);
+}
+
+static void recursiveBisection(const struct PartitionGraph *graph, int *vertices, int n, int numParts, int *parts)
+{
+    int *index = (int *)malloc(sizeof(int) * graph->n);
+    for (int i = 0; i < graph->n; i++)
+    {
+        index[i] = -1;
+    }
+    recursiveBisectionParts(graph, vertices, n, numParts, 0, index, parts);
+    free(index);
+}
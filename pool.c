@@ -2,15 +2,44 @@
 #include <stdio.h>
 #include "mpi.h"
 #include "pool.h"
+#include "steal.h"
 
 // MPI P2P tag to use for command communications, it is important not to reuse this
 #define PP_CONTROL_TAG 16384
 #define PP_PID_TAG 16383
+#define PP_PAYLOAD_TAG 16382
+#define PP_MANAGER_TAG 16381
+#define PP_PRESSURE_TAG 16380
 
-// Pool options
-#define PP_QuitOnNoProcs 1
+// Pool options, with neither of the first two set start requests wait in a bounded backlog until workers go to sleep,
+// and requesters are told to throttle while the backlog is deeper than the pressure threshold
+#define PP_QuitOnNoProcs 0
 #define PP_IgnoreOnNoProcs 0
+#define PP_BacklogCapacity 4096
+#define PP_BacklogPressure 256
 #define PP_DEBUG 0
+// Elastic mode, when the master's idle stack is empty it spawns extra workers with MPI_Comm_spawn, at least
+// PP_SpawnBatch at a time and at most PP_MaxSpawnedWorkers alive at once. The processes of one spawn share an
+// MPI_COMM_WORLD and can only exit together, so a spawn group is retired once all of its workers have been idle for
+// PP_SpawnCooldown seconds. The application must set the spawn command before initialising the pool. These options
+// can be overridden at compile time, which the pool spawn test does to run with a short cooldown
+#ifndef PP_ElasticSpawn
+#define PP_ElasticSpawn 0
+#endif
+#ifndef PP_SpawnBatch
+#define PP_SpawnBatch 4
+#endif
+#ifndef PP_MaxSpawnedWorkers
+#define PP_MaxSpawnedWorkers 64
+#endif
+#ifndef PP_SpawnCooldown
+#define PP_SpawnCooldown 10.0
+#endif
+// Number of ranks in each block of the pool. Rank 0 manages the workers of the first block and every later block is
+// managed by a sub-master on its first rank, zero means that rank 0 manages every worker itself. An application that
+// relies on its first workers landing on ranks 1, 2, ... (see processPoolSetFixedRanks, the simulation's control, map
+// and vehicle host actors) needs a block of at least that many ranks, otherwise processPoolInit fails
+#define PP_SubMasterBlock 0
 
 // Example command package data type which can be extended
 static MPI_Datatype PP_COMMAND_TYPE;
@@ -18,14 +47,111 @@ static MPI_Datatype PP_COMMAND_TYPE;
 // Internal pool global state
 static int PP_myRank;
 static int PP_numProcs;
+// Block layout of the pool, a worker's master is the manager of its block, which is rank 0 or a sub-master. Workers
+// talk to their master over PP_comm, which for spawned workers is the communicator merged with the master. A spawned
+// worker keeps its parent intercommunicator so that it can disconnect from the master when it is stopped
+static int PP_blockSize, PP_numBlocks;
+static int PP_myMaster;
+static MPI_Comm PP_comm = MPI_COMM_NULL;
+static MPI_Comm PP_parentComm = MPI_COMM_NULL;
+static int PP_spawned = 0;
+// Workers of the block the calling master or sub-master manages, PP_active is indexed from PP_firstWorker
+static int PP_firstWorker, PP_numWorkers;
 static char *PP_active = NULL;
-static int PP_processesAwaitingStart;
+// Intrusive free list of idle workers, PP_nextIdle[i] is the worker below i on the stack or -1 at the bottom
+static int *PP_nextIdle = NULL;
+static int PP_idleHead = -1;
+static struct PP_Statistics PP_statistics;
+// Ring buffer of the workers waiting to be started in FIFO order, and the start requests they belong to, a request is
+// answered once its last worker has been started
+struct PP_BacklogEntry {
+	int request;
+	int index;
+	int payload;
+	double queuedAt;
+};
+struct PP_PendingStart {
+	int source;
+	int n;
+	int remaining;
+	int *ranks;
+	double requested;
+};
+static struct PP_BacklogEntry *PP_backlog = NULL;
+static int PP_backlogHead = 0, PP_backlogCount = 0;
+static struct PP_PendingStart *PP_pending = NULL;
+static int *PP_nextPending = NULL;
+static int PP_freePending = -1;
+// Requesters that have been told to throttle, and whether this worker has been told to throttle
+static char *PP_pressured = NULL;
+static int *PP_pressuredRanks = NULL;
+static int PP_numPressured = 0;
+static int PP_underPressure = 0;
+// Spawned workers of the elastic master. Worker i of the master is spawned worker i - PP_numWorkers, and it is known to
+// requesters by the id PP_numProcs + i - PP_numWorkers. Each spawn creates a group sharing one merged communicator, in
+// which the master is rank 0, and the master keeps a receive posted for the commands of each group. The spawn
+// intercommunicator is kept alongside so that both can be disconnected when the group is retired
+struct PP_SpawnGroup {
+	MPI_Comm comm;
+	MPI_Comm intercomm;
+	int size;
+	int live;
+	int *slots;
+	MPI_Request recv;
+	struct PP_Control_Package command;
+};
+struct PP_SpawnedWorker {
+	int live;
+	int group;
+	int rank;
+	double idleSince;
+};
+static enum PP_Scheduler PP_scheduler = PP_MASTER_SCHEDULER;
+static int PP_fixedRanks = 1;
+static char *PP_spawnCommand = NULL;
+static char **PP_spawnArgv = NULL;
+static struct PP_SpawnGroup PP_groups[PP_MaxSpawnedWorkers];
+static struct PP_SpawnedWorker PP_spawnedWorkers[PP_MaxSpawnedWorkers];
+static int PP_numGroups = 0;
+static MPI_Request PP_worldRecv = MPI_REQUEST_NULL;
+static double PP_lastRetireCheck = 0;
+// Master scratch space for the payloads and ranks of batched start requests
+static int *PP_batchPayloads = NULL, *PP_batchRanks = NULL;
+static int PP_batchCapacity = 0;
 static struct PP_Control_Package in_command;
 static MPI_Request PP_pollRecvCommandRequest = MPI_REQUEST_NULL;
+// Commands sent between the masters, a sub-master serves these even while it waits for another master
+static struct PP_Control_Package manager_command;
+static MPI_Request PP_managerRecvRequest = MPI_REQUEST_NULL;
+static int PP_stopRequested = 0;
 
 // Internal pool functions
 static void errorMessage(char *);
-static int startAwaitingProcessesIfNeeded(int, int);
+static void initialiseManager();
+static int subMasterLoop();
+static int handleWorkerCommand(int);
+static void handleManagerCommand(int);
+static void waitServingManagers(MPI_Request *);
+static void broadcastStop();
+static int isManagerRank(int);
+static int workerPeer(int);
+static int peerWorker(int);
+static MPI_Comm peerAddress(int, int *);
+static int startBatchGrowing(int, const int *, int *, double);
+static int spawnWorkers(int);
+static void retireIdleSpawnedWorkers();
+static void freeSpawnGroup(int);
+static int popIdleWorker();
+static void pushIdleWorker(int);
+static void wakeWorker(int, int);
+static int submitStart(int, int, const int *, int *, double);
+static void queueStart(int, int, const int *, const int *, double);
+static void serveBacklog();
+static void signalPressure(int, int);
+static int startBatch(int, const int *, int *, double);
+static int borrowWorkers(int, const int *, int *);
+static void requestWorkers(int, enum PP_Control_Command, int, const int *, int *);
+static void recordStart(double);
 static int handleRecievedCommand();
 static void initialiseType();
 static struct PP_Control_Package createCommandPackage(enum PP_Control_Command);
@@ -33,54 +159,156 @@ static struct PP_Control_Package createCommandPackage(enum PP_Control_Command);
 /**
  * Initialises the processes pool. Note that a worker will not return from this until it has been instructed to do some work
  * or quit. The return code zero indicates quit, one indicates loop and work for the worker and two indicates that this is the
- * master and it should loop and call master pool.
+ * master and it should loop and call master pool. A sub-master serves its block inside this call and returns zero once the
+ * pool has been stopped
  */
 int processPoolInit()
 {
-	initialiseType();
 	MPI_Comm_rank(MPI_COMM_WORLD, &PP_myRank);
 	MPI_Comm_size(MPI_COMM_WORLD, &PP_numProcs);
+	MPI_Comm_get_parent(&PP_parentComm);
+	if (PP_parentComm == MPI_COMM_NULL && PP_myRank == 0 && PP_numProcs < PP_fixedRanks)
+	{
+		// 固定的rank不存在时启动请求会排队，之后向这些rank发送的消息会失败，所以在这里就停止
+		char message[128];
+		snprintf(message, sizeof(message), "The application uses ranks 1 to %d for fixed workers, run with at least %d MPI processes",
+				 PP_fixedRanks - 1, PP_fixedRanks);
+		errorMessage(message);
+	}
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+		return stealingInit();
+	initialiseType();
+	PP_comm = MPI_COMM_WORLD;
+
+	// 由主进程动态启动的工作进程与主进程合并通信器，之后只通过它与主进程通信
+	if (PP_parentComm != MPI_COMM_NULL)
+	{
+		PP_spawned = 1;
+		MPI_Intercomm_merge(PP_parentComm, 1, &PP_comm);
+		MPI_Comm_rank(PP_comm, &PP_myRank);
+		PP_myMaster = 0;
+		MPI_Recv(&in_command, 1, PP_COMMAND_TYPE, PP_myMaster, PP_CONTROL_TAG, PP_comm, MPI_STATUS_IGNORE);
+		return handleRecievedCommand();
+	}
+
+	PP_blockSize = PP_SubMasterBlock > 1 && PP_SubMasterBlock < PP_numProcs ? PP_SubMasterBlock : PP_numProcs;
+	PP_numBlocks = (PP_numProcs + PP_blockSize - 1) / PP_blockSize;
+	PP_myMaster = PP_myRank - PP_myRank % PP_blockSize;
 	if (PP_myRank == 0)
 	{
 		if (PP_numProcs < 2)
 		{
 			errorMessage("No worker processes available for pool, run with more than one MPI process");
 		}
-		PP_active = (char *)malloc(PP_numProcs);
-		int i;
-		for (i = 0; i < PP_numProcs - 1; i++)
-			PP_active[i] = 0;
-		PP_processesAwaitingStart = 0;
+		if (PP_blockSize < PP_fixedRanks && PP_blockSize < PP_numProcs)
+		{
+			// 子主进程会占用应用固定使用的rank，或者这些rank被分到其他块中，启动顺序不再对应
+			char message[256];
+			snprintf(message, sizeof(message), "PP_SubMasterBlock of %d makes rank %d a sub-master, but the application uses ranks 1 to %d "
+					 "for fixed workers, use a block of at least %d ranks", PP_blockSize, PP_blockSize, PP_fixedRanks - 1, PP_fixedRanks);
+			errorMessage(message);
+		}
+		initialiseManager();
 		if (PP_DEBUG)
 			printf("[Master] Initialised Master\n");
 		return 2;
 	}
+	else if (PP_myMaster == PP_myRank)
+	{
+		initialiseManager();
+		if (PP_DEBUG)
+			printf("[SubMaster] Process %d manages ranks %d to %d\n", PP_myRank, PP_firstWorker, PP_firstWorker + PP_numWorkers - 1);
+		return subMasterLoop();
+	}
 	else
 	{
-		// 工作进程进入阻塞状态等待主进程的命令
-		MPI_Recv(&in_command, 1, PP_COMMAND_TYPE, 0, PP_CONTROL_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		// 工作进程进入阻塞状态等待所在块的主进程的命令
+		MPI_Recv(&in_command, 1, PP_COMMAND_TYPE, PP_myMaster, PP_CONTROL_TAG, PP_comm, MPI_STATUS_IGNORE);
 		return handleRecievedCommand();
 	}
 }
 
 /**
- * Each process calls this to finalise the process pool
+ * Sets the command and arguments the elastic master spawns extra workers with, usually the application's own
+ * executable and arguments. The arguments are terminated by a NULL pointer and exclude the command, as for
+ * MPI_Comm_spawn. Spawned workers run the application from the start, and their initialisation of the pool turns them
+ * into workers of the master rather than starting another pool
+ */
+void processPoolSetSpawnCommand(char *command, char *argv[])
+{
+	PP_spawnCommand = command;
+	PP_spawnArgv = argv;
+}
+
+/**
+ * Sets how many of the lowest ranks (including the master) the application addresses directly, i.e. it relies on the
+ * workers it starts first being ranks 1, 2, ... up to this. Called before initialising the pool, which then rejects a
+ * block layout that would make any of these ranks a sub-master or put them outside the master's own block, and a run
+ * with fewer processes than this
+ */
+void processPoolSetFixedRanks(int numRanks)
+{
+	PP_fixedRanks = numRanks;
+}
+
+/**
+ * Selects the scheduler behind the pool API, every process must select the same one before initialising the pool. The
+ * work stealing scheduler ignores the sub-master and elastic options
+ */
+void processPoolSetScheduler(enum PP_Scheduler scheduler)
+{
+	PP_scheduler = scheduler;
+}
+
+/**
+ * Each process calls this to finalise the process pool. The master sends the stop command down the tree of sub-masters
+ * and each master stops the workers of its own block
  */
 void processPoolFinalise()
 {
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+	{
+		stealingFinalise();
+		return;
+	}
+	if (PP_spawned)
+	{
+		// 与主进程断开连接后MPI_Finalize不再等待父作业，同组的进程总是被一起停止。合并的通信器上没有未完成的通信，
+		// 直接释放即可，Open MPI 4.1在跨作业的合并通信器上调用MPI_Comm_disconnect会挂起
+		MPI_Comm_free(&PP_comm);
+		MPI_Comm_disconnect(&PP_parentComm);
+		MPI_Type_free(&PP_COMMAND_TYPE);
+		return;
+	}
 	if (PP_myRank == 0)
 	{
-		if (PP_active != NULL)
-			free(PP_active);
-		int i;
-		for (i = 0; i < PP_numProcs - 1; i++)
+		broadcastStop();
+		if (PP_worldRecv != MPI_REQUEST_NULL)
 		{
-			if (PP_DEBUG)
-				printf("[Master] Shutting down process %d\n", i);
-			struct PP_Control_Package out_command = createCommandPackage(PP_STOP);
-			MPI_Send(&out_command, 1, PP_COMMAND_TYPE, i + 1, PP_CONTROL_TAG, MPI_COMM_WORLD);
+			MPI_Cancel(&PP_worldRecv);
+			MPI_Wait(&PP_worldRecv, MPI_STATUS_IGNORE);
+		}
+		int g;
+		for (g = 0; g < PP_MaxSpawnedWorkers; g++)
+		{
+			if (PP_groups[g].comm != MPI_COMM_NULL && PP_groups[g].size > 0)
+				freeSpawnGroup(g);
 		}
 	}
+	if (PP_myMaster == PP_myRank)
+	{
+		if (PP_active != NULL)
+			free(PP_active);
+		if (PP_nextIdle != NULL)
+			free(PP_nextIdle);
+		free(PP_batchPayloads);
+		free(PP_batchRanks);
+		free(PP_backlog);
+		free(PP_pending);
+		free(PP_nextPending);
+		free(PP_pressured);
+		free(PP_pressuredRanks);
+	}
 	MPI_Barrier(MPI_COMM_WORLD);
 	MPI_Type_free(&PP_COMMAND_TYPE);
 }
@@ -91,46 +319,42 @@ void processPoolFinalise()
  */
 int masterPoll()
 {
-	// 轮询控制中心，接收来自工作进程的命令，并执行相应的动作，仅被主进程调用
+	// 轮询控制中心，接收来自工作进程和子主进程的命令，并执行相应的动作，仅被主进程调用
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+		return stealingMasterPoll();
 	if (PP_myRank == 0)
 	{
 		MPI_Status status;
-		MPI_Recv(&in_command, 1, PP_COMMAND_TYPE, MPI_ANY_SOURCE, PP_CONTROL_TAG, MPI_COMM_WORLD, &status);
-
-		// 收到工作进程的睡眠指令，则将发送命令的工作进程标记为非活跃状态
-		if (in_command.command == PP_SLEEPING)
-		{
-			if (PP_DEBUG)
-				printf("[Master] Received sleep command from %d\n", status.MPI_SOURCE);
-			PP_active[status.MPI_SOURCE - 1] = 0;
-		}
-
-		// 收到任务完成，说明工作进程完成其任务并且希望停止整个程序，主进程返回0表示整个程序可以停止轮询，终止进程池
-		if (in_command.command == PP_RUNCOMPLETE)
+		if (PP_numGroups == 0 && PP_worldRecv == MPI_REQUEST_NULL)
 		{
-			if (PP_DEBUG)
-				printf("[Master] Received shutdown command\n");
-			return 0;
+			MPI_Recv(&in_command, 1, PP_COMMAND_TYPE, MPI_ANY_SOURCE, PP_CONTROL_TAG, MPI_COMM_WORLD, &status);
+			return handleWorkerCommand(status.MPI_SOURCE);
 		}
 
-		// 增加等待开始的进程的计数，表示有额外的工作进程请求激活
-		if (in_command.command == PP_STARTPROCESS)
+		// 有动态启动的工作进程时，同时等待MPI_COMM_WORLD和每个启动组的通信器上的命令
+		MPI_Request requests[PP_MaxSpawnedWorkers + 1];
+		if (PP_worldRecv == MPI_REQUEST_NULL)
+			MPI_Irecv(&in_command, 1, PP_COMMAND_TYPE, MPI_ANY_SOURCE, PP_CONTROL_TAG, MPI_COMM_WORLD, &PP_worldRecv);
+		requests[0] = PP_worldRecv;
+		int g, index, source;
+		for (g = 0; g < PP_MaxSpawnedWorkers; g++)
+			requests[g + 1] = PP_groups[g].recv;
+		MPI_Waitany(PP_MaxSpawnedWorkers + 1, requests, &index, &status);
+		if (index == 0)
 		{
-			PP_processesAwaitingStart++;
+			PP_worldRecv = MPI_REQUEST_NULL;
+			source = status.MPI_SOURCE;
 		}
-		
-		// 不管接收到什么指令，都会试图启动正在等待启动的工作进程
-		// 传入正在等待的数量和发出这次指令的进程
-		// returnRank的值可能是这次成功启动的mpi的进程排名，或是-1（特殊情况，例如启动失败或不是最后一个）
-		int returnRank = startAwaitingProcessesIfNeeded(PP_processesAwaitingStart, status.MPI_SOURCE);
-
-		if (in_command.command == PP_STARTPROCESS)
+		else
 		{
-			// 通常会返回给发起这个指令的进程新启动的进程的rank
-			// If the master was to start a worker then send back the process rank that this worker is now on
-			MPI_Send(&returnRank, 1, MPI_INT, status.MPI_SOURCE, PP_PID_TAG, MPI_COMM_WORLD);
+			struct PP_SpawnGroup *group = &PP_groups[index - 1];
+			in_command = group->command;
+			source = PP_numProcs + group->slots[status.MPI_SOURCE - 1];
+			MPI_Irecv(&group->command, 1, PP_COMMAND_TYPE, MPI_ANY_SOURCE, PP_CONTROL_TAG, group->comm, &group->recv);
 		}
-		return 1;
+		int result = handleWorkerCommand(source);
+		retireIdleSpawnedWorkers();
+		return result;
 	}
 	else
 	{
@@ -144,39 +368,148 @@ int masterPoll()
  */
 int startWorkerProcess()
 {
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+	{
+		int parent, workerRank;
+		MPI_Comm_rank(MPI_COMM_WORLD, &parent);
+		stealingStartWorkers(1, &workerRank, &parent);
+		return workerRank;
+	}
 	if (PP_myRank == 0)
 	{
-		PP_processesAwaitingStart++;
-		return startAwaitingProcessesIfNeeded(PP_processesAwaitingStart, 0);
+		// The master cannot wait for itself, a worker that has to wait in the backlog gets the rank -1
+		int parent = 0, workerRank;
+		submitStart(0, 1, &parent, &workerRank, MPI_Wtime());
+		return workerRank;
 	}
 	else
 	{
-		// 如果不是被master调用，则向主进程发送开启进程的指令，由主进程启用新的进程
+		// 如果不是被master调用，则向所在块的主进程发送开启进程的指令，由它启用新的进程
 		int workerRank;
 		struct PP_Control_Package out_command = createCommandPackage(PP_STARTPROCESS);
-		MPI_Send(&out_command, 1, PP_COMMAND_TYPE, 0, PP_CONTROL_TAG, MPI_COMM_WORLD);
+		MPI_Send(&out_command, 1, PP_COMMAND_TYPE, PP_myMaster, PP_CONTROL_TAG, PP_comm);
 
 		// 通常发送后，主进程会向发起这个指令的进程发回一个启用的进程的rank
 		// Receive the rank that this worker has been placed on - if you change the default option from aborting when
 		// there are not enough MPI processes then this may be -1
-		MPI_Recv(&workerRank, 1, MPI_INT, 0, PP_PID_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		MPI_Recv(&workerRank, 1, MPI_INT, PP_myMaster, PP_PID_TAG, PP_comm, MPI_STATUS_IGNORE);
 		return workerRank;
 	}
 }
 
+/**
+ * A worker or the master can start several worker processes at once. A worker sends one command followed by the
+ * payloads and receives all of the ranks in one reply, rather than making a round trip to the master per worker and then
+ * sending each worker its role separately. Each started worker retrieves its payload with getCommandData
+ */
+int startWorkerProcesses(int n, int *ranks_out, const int *payloads)
+{
+	if (n <= 0)
+		return 0;
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+		return stealingStartWorkers(n, ranks_out, payloads);
+	if (PP_myRank == 0)
+	{
+		return submitStart(0, n, payloads, ranks_out, MPI_Wtime());
+	}
+	else
+	{
+		requestWorkers(PP_myMaster, PP_STARTPROCESSES, n, payloads, ranks_out);
+		int started = 0, i;
+		for (i = 0; i < n; i++)
+		{
+			if (ranks_out[i] != -1)
+				started++;
+		}
+		return started;
+	}
+}
+
+/**
+ * Requests n workers like startWorkerProcesses but does not wait for them to start, the ranks are written to ranks_out
+ * by the time the request completes. Workers that have to wait in the master's backlog complete the request later, and
+ * a worker's requests complete in the order they were made. The master's own requests complete straight away
+ */
+void startWorkerProcessesAsync(int n, int *ranks_out, const int *payloads, struct PP_StartRequest *handle)
+{
+	handle->request = MPI_REQUEST_NULL;
+	if (n <= 0)
+		return;
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+	{
+		// 任务直接放入本进程的双端队列，请求立即完成
+		stealingStartWorkers(n, ranks_out, payloads);
+		return;
+	}
+	if (PP_myRank == 0)
+	{
+		submitStart(0, n, payloads, ranks_out, MPI_Wtime());
+		return;
+	}
+	struct PP_Control_Package out_command = createCommandPackage(PP_STARTPROCESSES);
+	out_command.data = n;
+	MPI_Send(&out_command, 1, PP_COMMAND_TYPE, PP_myMaster, PP_CONTROL_TAG, PP_comm);
+	MPI_Send(payloads, n, MPI_INT, PP_myMaster, PP_PAYLOAD_TAG, PP_comm);
+	MPI_Irecv(ranks_out, n, MPI_INT, PP_myMaster, PP_PID_TAG, PP_comm, &handle->request);
+}
+
+/**
+ * Returns one once every worker of an asynchronous start request has been started
+ */
+int testStartRequest(struct PP_StartRequest *handle)
+{
+	int flag;
+	MPI_Test(&handle->request, &flag, MPI_STATUS_IGNORE);
+	return flag;
+}
+
+/**
+ * Stops waiting for an asynchronous start request that has not completed, its workers may still be started later
+ */
+void cancelStartRequest(struct PP_StartRequest *handle)
+{
+	if (handle->request == MPI_REQUEST_NULL)
+		return;
+	MPI_Cancel(&handle->request);
+	MPI_Wait(&handle->request, MPI_STATUS_IGNORE);
+}
+
+/**
+ * Whether the worker's master has told it to throttle its start requests because the backlog is too deep. Picks up
+ * any signals the master has sent since the last call
+ */
+int isPoolBackpressured()
+{
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+		return stealingIsBackpressured();
+	int flag;
+	MPI_Iprobe(PP_myMaster, PP_PRESSURE_TAG, PP_comm, &flag, MPI_STATUS_IGNORE);
+	while (flag)
+	{
+		MPI_Recv(&PP_underPressure, 1, MPI_INT, PP_myMaster, PP_PRESSURE_TAG, PP_comm, MPI_STATUS_IGNORE);
+		MPI_Iprobe(PP_myMaster, PP_PRESSURE_TAG, PP_comm, &flag, MPI_STATUS_IGNORE);
+	}
+	return PP_underPressure;
+}
+
 /**
  * A worker can instruct the master to shutdown the process pool. The master can also call this
  * but it does nothing (they just need to call the finalisation step)
  */
 void shutdownPool()
 {
-	// 只能由工作进程调用，会向主线程发送一个请求结束程序和进程池的指令
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+	{
+		stealingShutdown();
+		return;
+	}
+	// 只能由工作进程调用，会向所在块的主进程发送一个请求结束程序和进程池的指令，子主进程会转发给主进程
 	if (PP_myRank != 0)
 	{
 		if (PP_DEBUG)
 			printf("[Worker] Commanding a pool shutdown\n");
 		struct PP_Control_Package out_command = createCommandPackage(PP_RUNCOMPLETE);
-		MPI_Send(&out_command, 1, PP_COMMAND_TYPE, 0, PP_CONTROL_TAG, MPI_COMM_WORLD);
+		MPI_Send(&out_command, 1, PP_COMMAND_TYPE, PP_myMaster, PP_CONTROL_TAG, PP_comm);
 	}
 }
 
@@ -187,16 +520,18 @@ void shutdownPool()
  */
 int workerSleep()
 {
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+		return stealingWorkerSleep();
 	// 只能被工作进程调用
 	if (PP_myRank != 0)
-	{	
+	{
 		// 该指令可能会在主进程执行唤醒工作进程时被发送给工作进程，目前没有别的函数会给子进程发送其他指令
 		if (in_command.command == PP_WAKE)
 		{
-			// 给主进程发送指令说明该工作进程要睡眠，主进程会把该工作进程的active改成0
+			// 给所在块的主进程发送指令说明该工作进程要睡眠，主进程会把该工作进程放回空闲栈
 			// The command was to wake up, it has done the work and now it needs to switch to sleeping mode
 			struct PP_Control_Package out_command = createCommandPackage(PP_SLEEPING);
-			MPI_Send(&out_command, 1, PP_COMMAND_TYPE, 0, PP_CONTROL_TAG, MPI_COMM_WORLD);
+			MPI_Send(&out_command, 1, PP_COMMAND_TYPE, PP_myMaster, PP_CONTROL_TAG, PP_comm);
 
 			// 如果有一个非阻塞操作被启动了但是未完成，则等待直到该操作完成
 			if (PP_pollRecvCommandRequest != MPI_REQUEST_NULL)
@@ -217,14 +552,55 @@ int workerSleep()
  */
 int getCommandData()
 {
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+		return stealingCommandData();
 	return in_command.data;
 }
 
+/**
+ * Copies the occupancy and start latency counters, these are only maintained by the masters. With sub-masters the
+ * master collects the counters of every block and sums them, so the high-water mark is the sum of the blocks' peaks
+ */
+void getPoolStatistics(struct PP_Statistics *statistics)
+{
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+	{
+		stealingStatistics(statistics);
+		return;
+	}
+	if (PP_myRank != 0)
+		errorMessage("Worker process requested pool statistics");
+	*statistics = PP_statistics;
+	int block;
+	for (block = 1; block < PP_numBlocks; block++)
+	{
+		struct PP_Statistics blockStatistics;
+		struct PP_Control_Package out_command = createCommandPackage(PP_REPORT);
+		MPI_Send(&out_command, 1, PP_COMMAND_TYPE, block * PP_blockSize, PP_MANAGER_TAG, MPI_COMM_WORLD);
+		MPI_Recv(&blockStatistics, sizeof(blockStatistics), MPI_BYTE, block * PP_blockSize, PP_PID_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		statistics->numWorkers += blockStatistics.numWorkers;
+		statistics->backlogDepth += blockStatistics.backlogDepth;
+		statistics->maxBacklogDepth += blockStatistics.maxBacklogDepth;
+		statistics->numQueued += blockStatistics.numQueued;
+		statistics->totalQueueWait += blockStatistics.totalQueueWait;
+		if (blockStatistics.maxQueueWait > statistics->maxQueueWait)
+			statistics->maxQueueWait = blockStatistics.maxQueueWait;
+		statistics->numActive += blockStatistics.numActive;
+		statistics->highWaterMark += blockStatistics.highWaterMark;
+		statistics->numStarts += blockStatistics.numStarts;
+		statistics->totalStartLatency += blockStatistics.totalStartLatency;
+		if (blockStatistics.maxStartLatency > statistics->maxStartLatency)
+			statistics->maxStartLatency = blockStatistics.maxStartLatency;
+	}
+}
+
 /**
  * Determines whether or not the worker should stop (i.e. the master has send the STOP command to all workers)
  */
 int shouldWorkerStop()
 {
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+		return stealingShouldWorkerStop();
 	// 先检查非阻塞操作是否全部完成
 	if (PP_pollRecvCommandRequest != MPI_REQUEST_NULL)
 	{
@@ -242,65 +618,751 @@ int shouldWorkerStop()
 }
 
 /**
- * Called by the master and will start awaiting processes (signal to them to start) if required.
- * By default this works as a process pool, so if there are not enough processes to workers then it will quit
- * but this can be changed by modifying options in the pool.
- * It takes in the awaiting worker number to send rank data to/from, the parent rank of the process to start
- * and returns the process rank that this awaiting worker was on. In the default case of #workers > pool capacity
- * causing an abort, then this will only be called to start single workers and as such the parent ID and return rank
- * will match perfectly. If you change the options to allow for workers to queue up if there is not enough MPI
- * capacity then the parent and return rank will be -1 for all workers started which do not match the provided awaiting Id
+ * Lets the pool serve a running worker that does not poll shouldWorkerStop, the master scheduler needs nothing from it
+ */
+void processPoolProgress()
+{
+	if (PP_scheduler == PP_STEALING_SCHEDULER)
+		stealingProgress();
+}
+
+/**
+ * Sets up the idle stack of the block managed by the master or a sub-master
  */
-static int startAwaitingProcessesIfNeeded(int awaitingId, int parent)
+static void initialiseManager()
 {
-	int awaitingProcessMPIRank = -1;
+	PP_firstWorker = PP_myRank + 1;
+	int end = PP_myRank + PP_blockSize < PP_numProcs ? PP_myRank + PP_blockSize : PP_numProcs;
+	PP_numWorkers = end - PP_firstWorker;
+	// The elastic master keeps its spawned workers after its own block's in the same arrays
+	PP_active = (char *)malloc(PP_numWorkers + PP_MaxSpawnedWorkers + 1);
+	PP_nextIdle = (int *)malloc(sizeof(int) * (PP_numWorkers + PP_MaxSpawnedWorkers + 1));
+	// The lowest ranks are on top of the stack so that initial workers are placed on consecutive ranks
+	int i;
+	for (i = 0; i < PP_numWorkers; i++)
+	{
+		PP_active[i] = 0;
+		PP_nextIdle[i] = i + 1 < PP_numWorkers ? i + 1 : -1;
+	}
+	PP_idleHead = PP_numWorkers > 0 ? 0 : -1;
+	PP_backlog = (struct PP_BacklogEntry *)malloc(sizeof(struct PP_BacklogEntry) * PP_BacklogCapacity);
+	PP_pending = (struct PP_PendingStart *)malloc(sizeof(struct PP_PendingStart) * PP_BacklogCapacity);
+	PP_nextPending = (int *)malloc(sizeof(int) * PP_BacklogCapacity);
+	for (i = 0; i < PP_BacklogCapacity; i++)
+		PP_nextPending[i] = i + 1 < PP_BacklogCapacity ? i + 1 : -1;
+	PP_freePending = 0;
+	PP_pressured = (char *)calloc(PP_numProcs + PP_MaxSpawnedWorkers, 1);
+	PP_pressuredRanks = (int *)malloc(sizeof(int) * (PP_numProcs + PP_MaxSpawnedWorkers));
+	PP_statistics.numWorkers = PP_numWorkers;
+	PP_statistics.numActive = 0;
+	PP_statistics.highWaterMark = 0;
+	PP_statistics.numStarts = 0;
+	PP_statistics.totalStartLatency = 0;
+	PP_statistics.maxStartLatency = 0;
+	PP_statistics.backlogDepth = 0;
+	PP_statistics.maxBacklogDepth = 0;
+	PP_statistics.numQueued = 0;
+	PP_statistics.totalQueueWait = 0;
+	PP_statistics.maxQueueWait = 0;
+	PP_statistics.numSpawned = 0;
+	PP_statistics.numRetired = 0;
+	PP_statistics.numSteals = 0;
+	PP_statistics.numFailedSteals = 0;
+	for (i = 0; i < PP_MaxSpawnedWorkers; i++)
+	{
+		PP_groups[i].comm = MPI_COMM_NULL;
+		PP_groups[i].intercomm = MPI_COMM_NULL;
+		PP_groups[i].size = 0;
+		PP_groups[i].recv = MPI_REQUEST_NULL;
+		PP_spawnedWorkers[i].live = 0;
+		PP_active[PP_numWorkers + i] = 0;
+	}
+}
 
-	// 如果存在正在等待被启动的进程
-	if (PP_processesAwaitingStart)
+/**
+ * Called by a sub-master from the pool initialisation, serves the commands of the workers in its block and the requests
+ * of the other masters until the stop command comes down the tree, then stops its own workers and returns zero
+ */
+static int subMasterLoop()
+{
+	MPI_Request controlRequest;
+	MPI_Irecv(&in_command, 1, PP_COMMAND_TYPE, MPI_ANY_SOURCE, PP_CONTROL_TAG, MPI_COMM_WORLD, &controlRequest);
+	MPI_Irecv(&manager_command, 1, PP_COMMAND_TYPE, MPI_ANY_SOURCE, PP_MANAGER_TAG, MPI_COMM_WORLD, &PP_managerRecvRequest);
+	while (!PP_stopRequested)
 	{
-		int i;
-		for (i = 0; i < PP_numProcs - 1; i++)
+		MPI_Request requests[2] = {controlRequest, PP_managerRecvRequest};
+		int index;
+		MPI_Status status;
+		MPI_Waitany(2, requests, &index, &status);
+		controlRequest = requests[0];
+		PP_managerRecvRequest = requests[1];
+		if (index == 1)
 		{
-			// 遍历所有可用的进程，找到第一个非活跃状态的进程
-			if (!PP_active[i])
+			handleManagerCommand(status.MPI_SOURCE);
+		}
+		else
+		{
+			handleWorkerCommand(status.MPI_SOURCE);
+			MPI_Irecv(&in_command, 1, PP_COMMAND_TYPE, MPI_ANY_SOURCE, PP_CONTROL_TAG, MPI_COMM_WORLD, &controlRequest);
+		}
+	}
+	broadcastStop();
+	MPI_Cancel(&controlRequest);
+	MPI_Wait(&controlRequest, MPI_STATUS_IGNORE);
+	return 0;
+}
+
+/**
+ * Called by the master or a sub-master to handle a command received from one of its workers, or a start request or
+ * shutdown forwarded by a sub-master. Returns zero if the master is to stop polling
+ */
+static int handleWorkerCommand(int source)
+{
+	// 收到工作进程的睡眠指令，则将发送命令的工作进程放回空闲栈，并用它启动等待中的进程
+	if (in_command.command == PP_SLEEPING)
+	{
+		if (PP_DEBUG)
+			printf("[Master %d] Received sleep command from %d\n", PP_myRank, source);
+		pushIdleWorker(peerWorker(source));
+		serveBacklog();
+		return 1;
+	}
+
+	// 收到任务完成，说明工作进程完成其任务并且希望停止整个程序，主进程返回0表示整个程序可以停止轮询，终止进程池
+	// 子主进程把这个指令转发给主进程
+	if (in_command.command == PP_RUNCOMPLETE)
+	{
+		if (PP_DEBUG)
+			printf("[Master %d] Received shutdown command\n", PP_myRank);
+		if (PP_myRank == 0)
+			return 0;
+		struct PP_Control_Package out_command = createCommandPackage(PP_RUNCOMPLETE);
+		MPI_Send(&out_command, 1, PP_COMMAND_TYPE, 0, PP_CONTROL_TAG, MPI_COMM_WORLD);
+		return 1;
+	}
+
+	// 批量启动请求，负载随后单独发送，一次性启动所有进程，并把它们的rank一起发回给请求的进程
+	// 子主进程转发上来的请求已经向其他子主进程借用过，只用本块空闲的进程，不再借用或排队
+	if (in_command.command == PP_STARTPROCESSES)
+	{
+		double requested = MPI_Wtime();
+		int n = in_command.data;
+		if (n > PP_batchCapacity)
+		{
+			PP_batchCapacity = n;
+			PP_batchPayloads = (int *)realloc(PP_batchPayloads, sizeof(int) * n);
+			PP_batchRanks = (int *)realloc(PP_batchRanks, sizeof(int) * n);
+		}
+		int sourceRank;
+		MPI_Comm sourceComm = peerAddress(source, &sourceRank);
+		MPI_Recv(PP_batchPayloads, n, MPI_INT, sourceRank, PP_PAYLOAD_TAG, sourceComm, MPI_STATUS_IGNORE);
+		if (isManagerRank(source))
+		{
+			if (startBatch(n, PP_batchPayloads, PP_batchRanks, requested) < n)
+				startBatchGrowing(n, PP_batchPayloads, PP_batchRanks, requested);
+			MPI_Send(PP_batchRanks, n, MPI_INT, source, PP_PID_TAG, MPI_COMM_WORLD);
+		}
+		else
+		{
+			submitStart(source, n, PP_batchPayloads, PP_batchRanks, requested);
+		}
+		return 1;
+	}
+
+	// 启动单个进程的请求，新进程的数据是发起请求的进程，启动之后返回给发起这个指令的进程新启动的进程的rank
+	// If the master was to start a worker then send back the process rank that this worker is now on
+	if (in_command.command == PP_STARTPROCESS)
+	{
+		int parent = source, workerRank;
+		submitStart(source, 1, &parent, &workerRank, MPI_Wtime());
+	}
+	return 1;
+}
+
+/**
+ * Called by a sub-master to handle a command from another master. Lending workers and reporting the counters never
+ * wait on another master, so sub-masters can serve these while waiting themselves without deadlocking
+ */
+static void handleManagerCommand(int source)
+{
+	if (manager_command.command == PP_LEND)
+	{
+		// 另一个主进程的块没有空闲的工作进程，用本块的工作进程为它启动，不足的部分返回-1
+		double requested = MPI_Wtime();
+		int n = manager_command.data;
+		int *payloads = (int *)malloc(sizeof(int) * n), *ranks = (int *)malloc(sizeof(int) * n);
+		MPI_Recv(payloads, n, MPI_INT, source, PP_PAYLOAD_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		startBatch(n, payloads, ranks, requested);
+		MPI_Send(ranks, n, MPI_INT, source, PP_PID_TAG, MPI_COMM_WORLD);
+		free(payloads);
+		free(ranks);
+	}
+	else if (manager_command.command == PP_REPORT)
+	{
+		MPI_Send(&PP_statistics, sizeof(PP_statistics), MPI_BYTE, source, PP_PID_TAG, MPI_COMM_WORLD);
+	}
+	else if (manager_command.command == PP_STOP)
+	{
+		// 停止之后不再接收其他主进程的命令
+		PP_stopRequested = 1;
+		return;
+	}
+	else
+	{
+		errorMessage("Unexpected manager command");
+	}
+	MPI_Irecv(&manager_command, 1, PP_COMMAND_TYPE, MPI_ANY_SOURCE, PP_MANAGER_TAG, MPI_COMM_WORLD, &PP_managerRecvRequest);
+}
+
+/**
+ * Waits for a reply from another master. A sub-master keeps serving the other masters' commands meanwhile, as the
+ * master it is waiting on may itself be waiting to borrow workers from it
+ */
+static void waitServingManagers(MPI_Request *request)
+{
+	while (1 == 1)
+	{
+		MPI_Request requests[2] = {*request, PP_managerRecvRequest};
+		int index;
+		MPI_Status status;
+		MPI_Waitany(2, requests, &index, &status);
+		*request = requests[0];
+		PP_managerRecvRequest = requests[1];
+		if (index != 1)
+			return;
+		handleManagerCommand(status.MPI_SOURCE);
+	}
+}
+
+/**
+ * Sends the stop command to the child sub-masters in the binary tree over the blocks and to the workers of the caller's
+ * own block, so that no master sends more than two stop commands to other masters
+ */
+static void broadcastStop()
+{
+	int block = PP_myRank / PP_blockSize, child, i;
+	struct PP_Control_Package out_command = createCommandPackage(PP_STOP);
+	for (child = 2 * block + 1; child <= 2 * block + 2 && child < PP_numBlocks; child++)
+	{
+		MPI_Send(&out_command, 1, PP_COMMAND_TYPE, child * PP_blockSize, PP_MANAGER_TAG, MPI_COMM_WORLD);
+	}
+	for (i = 0; i < PP_numWorkers + PP_MaxSpawnedWorkers; i++)
+	{
+		if (i >= PP_numWorkers && !PP_spawnedWorkers[i - PP_numWorkers].live)
+			continue;
+		int rank;
+		MPI_Comm comm = peerAddress(workerPeer(i), &rank);
+		if (PP_DEBUG)
+			printf("[Master %d] Shutting down process %d\n", PP_myRank, workerPeer(i));
+		MPI_Send(&out_command, 1, PP_COMMAND_TYPE, rank, PP_CONTROL_TAG, comm);
+	}
+}
+
+/**
+ * Whether a rank is the master or a sub-master rather than a worker
+ */
+static int isManagerRank(int rank)
+{
+	return rank < PP_numProcs && rank % PP_blockSize == 0;
+}
+
+/**
+ * Id by which requesters know a worker of the caller, its rank in MPI_COMM_WORLD unless it is a spawned worker
+ */
+static int workerPeer(int i)
+{
+	return i < PP_numWorkers ? PP_firstWorker + i : PP_numProcs + i - PP_numWorkers;
+}
+
+static int peerWorker(int peer)
+{
+	return peer < PP_numProcs ? peer - PP_firstWorker : PP_numWorkers + peer - PP_numProcs;
+}
+
+/**
+ * Communicator and rank to reach a worker or requester by its id
+ */
+static MPI_Comm peerAddress(int peer, int *rank)
+{
+	if (peer < PP_numProcs)
+	{
+		*rank = peer;
+		return MPI_COMM_WORLD;
+	}
+	struct PP_SpawnedWorker *worker = &PP_spawnedWorkers[peer - PP_numProcs];
+	*rank = worker->rank;
+	return PP_groups[worker->group].comm;
+}
+
+/**
+ * Sends the wake command with its data to a worker of the caller's block
+ */
+static void wakeWorker(int i, int data)
+{
+	struct PP_Control_Package out_command = createCommandPackage(PP_WAKE);
+	out_command.data = data;
+	int rank;
+	MPI_Comm comm = peerAddress(workerPeer(i), &rank);
+	if (PP_DEBUG)
+		printf("[Master %d] Starting process %d with data %d\n", PP_myRank, workerPeer(i), data);
+	MPI_Send(&out_command, 1, PP_COMMAND_TYPE, rank, PP_CONTROL_TAG, comm);
+}
+
+/**
+ * Called by the master or a sub-master to start a request's workers, each woken with its own payload as the command
+ * data. Workers are taken from the caller's own block first and then borrowed from the other blocks. If the pool queues
+ * on no processes then the rest wait in the backlog and the requester gets the ranks once they have all been started,
+ * otherwise they get the rank -1 unless the pool quits. Requests never overtake the backlog, so a requester receives
+ * its replies in the order it made its requests. Returns the number of workers started straight away
+ */
+static int submitStart(int source, int n, const int *payloads, int *ranks, double requested)
+{
+	int started = 0, b;
+	if (PP_backlogCount == 0)
+	{
+		started = startBatch(n, payloads, ranks, requested);
+		if (started < n)
+			started += borrowWorkers(n, payloads, ranks);
+		if (started < n && PP_ElasticSpawn && PP_myRank == 0)
+			started += startBatchGrowing(n, payloads, ranks, requested);
+	}
+	else
+	{
+		for (b = 0; b < n; b++)
+			ranks[b] = -1;
+	}
+
+	if (started < n)
+	{
+		if (PP_QuitOnNoProcs)
+		{
+			errorMessage("No more processes available");
+		}
+		if (PP_IgnoreOnNoProcs)
+		{
+			fprintf(stderr, "[ProcessPool] Warning. No processes available. Ignoring %d launch requests.\n", n - started);
+		}
+		else
+		{
+			queueStart(source, n, payloads, ranks, requested);
+			return started;
+		}
+	}
+	if (source != PP_myRank)
+	{
+		int sourceRank;
+		MPI_Comm sourceComm = peerAddress(source, &sourceRank);
+		MPI_Send(ranks, n, MPI_INT, sourceRank, PP_PID_TAG, sourceComm);
+	}
+	return started;
+}
+
+/**
+ * Adds the workers of a request that could not be started to the back of the backlog. The requester is told to
+ * throttle its requests if this takes the backlog past the pressure threshold
+ */
+static void queueStart(int source, int n, const int *payloads, const int *ranks, double requested)
+{
+	int missing = 0, b;
+	for (b = 0; b < n; b++)
+	{
+		if (ranks[b] == -1)
+			missing++;
+	}
+	if (PP_backlogCount + missing > PP_BacklogCapacity)
+	{
+		errorMessage("Start backlog is full");
+	}
+
+	int r = PP_freePending;
+	PP_freePending = PP_nextPending[r];
+	struct PP_PendingStart *pending = &PP_pending[r];
+	pending->source = source;
+	pending->n = n;
+	pending->remaining = missing;
+	pending->requested = requested;
+	pending->ranks = (int *)malloc(sizeof(int) * n);
+	double now = MPI_Wtime();
+	for (b = 0; b < n; b++)
+	{
+		pending->ranks[b] = ranks[b];
+		if (ranks[b] != -1)
+			continue;
+		struct PP_BacklogEntry *entry = &PP_backlog[(PP_backlogHead + PP_backlogCount) % PP_BacklogCapacity];
+		entry->request = r;
+		entry->index = b;
+		entry->payload = payloads[b];
+		entry->queuedAt = now;
+		PP_backlogCount++;
+	}
+	if (PP_DEBUG)
+		printf("[Master %d] Queued %d starts from %d, backlog %d\n", PP_myRank, missing, source, PP_backlogCount);
+
+	PP_statistics.numQueued += missing;
+	PP_statistics.backlogDepth = PP_backlogCount;
+	if (PP_backlogCount > PP_statistics.maxBacklogDepth)
+		PP_statistics.maxBacklogDepth = PP_backlogCount;
+	if (PP_backlogCount > PP_BacklogPressure && source != PP_myRank && !PP_pressured[source])
+		signalPressure(source, 1);
+}
+
+/**
+ * Starts the workers at the front of the backlog on the idle workers of the caller's block, replying to each request
+ * once its last worker has been started. Requesters are released from throttling once the backlog has half drained
+ */
+static void serveBacklog()
+{
+	while (PP_backlogCount > 0)
+	{
+		int i = popIdleWorker();
+		if (i == -1)
+			break;
+		struct PP_BacklogEntry *entry = &PP_backlog[PP_backlogHead];
+		PP_backlogHead = (PP_backlogHead + 1) % PP_BacklogCapacity;
+		PP_backlogCount--;
+
+		struct PP_PendingStart *pending = &PP_pending[entry->request];
+		wakeWorker(i, entry->payload);
+		recordStart(pending->requested);
+		double wait = MPI_Wtime() - entry->queuedAt;
+		PP_statistics.totalQueueWait += wait;
+		if (wait > PP_statistics.maxQueueWait)
+			PP_statistics.maxQueueWait = wait;
+
+		pending->ranks[entry->index] = workerPeer(i);
+		pending->remaining--;
+		if (pending->remaining == 0)
+		{
+			if (pending->source != PP_myRank)
+			{
+				int sourceRank;
+				MPI_Comm sourceComm = peerAddress(pending->source, &sourceRank);
+				MPI_Send(pending->ranks, pending->n, MPI_INT, sourceRank, PP_PID_TAG, sourceComm);
+			}
+			free(pending->ranks);
+			PP_nextPending[entry->request] = PP_freePending;
+			PP_freePending = entry->request;
+		}
+	}
+	PP_statistics.backlogDepth = PP_backlogCount;
+
+	if (PP_numPressured > 0 && PP_backlogCount <= PP_BacklogPressure / 2)
+	{
+		while (PP_numPressured > 0)
+		{
+			signalPressure(PP_pressuredRanks[PP_numPressured - 1], 0);
+		}
+	}
+}
+
+/**
+ * Tells a requester to start or stop throttling its start requests, and tracks which requesters are throttling
+ */
+static void signalPressure(int rank, int on)
+{
+	if (PP_DEBUG)
+		printf("[Master %d] Backpressure %s for %d\n", PP_myRank, on ? "on" : "off", rank);
+	int peerRank;
+	MPI_Comm comm = peerAddress(rank, &peerRank);
+	MPI_Send(&on, 1, MPI_INT, peerRank, PP_PRESSURE_TAG, comm);
+	PP_pressured[rank] = on;
+	if (on)
+		PP_pressuredRanks[PP_numPressured++] = rank;
+	else
+		PP_numPressured--;
+}
+
+/**
+ * Starts as many workers of a batch as there are idle workers in the caller's block, the rest get the rank -1
+ */
+static int startBatch(int n, const int *payloads, int *ranks, double requested)
+{
+	int started = 0, b;
+	for (b = 0; b < n; b++)
+	{
+		int i = popIdleWorker();
+		if (i == -1)
+		{
+			ranks[b] = -1;
+			continue;
+		}
+		wakeWorker(i, payloads[b]);
+		recordStart(requested);
+		ranks[b] = workerPeer(i);
+		started++;
+	}
+	return started;
+}
+
+/**
+ * Called by the elastic master once its idle stack is empty, spawns workers for those of a batch which still have the
+ * rank -1 and starts them. Returns the number started, which is less than asked for once the spawn limit is reached
+ */
+static int startBatchGrowing(int n, const int *payloads, int *ranks, double requested)
+{
+	if (!PP_ElasticSpawn || PP_myRank != 0)
+		return 0;
+	int missing = 0, started = 0, b;
+	for (b = 0; b < n; b++)
+	{
+		if (ranks[b] == -1)
+			missing++;
+	}
+	if (missing == 0 || spawnWorkers(missing > PP_SpawnBatch ? missing : PP_SpawnBatch) == 0)
+		return 0;
+	for (b = 0; b < n; b++)
+	{
+		if (ranks[b] != -1)
+			continue;
+		int i = popIdleWorker();
+		if (i == -1)
+			break;
+		wakeWorker(i, payloads[b]);
+		recordStart(requested);
+		ranks[b] = workerPeer(i);
+		started++;
+	}
+	return started;
+}
+
+/**
+ * Launches up to n more workers from the spawn command in one group and puts them on the idle stack. The master waits
+ * in the merge until the new processes have initialised their pool
+ */
+static int spawnWorkers(int n)
+{
+	if (PP_spawnCommand == NULL)
+		errorMessage("Elastic pool has no spawn command, call processPoolSetSpawnCommand before processPoolInit");
+	int numFree = 0, g, s;
+	for (s = 0; s < PP_MaxSpawnedWorkers; s++)
+	{
+		if (!PP_spawnedWorkers[s].live)
+			numFree++;
+	}
+	if (n > numFree)
+		n = numFree;
+	if (n == 0)
+		return 0;
+	for (g = 0; PP_groups[g].size > 0; g++)
+		;
+
+	struct PP_SpawnGroup *group = &PP_groups[g];
+	MPI_Comm_spawn(PP_spawnCommand, PP_spawnArgv, n, MPI_INFO_NULL, 0, MPI_COMM_SELF, &group->intercomm,
+			MPI_ERRCODES_IGNORE);
+	MPI_Intercomm_merge(group->intercomm, 0, &group->comm);
+	group->size = n;
+	group->live = n;
+	group->slots = (int *)malloc(sizeof(int) * n);
+	PP_numGroups++;
+
+	// 新进程占用编号最小的空槽位，按照在组中的顺序放入空闲栈，组内rank最小的进程在栈顶
+	int r;
+	for (r = 0, s = 0; r < n; r++, s++)
+	{
+		while (PP_spawnedWorkers[s].live)
+			s++;
+		group->slots[r] = s;
+	}
+	for (r = n - 1; r >= 0; r--)
+	{
+		s = group->slots[r];
+		PP_spawnedWorkers[s].live = 1;
+		PP_spawnedWorkers[s].group = g;
+		PP_spawnedWorkers[s].rank = r + 1;
+		PP_spawnedWorkers[s].idleSince = MPI_Wtime();
+		int i = PP_numWorkers + s;
+		PP_active[i] = 0;
+		PP_nextIdle[i] = PP_idleHead;
+		PP_idleHead = i;
+	}
+	PP_statistics.numSpawned += n;
+	PP_statistics.numWorkers += n;
+	MPI_Irecv(&group->command, 1, PP_COMMAND_TYPE, MPI_ANY_SOURCE, PP_CONTROL_TAG, group->comm, &group->recv);
+	if (PP_DEBUG)
+		printf("[Master] Spawned %d workers\n", n);
+	return n;
+}
+
+/**
+ * Retires the spawn groups whose workers have all been idle for longer than the cooldown, checking at most once a
+ * second. The workers of a group are taken off the idle stack and stopped together, and the master then disconnects
+ * from the group so that its processes can exit
+ */
+static void retireIdleSpawnedWorkers()
+{
+	double now = MPI_Wtime();
+	if (PP_numGroups == 0 || now - PP_lastRetireCheck < 1.0)
+		return;
+	PP_lastRetireCheck = now;
+
+	// 统计每个组中空闲超过冷却时间的工作进程，只有全部空闲的组才会被停止
+	int numCooled[PP_MaxSpawnedWorkers] = {0};
+	int i, g, r;
+	for (i = PP_idleHead; i != -1; i = PP_nextIdle[i])
+	{
+		struct PP_SpawnedWorker *worker = i >= PP_numWorkers ? &PP_spawnedWorkers[i - PP_numWorkers] : NULL;
+		if (worker != NULL && now - worker->idleSince >= PP_SpawnCooldown)
+			numCooled[worker->group]++;
+	}
+	int retiring = 0;
+	for (g = 0; g < PP_MaxSpawnedWorkers; g++)
+	{
+		if (PP_groups[g].size > 0 && numCooled[g] == PP_groups[g].live)
+			retiring = 1;
+		else
+			numCooled[g] = 0;
+	}
+	if (!retiring)
+		return;
+
+	int *link = &PP_idleHead;
+	while (*link != -1)
+	{
+		i = *link;
+		if (i >= PP_numWorkers && numCooled[PP_spawnedWorkers[i - PP_numWorkers].group] > 0)
+			*link = PP_nextIdle[i];
+		else
+			link = &PP_nextIdle[i];
+	}
+	for (g = 0; g < PP_MaxSpawnedWorkers; g++)
+	{
+		if (numCooled[g] == 0)
+			continue;
+		struct PP_SpawnGroup *group = &PP_groups[g];
+		for (r = 0; r < group->size; r++)
+		{
+			struct PP_SpawnedWorker *worker = &PP_spawnedWorkers[group->slots[r]];
+			struct PP_Control_Package out_command = createCommandPackage(PP_STOP);
+			MPI_Send(&out_command, 1, PP_COMMAND_TYPE, worker->rank, PP_CONTROL_TAG, group->comm);
+			worker->live = 0;
+			PP_statistics.numRetired++;
+			PP_statistics.numWorkers--;
+			if (PP_DEBUG)
+				printf("[Master] Retired spawned worker %d\n", PP_numProcs + group->slots[r]);
+		}
+		group->live = 0;
+		freeSpawnGroup(g);
+	}
+}
+
+/**
+ * Stops listening to a spawn group and disconnects the master from it, which waits for the group's workers to
+ * disconnect once they have been stopped. The merged communicator has no pending communication by then and is freed,
+ * as the spawned workers do, and the spawn intercommunicator is disconnected
+ */
+static void freeSpawnGroup(int g)
+{
+	struct PP_SpawnGroup *group = &PP_groups[g];
+	MPI_Cancel(&group->recv);
+	MPI_Wait(&group->recv, MPI_STATUS_IGNORE);
+	MPI_Comm_free(&group->comm);
+	MPI_Comm_disconnect(&group->intercomm);
+	free(group->slots);
+	group->size = 0;
+	PP_numGroups--;
+}
+
+/**
+ * Starts the workers of a batch which still have the rank -1 in the other blocks. The sub-masters are asked in turn,
+ * starting from the next block, and a sub-master only escalates what is left to the master once they are all full
+ */
+static int borrowWorkers(int n, const int *payloads, int *ranks)
+{
+	if (PP_numBlocks == 1)
+		return 0;
+	int *index = (int *)malloc(sizeof(int) * n), *lendPayloads = (int *)malloc(sizeof(int) * n);
+	int *lent = (int *)malloc(sizeof(int) * n);
+	int myBlock = PP_myRank / PP_blockSize, borrowed = 0, k;
+	for (k = 1; k <= PP_numBlocks; k++)
+	{
+		// 最后一轮是向主进程请求，主进程自己不需要
+		int block = k < PP_numBlocks ? (myBlock + k) % PP_numBlocks : 0;
+		if ((block == 0 && k < PP_numBlocks) || block == myBlock)
+			continue;
+
+		int m = 0, b;
+		for (b = 0; b < n; b++)
+		{
+			if (ranks[b] == -1)
 			{
-				PP_active[i] = 1;
-				struct PP_Control_Package out_command = createCommandPackage(PP_WAKE);
-
-				// 如果awaitingID等于PP_processesAwaitingStart，则说明当前正在处理启动的进程是最后一个请求启动的进程
-				// 如果.data等于-1，说明这个启动请求无法直接关联到特定的父进程
-				out_command.data = awaitingId == PP_processesAwaitingStart ? parent : -1;
-				if (PP_DEBUG)
-					printf("[Master] Starting process %d\n", i + 1);
-				MPI_Send(&out_command, 1, PP_COMMAND_TYPE, i + 1, PP_CONTROL_TAG, MPI_COMM_WORLD);
-
-				// 如果是最后一个，则记录目前正在处理启动的mpi的排名，返回这个排名
-				if (awaitingId == PP_processesAwaitingStart)
-					awaitingProcessMPIRank = i + 1; // Will return this rank to the caller
-
-				// 减少计数，若计数为0则退出循环
-				PP_processesAwaitingStart--;
-				if (PP_processesAwaitingStart == 0)
-					break;
+				index[m] = b;
+				lendPayloads[m++] = payloads[b];
 			}
-			if (i == PP_numProcs - 2)
+		}
+		if (m == 0)
+			break;
+		requestWorkers(block * PP_blockSize, block == 0 ? PP_STARTPROCESSES : PP_LEND, m, lendPayloads, lent);
+		for (b = 0; b < m; b++)
+		{
+			if (lent[b] != -1)
 			{
-				// If I reach this point, I must have looped through the whole array and found no available processes
-				if (PP_QuitOnNoProcs)
-				{
-					errorMessage("No more processes available");
-				}
-
-				if (PP_IgnoreOnNoProcs)
-				{
-					fprintf(stderr, "[ProcessPool] Warning. No processes available. Ignoring launch request.\n");
-					PP_processesAwaitingStart--;
-				}
-				// otherwise, do nothing; a process may become available on the next iteration of the loop
+				ranks[index[b]] = lent[b];
+				borrowed++;
 			}
 		}
 	}
-	return awaitingProcessMPIRank;
+	free(index);
+	free(lendPayloads);
+	free(lent);
+	return borrowed;
+}
+
+/**
+ * Asks another master to start workers with the given payloads and waits for their ranks. Start requests go to the
+ * receiver's control loop, requests to lend workers go to the sub-master's manager commands
+ */
+static void requestWorkers(int target, enum PP_Control_Command command, int n, const int *payloads, int *ranks)
+{
+	struct PP_Control_Package out_command = createCommandPackage(command);
+	out_command.data = n;
+	MPI_Send(&out_command, 1, PP_COMMAND_TYPE, target, command == PP_LEND ? PP_MANAGER_TAG : PP_CONTROL_TAG, PP_comm);
+	MPI_Send(payloads, n, MPI_INT, target, PP_PAYLOAD_TAG, PP_comm);
+	MPI_Request request;
+	MPI_Irecv(ranks, n, MPI_INT, target, PP_PID_TAG, PP_comm, &request);
+	waitServingManagers(&request);
+}
+
+/**
+ * Adds a started worker to the start latency counters
+ */
+static void recordStart(double requested)
+{
+	double latency = MPI_Wtime() - requested;
+	PP_statistics.numStarts++;
+	PP_statistics.totalStartLatency += latency;
+	if (latency > PP_statistics.maxStartLatency)
+		PP_statistics.maxStartLatency = latency;
+}
+
+/**
+ * Takes the worker on top of the idle stack and marks it active, returns -1 if every worker is active
+ */
+static int popIdleWorker()
+{
+	int i = PP_idleHead;
+	if (i == -1)
+		return -1;
+	PP_idleHead = PP_nextIdle[i];
+	PP_active[i] = 1;
+	PP_statistics.numActive++;
+	if (PP_statistics.numActive > PP_statistics.highWaterMark)
+		PP_statistics.highWaterMark = PP_statistics.numActive;
+	return i;
+}
+
+/**
+ * Returns a worker that has gone to sleep to the top of the idle stack, so the most recently used worker is reused first
+ */
+static void pushIdleWorker(int i)
+{
+	if (!PP_active[i])
+		return;
+	PP_active[i] = 0;
+	PP_nextIdle[i] = PP_idleHead;
+	PP_idleHead = i;
+	PP_statistics.numActive--;
+	if (i >= PP_numWorkers)
+		PP_spawnedWorkers[i - PP_numWorkers].idleSince = MPI_Wtime();
 }
 
 /**
@@ -308,13 +1370,13 @@ static int startAwaitingProcessesIfNeeded(int awaitingId, int parent)
  */
 static int handleRecievedCommand()
 {
-	// 用于工作进程处理从主进程接收到的命令，可能会被唤醒或被停止
+	// 用于工作进程处理从所在块的主进程接收到的命令，可能会被唤醒或被停止
 	// We have just (most likely) received a command, therefore decide what to do
 	if (in_command.command == PP_WAKE)
 	{
 		// 接收到唤醒指令，继续等待接收下一个工作指令，返回1表示已经唤醒
 		// If we are told to wake then post a recv for the next command and return true to continues
-		MPI_Irecv(&in_command, 1, PP_COMMAND_TYPE, 0, PP_CONTROL_TAG, MPI_COMM_WORLD, &PP_pollRecvCommandRequest);
+		MPI_Irecv(&in_command, 1, PP_COMMAND_TYPE, PP_myMaster, PP_CONTROL_TAG, PP_comm, &PP_pollRecvCommandRequest);
 		if (PP_DEBUG)
 			printf("[Worker] Process %d woken to work\n", PP_myRank);
 		return 1;
@@ -350,10 +1412,10 @@ static void errorMessage(char *message)
  */
 static void initialiseType()
 {
-	struct PP_Control_Package package;
+	struct PP_Control_Package package = {0};
 	MPI_Aint pckAddress, dataAddress;
-	MPI_Address(&package, &pckAddress);
-	MPI_Address(&package.data, &dataAddress);
+	MPI_Get_address(&package, &pckAddress);
+	MPI_Get_address(&package.data, &dataAddress);
 	int blocklengths[3] = {1, 1}, nitems = 2;
 	MPI_Datatype types[3] = {MPI_CHAR, MPI_INT};
 	MPI_Aint offsets[3] = {0, dataAddress - pckAddress};
@@ -366,7 +1428,7 @@ static void initialiseType()
  */
 static struct PP_Control_Package createCommandPackage(enum PP_Control_Command desiredCommand)
 {
-	struct PP_Control_Package package;
+	struct PP_Control_Package package = {0};
 	package.command = desiredCommand;
 	return package;
 }
@@ -1,13 +1,29 @@
 #ifndef POOL_H_
 #define POOL_H_
 
+#include "mpi.h"
+
 // The core process pool command which instructs what to do next
 enum PP_Control_Command {
 	PP_STOP=0,
 	PP_SLEEPING=1,
 	PP_WAKE=2,
 	PP_STARTPROCESS=3,
-	PP_RUNCOMPLETE=4
+	PP_RUNCOMPLETE=4,
+	PP_STARTPROCESSES=5,
+	PP_LEND=6,
+	PP_REPORT=7,
+	PP_STEAL=8,
+	PP_TASK=9,
+	PP_NOTASK=10,
+	PP_TOKEN=11
+};
+
+// Scheduler behind the pool API. The master scheduler starts every worker through rank 0 or a sub-master, the work
+// stealing scheduler keeps a deque of tasks on each rank which idle ranks steal from, see steal.c
+enum PP_Scheduler {
+	PP_MASTER_SCHEDULER=0,
+	PP_STEALING_SCHEDULER=1
 };
 
 // An example data package which combines the command with some optional data, an example and can be extended
@@ -16,8 +32,44 @@ struct PP_Control_Package {
     int data;
 };
 
+// Occupancy and start latency counters of the pool, maintained by the master and any sub-masters for their blocks. The
+// start latency of a worker is the time from its master receiving the request to start it until the worker is woken,
+// the backlog counters cover the workers that had to wait in the backlog for an idle worker, and the spawn counters the
+// workers an elastic master launched and retired. With the work stealing scheduler the backlog is the ranks' deques,
+// the high water mark is the number of ranks that ran a task and the steal counters are those of the idle ranks
+struct PP_Statistics {
+	int numWorkers;
+	int numActive;
+	int highWaterMark;
+	long numStarts;
+	double totalStartLatency;
+	double maxStartLatency;
+	int backlogDepth;
+	int maxBacklogDepth;
+	long numQueued;
+	double totalQueueWait;
+	double maxQueueWait;
+	long numSpawned;
+	long numRetired;
+	long numSteals;
+	long numFailedSteals;
+};
+
+// Handle of an asynchronous start request, which completes once all of its workers have been started
+struct PP_StartRequest {
+	MPI_Request request;
+};
+
 // Initialises the process pool
 int processPoolInit();
+// Sets the command and NULL terminated arguments the master spawns extra workers with when elastic, called before
+// initialising the pool
+void processPoolSetSpawnCommand(char *, char *[]);
+// Sets how many of the lowest ranks the application relies on its first started workers occupying, called before
+// initialising the pool
+void processPoolSetFixedRanks(int);
+// Selects the scheduler, called before initialising the pool
+void processPoolSetScheduler(enum PP_Scheduler);
 // Finalises the process pool
 void processPoolFinalise();
 // Called by the master in loop, blocks until state change, 1=continue and 0=stop
@@ -26,11 +78,26 @@ int masterPoll();
 int workerSleep();
 // Determines whether the current worker should stop or not (i.e. whether the pool is shutting down)
 int shouldWorkerStop();
+// Called by a running worker that does not poll shouldWorkerStop, lets the pool serve it with the work stealing scheduler
+void processPoolProgress();
 // Called by the master or a worker to start a new worker process
 int startWorkerProcess();
+// Called by the master or a worker to start n worker processes in one request, each is woken with its payload as the
+// command data. Writes the rank of each worker to ranks_out, -1 if it could not be started, and returns the number started
+int startWorkerProcesses(int, int *, const int *);
+// Called by the master or a worker to request n worker processes without waiting for them to be started
+void startWorkerProcessesAsync(int, int *, const int *, struct PP_StartRequest *);
+// Returns one once every worker of an asynchronous start request has been started, and zero otherwise
+int testStartRequest(struct PP_StartRequest *);
+// Stops waiting for an asynchronous start request
+void cancelStartRequest(struct PP_StartRequest *);
+// Called by a worker, whether its master has asked it to throttle start requests because the backlog is too deep
+int isPoolBackpressured();
 // Called by a worker to shut the pool down
 void shutdownPool();
 // Retrieves the optional data associated with the command, provides an example of how this can be done
 int getCommandData();
+// Called by the master to retrieve the occupancy and start latency counters of the pool
+void getPoolStatistics(struct PP_Statistics *);
 
 #endif /* POOL_H_ */
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mpi.h"
+#include "roadmap.h"
+#include "code.h"
+
+// Shared memory window holding this node's copy of the topology
+static MPI_Win topologyWindow = MPI_WIN_NULL;
+static MPI_Comm nodeComm = MPI_COMM_NULL;
+// Mapping of a compiled roadmap file, the page cache shares this between all processes on a node
+static void *mappedBase = NULL;
+static size_t mappedSize = 0;
+
+static size_t getTopologySize(int32_t, int32_t);
+static void layoutTopology(struct RoadTopology *, char *);
+static int mapTopologyFile(char *, struct RoadTopology *);
+static int checkTopology(const struct RoadTopology *);
+static uint64_t computeTopologyChecksum(const struct RoadTopology *);
+
+/**
+ * Parses the provided roadmap file and uses this to build the topology of junctions and roads, as well as
+ * reading traffic light information. Roads are grouped by their source junction and keep the file order
+ * within a junction, so road j of a junction is the j-th road listed for it in the file
+ **/
+void parseRoadTopology(char *filename, struct RoadTopology *topology)
+{
+    enum ReadMode currentMode = NONE;
+    char buffer[MAX_ROAD_LEN];
+    FILE *f = fopen(filename, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Error opening roadmap file '%s'\n", filename);
+        exit(-1);
+    }
+
+    // 道路按文件中的顺序先读入临时数组，之后再按起点路口分组
+    int num_junctions = 0, num_roads = 0, capacity = 1024;
+    int32_t *from = (int32_t *)malloc(sizeof(int32_t) * capacity);
+    int32_t *to = (int32_t *)malloc(sizeof(int32_t) * capacity);
+    int32_t *length = (int32_t *)malloc(sizeof(int32_t) * capacity);
+    int32_t *speed = (int32_t *)malloc(sizeof(int32_t) * capacity);
+    char *lights = NULL;
+
+    while (fgets(buffer, MAX_ROAD_LEN, f))
+    {
+        if (buffer[0] == '%')
+            continue;
+        if (buffer[0] == '#')
+        {
+            if (strncmp("# Road layout:", buffer, 14) == 0)
+            {
+                char *s = strstr(buffer, ":");
+                num_junctions = atoi(&s[1]);
+                lights = (char *)calloc(num_junctions, sizeof(char));
+                currentMode = ROADMAP;
+            }
+            if (strncmp("# Traffic lights:", buffer, 17) == 0)
+            {
+                currentMode = TRAFFICLIGHTS;
+            }
+        }
+        else
+        {
+            if (currentMode == ROADMAP)
+            {
+                if (num_roads == capacity)
+                {
+                    capacity *= 2;
+                    from = (int32_t *)realloc(from, sizeof(int32_t) * capacity);
+                    to = (int32_t *)realloc(to, sizeof(int32_t) * capacity);
+                    length = (int32_t *)realloc(length, sizeof(int32_t) * capacity);
+                    speed = (int32_t *)realloc(speed, sizeof(int32_t) * capacity);
+                }
+                char *space = strstr(buffer, " ");
+                *space = '\0';
+                from[num_roads] = atoi(buffer);
+                char *nextspace = strstr(&space[1], " ");
+                *nextspace = '\0';
+                to[num_roads] = atoi(&space[1]);
+                char *nextspace2 = strstr(&nextspace[1], " ");
+                *nextspace2 = '\0';
+                length[num_roads] = atoi(&nextspace[1]);
+                speed[num_roads] = atoi(&nextspace2[1]);
+                num_roads++;
+            }
+            else if (currentMode == TRAFFICLIGHTS)
+            {
+                lights[atoi(buffer)] = 1;
+            }
+        }
+    }
+    fclose(f);
+
+    topology->num_junctions = num_junctions;
+    topology->num_roads = num_roads;
+    layoutTopology(topology, (char *)malloc(getTopologySize(num_junctions, num_roads)));
+
+    // 统计每个路口的道路数量，计算每个路口的道路起始位置
+    memset(topology->roadOffsets, 0, sizeof(int32_t) * (num_junctions + 1));
+    for (int i = 0; i < num_roads; i++)
+    {
+        topology->roadOffsets[from[i] + 1]++;
+    }
+    for (int i = 0; i < num_junctions; i++)
+    {
+        topology->roadOffsets[i + 1] += topology->roadOffsets[i];
+    }
+
+    // 按起点路口放置道路，同一路口的道路保持文件中的顺序
+    int32_t *next = (int32_t *)malloc(sizeof(int32_t) * (num_junctions + 1));
+    memcpy(next, topology->roadOffsets, sizeof(int32_t) * (num_junctions + 1));
+    for (int i = 0; i < num_roads; i++)
+    {
+        int32_t road = next[from[i]]++;
+        topology->roadFrom[road] = from[i];
+        topology->roadTo[road] = to[i];
+        topology->roadLength[road] = length[i];
+        topology->roadMaxSpeed[road] = speed[i];
+    }
+
+    // 只有连接了道路的路口才会有信号灯
+    for (int i = 0; i < num_junctions; i++)
+    {
+        topology->hasTrafficLights[i] = lights[i] && topology->roadOffsets[i + 1] > topology->roadOffsets[i];
+    }
+    topology->checksum = computeTopologyChecksum(topology);
+
+    free(next);
+    free(from);
+    free(to);
+    free(length);
+    free(speed);
+    free(lights);
+}
+
+/**
+ * Frees a topology that was created by parseRoadTopology, all arrays live in the one allocation
+ **/
+void freeRoadTopology(struct RoadTopology *topology)
+{
+    free(topology->roadOffsets);
+    topology->roadOffsets = NULL;
+}
+
+/**
+ * Writes the topology to a compiled roadmap file. The arrays are written in exactly the layout they have in
+ * memory (native byte order), so that loading the file is just a matter of mapping it
+ **/
+void writeRoadTopology(char *filename, const struct RoadTopology *topology)
+{
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Error opening compiled roadmap file '%s' for writing\n", filename);
+        exit(-1);
+    }
+
+    struct RoadMapFileHeader header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, ROADMAP_FILE_MAGIC);
+    header.version = ROADMAP_FILE_VERSION;
+    header.num_junctions = topology->num_junctions;
+    header.num_roads = topology->num_roads;
+    header.checksum = topology->checksum;
+
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(topology->roadOffsets, sizeof(int32_t), topology->num_junctions + 1, f) == (size_t)topology->num_junctions + 1;
+    ok = ok && fwrite(topology->roadFrom, sizeof(int32_t), topology->num_roads, f) == (size_t)topology->num_roads;
+    ok = ok && fwrite(topology->roadTo, sizeof(int32_t), topology->num_roads, f) == (size_t)topology->num_roads;
+    ok = ok && fwrite(topology->roadLength, sizeof(int32_t), topology->num_roads, f) == (size_t)topology->num_roads;
+    ok = ok && fwrite(topology->roadMaxSpeed, sizeof(int32_t), topology->num_roads, f) == (size_t)topology->num_roads;
+    ok = ok && fwrite(topology->hasTrafficLights, sizeof(char), topology->num_junctions, f) == (size_t)topology->num_junctions;
+    if (fclose(f) != 0 || !ok)
+    {
+        fprintf(stderr, "Error writing compiled roadmap file '%s'\n", filename);
+        exit(-1);
+    }
+}
+
+/**
+ * Maps a compiled roadmap file read only into memory and points the topology at it, then checks its roads. Returns one
+ * if this was done or zero if the file is not a compiled roadmap (i.e. it is a text roadmap which needs parsing)
+ **/
+int mapRoadTopology(char *filename, struct RoadTopology *topology)
+{
+    if (!mapTopologyFile(filename, topology))
+        return 0;
+    if (!checkTopology(topology))
+    {
+        fprintf(stderr, "Error: Compiled roadmap '%s' is corrupt, its roads do not match its junctions\n", filename);
+        exit(-1);
+    }
+    return 1;
+}
+
+/**
+ * Maps a compiled roadmap file and checks its header, but not its roads. Returns zero if it is not a compiled roadmap
+ **/
+static int mapTopologyFile(char *filename, struct RoadTopology *topology)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error opening roadmap file '%s'\n", filename);
+        exit(-1);
+    }
+
+    struct RoadMapFileHeader header;
+    if (read(fd, &header, sizeof(header)) != sizeof(header) || memcmp(header.magic, ROADMAP_FILE_MAGIC, sizeof(ROADMAP_FILE_MAGIC)) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+    if (header.version != ROADMAP_FILE_VERSION)
+    {
+        fprintf(stderr, "Error: Compiled roadmap '%s' has version %u but version %d is required, recompile it\n",
+                filename, header.version, ROADMAP_FILE_VERSION);
+        exit(-1);
+    }
+
+    // 文件头中的数量决定映射的大小，负数或者溢出的大小会绕过下面的截断检查
+    if (header.num_junctions < 0 || header.num_roads < 0 ||
+        (size_t)header.num_junctions + 1 + (size_t)header.num_roads * 4 > (SIZE_MAX - sizeof(header)) / (sizeof(int32_t) + 1))
+    {
+        fprintf(stderr, "Error: Compiled roadmap '%s' has an invalid header with %d junctions and %d roads\n",
+                filename, header.num_junctions, header.num_roads);
+        exit(-1);
+    }
+    struct stat st;
+    size_t size = sizeof(header) + getTopologySize(header.num_junctions, header.num_roads);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < size)
+    {
+        fprintf(stderr, "Error: Compiled roadmap '%s' is truncated\n", filename);
+        exit(-1);
+    }
+
+    void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        fprintf(stderr, "Error mapping compiled roadmap '%s'\n", filename);
+        exit(-1);
+    }
+    mappedBase = base;
+    mappedSize = size;
+
+    topology->num_junctions = header.num_junctions;
+    topology->num_roads = header.num_roads;
+    topology->checksum = header.checksum;
+    layoutTopology(topology, (char *)base + sizeof(header));
+    return 1;
+}
+
+/**
+ * Unmaps a topology that was mapped by mapRoadTopology
+ **/
+void unmapRoadTopology(struct RoadTopology *topology)
+{
+    munmap(mappedBase, mappedSize);
+    mappedBase = NULL;
+    mappedSize = 0;
+    topology->roadOffsets = NULL;
+}
+
+/**
+ * Loads the roadmap once per node. A compiled roadmap is simply mapped by every process, as the page cache already
+ * shares it across the node, and only the first process on each node checks its roads. Otherwise the text roadmap is
+ * loaded into a node level MPI-3 shared memory window, where only the first process on each node parses the file and
+ * the others attach to its copy. This is collective over MPI_COMM_WORLD, so it must be called by every process before
+ * the process pool is initialised, and the topology is then read only for the rest of the run
+ **/
+void loadSharedRoadTopology(char *filename, struct RoadTopology *topology)
+{
+    int nodeRank;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nodeComm);
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    if (mapTopologyFile(filename, topology))
+    {
+        // 同一节点上的进程映射的是同一个文件，检查一次就足够了
+        int valid = nodeRank != 0 || checkTopology(topology);
+        MPI_Bcast(&valid, 1, MPI_INT, 0, nodeComm);
+        if (!valid)
+        {
+            if (nodeRank == 0)
+                fprintf(stderr, "Error: Compiled roadmap '%s' is corrupt, its roads do not match its junctions\n", filename);
+            exit(-1);
+        }
+        return;
+    }
+
+    // 节点上的第一个进程负责解析文件，然后把路口和道路的数量以及校验和广播给节点上的其他进程
+    struct RoadTopology parsed;
+    int32_t sizes[2];
+    uint64_t checksum;
+    if (nodeRank == 0)
+    {
+        parseRoadTopology(filename, &parsed);
+        sizes[0] = parsed.num_junctions;
+        sizes[1] = parsed.num_roads;
+        checksum = parsed.checksum;
+    }
+    MPI_Bcast(sizes, 2, MPI_INT32_T, 0, nodeComm);
+    MPI_Bcast(&checksum, 1, MPI_UINT64_T, 0, nodeComm);
+
+    size_t size = getTopologySize(sizes[0], sizes[1]);
+    char *base;
+    MPI_Win_allocate_shared(nodeRank == 0 ? size : 0, 1, MPI_INFO_NULL, nodeComm, &base, &topologyWindow);
+    if (nodeRank == 0)
+    {
+        memcpy(base, parsed.roadOffsets, size);
+        freeRoadTopology(&parsed);
+    }
+    else
+    {
+        MPI_Aint segmentSize;
+        int dispUnit;
+        MPI_Win_shared_query(topologyWindow, 0, &segmentSize, &dispUnit, &base);
+    }
+
+    // 确保其他进程在第一个进程写完之后才读取
+    MPI_Win_fence(0, topologyWindow);
+
+    topology->num_junctions = sizes[0];
+    topology->num_roads = sizes[1];
+    topology->checksum = checksum;
+    layoutTopology(topology, base);
+}
+
+/**
+ * Releases the topology loaded by loadSharedRoadTopology, collective over MPI_COMM_WORLD
+ **/
+void freeSharedRoadTopology(struct RoadTopology *topology)
+{
+    if (mappedBase != NULL)
+        unmapRoadTopology(topology);
+    else
+        MPI_Win_free(&topologyWindow);
+    MPI_Comm_free(&nodeComm);
+    topology->roadOffsets = NULL;
+}
+
+/**
+ * FNV-1a hash of the arrays that route costs are derived from, so a file built for a map with the same number of
+ * junctions and roads but different roads, lengths or speeds does not match. Computed once when the roadmap is parsed
+ **/
+static uint64_t computeTopologyChecksum(const struct RoadTopology *topology)
+{
+    const int32_t *arrays[4] = {topology->roadOffsets, topology->roadTo, topology->roadLength, topology->roadMaxSpeed};
+    size_t lengths[4] = {(size_t)topology->num_junctions + 1, topology->num_roads, topology->num_roads, topology->num_roads};
+    uint64_t hash = 14695981039346656037ULL;
+    for (int a = 0; a < 4; a++)
+    {
+        const unsigned char *bytes = (const unsigned char *)arrays[a];
+        for (size_t i = 0; i < lengths[a] * sizeof(int32_t); i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+/**
+ * Number of bytes needed to hold all the arrays of a topology in one block
+ **/
+static size_t getTopologySize(int32_t num_junctions, int32_t num_roads)
+{
+    return sizeof(int32_t) * ((size_t)num_junctions + 1 + (size_t)num_roads * 4) + num_junctions;
+}
+
+/**
+ * Checks that the road offsets of a mapped topology cover exactly its roads in order and that every road joins two
+ * of its junctions, so nothing indexed by them reads outside the mapping
+ **/
+static int checkTopology(const struct RoadTopology *topology)
+{
+    if (topology->roadOffsets[0] != 0 || topology->roadOffsets[topology->num_junctions] != topology->num_roads)
+        return 0;
+    for (int i = 0; i < topology->num_junctions; i++)
+    {
+        if (topology->roadOffsets[i + 1] < topology->roadOffsets[i])
+            return 0;
+        for (int road = topology->roadOffsets[i]; road < topology->roadOffsets[i + 1]; road++)
+        {
+            if (topology->roadFrom[road] != i || topology->roadTo[road] < 0 || topology->roadTo[road] >= topology->num_junctions)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Points the arrays of the topology into one block of memory, the integer arrays come first so they stay aligned
+ **/
+static void layoutTopology(struct RoadTopology *topology, char *base)
+{
+    int32_t *p = (int32_t *)base;
+    topology->roadOffsets = p;
+    p += topology->num_junctions + 1;
+    topology->roadFrom = p;
+    p += topology->num_roads;
+    topology->roadTo = p;
+    p += topology->num_roads;
+    topology->roadLength = p;
+    p += topology->num_roads;
+    topology->roadMaxSpeed = p;
+    p += topology->num_roads;
+    topology->hasTrafficLights = (char *)p;
+}
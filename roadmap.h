@@ -0,0 +1,48 @@
+#ifndef ROADMAP_H_
+#define ROADMAP_H_
+
+#include <stdint.h>
+
+// Read-only road network topology. It only holds indices (no pointers) so that a single copy can be placed in node
+// shared memory and used by every process on the node. The roads leaving junction i are [roadOffsets[i], roadOffsets[i+1]).
+// The checksum covers the road offsets, ends, lengths and maximum speeds, files derived from a topology store it to detect
+// that they were built for a different roadmap
+struct RoadTopology {
+	int32_t num_junctions, num_roads;
+	uint64_t checksum;
+	int32_t *roadOffsets;
+	int32_t *roadFrom, *roadTo;
+	int32_t *roadLength, *roadMaxSpeed;
+	char *hasTrafficLights;
+};
+
+// Compiled roadmap files start with this header, followed by the topology arrays laid out exactly as in memory. The
+// checksum is computed once when the roadmap is compiled, so loading it never needs to read the whole file
+#define ROADMAP_FILE_MAGIC "ROADMAP"
+#define ROADMAP_FILE_VERSION 2
+
+struct RoadMapFileHeader {
+	char magic[8];
+	uint32_t version;
+	int32_t num_junctions, num_roads;
+	uint32_t reserved;
+	uint64_t checksum;
+};
+
+// Parses a text roadmap file into a privately allocated topology
+void parseRoadTopology(char *, struct RoadTopology *);
+// Frees a topology created by parseRoadTopology
+void freeRoadTopology(struct RoadTopology *);
+// Writes a topology out as a compiled roadmap file
+void writeRoadTopology(char *, const struct RoadTopology *);
+// Maps a compiled roadmap file read only into memory and checks its roads, returns zero if the file is not a compiled roadmap
+int mapRoadTopology(char *, struct RoadTopology *);
+// Unmaps a topology mapped by mapRoadTopology
+void unmapRoadTopology(struct RoadTopology *);
+// Collectively loads the roadmap once per node (mapping compiled files, otherwise parsing into a shared memory window),
+// called by every process before the pool starts. The roads of a compiled roadmap are checked by one process per node
+void loadSharedRoadTopology(char *, struct RoadTopology *);
+// Collectively releases the topology loaded by loadSharedRoadTopology
+void freeSharedRoadTopology(struct RoadTopology *);
+
+#endif /* ROADMAP_H_ */
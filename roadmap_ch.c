@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "roadmap.h"
+#include "ch.h"
+
+/**
+ * Preprocesses a roadmap (text or compiled) into a contraction hierarchy stored next to it, which the simulation
+ * then maps and uses for route planning. Usage: roadmap_ch <roadmap>
+ **/
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Error: You need to provide the roadmap file as the only argument\n");
+        exit(-1);
+    }
+
+    struct RoadTopology topology;
+    int compiled = mapRoadTopology(argv[1], &topology);
+    if (!compiled)
+        parseRoadTopology(argv[1], &topology);
+
+    clock_t start = clock();
+    struct ContractionHierarchy hierarchy;
+    buildContractionHierarchy(&topology, &hierarchy);
+    char filename[strlen(argv[1]) + strlen(CH_FILE_SUFFIX) + 1];
+    sprintf(filename, "%s%s", argv[1], CH_FILE_SUFFIX);
+    writeContractionHierarchy(filename, &hierarchy, &topology);
+    printf("Contracted %d junctions and %d roads into %d upward and %d downward edges in %.2f seconds, written to '%s'\n",
+           topology.num_junctions, topology.num_roads, hierarchy.num_up, hierarchy.num_down,
+           (double)(clock() - start) / CLOCKS_PER_SEC, filename);
+
+    freeContractionHierarchy(&hierarchy);
+    if (compiled)
+        unmapRoadTopology(&topology);
+    else
+        freeRoadTopology(&topology);
+    return 0;
+}
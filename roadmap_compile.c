@@ -0,0 +1,23 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "roadmap.h"
+
+/**
+ * Compiles a text roadmap (e.g. tiny_problem) into the binary roadmap format, which the simulation
+ * maps directly into memory instead of parsing. Usage: roadmap_compile <text roadmap> <compiled roadmap>
+ **/
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Error: You need to provide the text roadmap file and the compiled output file as arguments\n");
+        exit(-1);
+    }
+
+    struct RoadTopology topology;
+    parseRoadTopology(argv[1], &topology);
+    writeRoadTopology(argv[2], &topology);
+    printf("Compiled %d junctions and %d roads from '%s' into '%s'\n", topology.num_junctions, topology.num_roads, argv[1], argv[2]);
+    freeRoadTopology(&topology);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "roadmap.h"
+#include "code.h"
+#include "partition.h"
+
+// Number of sampled shortest path trees used to estimate the traffic of the junctions and roads
+#define PARTITION_TRAFFIC_SAMPLES 64
+
+/**
+ * Partitions a roadmap (text or compiled) between map actors and writes the partition file next to it, which the
+ * simulation then loads instead of splitting the junctions into blocks. Usage: roadmap_partition <roadmap> [parts]
+ **/
+int main(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        fprintf(stderr, "Error: You need to provide the roadmap file and optionally the number of parts (default %d) as arguments\n", NUM_MAP_ACTORS);
+        exit(-1);
+    }
+    int numParts = argc == 3 ? atoi(argv[2]) : NUM_MAP_ACTORS;
+    if (numParts < 1)
+    {
+        fprintf(stderr, "Error: The number of parts must be at least 1\n");
+        exit(-1);
+    }
+
+    struct RoadTopology topology;
+    int compiled = mapRoadTopology(argv[1], &topology);
+    if (!compiled)
+        parseRoadTopology(argv[1], &topology);
+
+    clock_t start = clock();
+    struct PartitionGraph graph;
+    buildPartitionGraph(&topology, PARTITION_TRAFFIC_SAMPLES, &graph);
+    int *parts = (int *)malloc(sizeof(int) * (topology.num_junctions > 0 ? topology.num_junctions : 1));
+    partitionGraph(&graph, numParts, 1, parts);
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    char filename[strlen(argv[1]) + strlen(PARTITION_FILE_SUFFIX) + 16];
+    sprintf(filename, "%s%s.%d", argv[1], PARTITION_FILE_SUFFIX, numParts);
+    writeMapPartition(filename, &topology, parts);
+
+    // 划分质量：被切断的边的权重，跨越两个部分的道路数量，以及最重的部分相对平均值的比例
+    int64_t cut;
+    double imbalance;
+    evaluatePartition(&graph, numParts, parts, &cut, &imbalance);
+    int64_t totalEdgeWeight = 0;
+    for (int e = 0; e < graph.offsets[graph.n]; e++)
+    {
+        totalEdgeWeight += graph.edgeWeight[e];
+    }
+    int cutRoads = 0;
+    for (int road = 0; road < topology.num_roads; road++)
+    {
+        if (parts[topology.roadFrom[road]] != parts[topology.roadTo[road]])
+            cutRoads++;
+    }
+    printf("Partitioned %d junctions and %d roads into %d parts in %.2f seconds, written to '%s'\n",
+           topology.num_junctions, topology.num_roads, numParts, seconds, filename);
+    printf("Cut road traffic %ld of %ld, %d of %d roads cross parts, heaviest part is %.3f times the average\n",
+           (long)cut, (long)(totalEdgeWeight / 2), cutRoads, topology.num_roads, imbalance);
+
+    free(parts);
+    freePartitionGraph(&graph);
+    if (compiled)
+        unmapRoadTopology(&topology);
+    else
+        freeRoadTopology(&topology);
+    return 0;
+}
@@ -0,0 +1,655 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "mpi.h"
+#include "roadmap.h"
+#include "code.h"
+#include "function.h"
+#include "heap.h"
+#include "route.h"
+
+// Threads sharing out the items of a batch task, the calling thread takes part as worker zero
+struct RouteThreads
+{
+    int numThreads;
+    pthread_t *threads;
+    struct RouteThreadArg *args;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, done;
+    int generation, busy, stop;
+    void (*task)(struct RoutePlanner *, int, int);
+    int numItems, nextItem;
+};
+
+struct RouteThreadArg
+{
+    struct RoutePlanner *planner;
+    int worker, generation;
+};
+
+static void buildRouteTable(struct RoutePlanner *, struct RouteSearch *, int, int64_t *);
+static int64_t *reserveRouteTable(struct RoutePlanner *, int);
+static int planNext(struct RoutePlanner *, struct RouteWorkspace *, int, int, const int *);
+static int planWithHierarchy(struct RoutePlanner *, struct RouteWorkspace *, int, int, const int *);
+static void initWorkspace(struct RoutePlanner *, struct RouteWorkspace *);
+static void freeWorkspace(struct RoutePlanner *, struct RouteWorkspace *);
+static int compareBatchEntries(const struct RouteBatchEntry *, const struct RouteBatchEntry *);
+static void sortBatchEntries(struct RoutePlanner *, int);
+static void growRouteBatch(struct RoutePlanner *, int);
+static void buildTableTask(struct RoutePlanner *, int, int);
+static void answerQueryTask(struct RoutePlanner *, int, int);
+static void runParallel(struct RoutePlanner *, void (*)(struct RoutePlanner *, int, int), int);
+static void startRouteThreads(struct RoutePlanner *);
+static void stopRouteThreads(struct RoutePlanner *);
+static void *routeThreadMain(void *);
+static void runTaskItems(struct RoutePlanner *, int);
+
+/**
+ * Initialises the planner and the scratch space of its queries. Without a hierarchy this also builds the reverse
+ * adjacency of the topology that the per destination searches run over. Tables are built lazily unless
+ * ROUTE_TABLES_UP_FRONT is set, in which case the cache holds a table for every junction so none is ever evicted
+ **/
+void initRoutePlanner(struct RoutePlanner *planner, const struct RoadTopology *topology, const struct ContractionHierarchy *hierarchy)
+{
+    int num_junctions = topology->num_junctions, num_roads = topology->num_roads;
+    planner->topology = topology;
+    planner->hierarchy = hierarchy;
+    planner->workspaces = NULL;
+    planner->numWorkspaces = 0;
+    planner->tables = NULL;
+    planner->cachedDests = NULL;
+    planner->pinned = NULL;
+    planner->numCached = planner->nextEvict = 0;
+    planner->threads = NULL;
+    planner->batchEntries = planner->batchSorted = NULL;
+    planner->batchUnique = planner->batchBuild = NULL;
+    planner->batchCapacity = 0;
+    planner->maxRoads = 1;
+    for (int i = 0; i < num_junctions; i++)
+    {
+        if (topology->roadOffsets[i + 1] - topology->roadOffsets[i] > planner->maxRoads)
+            planner->maxRoads = topology->roadOffsets[i + 1] - topology->roadOffsets[i];
+    }
+    planner->workspaces = (struct RouteWorkspace *)malloc(sizeof(struct RouteWorkspace));
+    planner->numWorkspaces = 1;
+    initWorkspace(planner, &planner->workspaces[0]);
+    if (hierarchy != NULL || !USE_ROUTE_TABLES)
+        return;
+
+    // 按终点路口统计进入每个路口的道路，构建反向的CSR
+    planner->inOffsets = (int32_t *)calloc(num_junctions + 1, sizeof(int32_t));
+    planner->inRoads = (int32_t *)malloc(sizeof(int32_t) * num_roads);
+    for (int road = 0; road < num_roads; road++)
+    {
+        planner->inOffsets[topology->roadTo[road] + 1]++;
+    }
+    for (int i = 0; i < num_junctions; i++)
+    {
+        planner->inOffsets[i + 1] += planner->inOffsets[i];
+    }
+    int32_t *next = (int32_t *)malloc(sizeof(int32_t) * num_junctions);
+    memcpy(next, planner->inOffsets, sizeof(int32_t) * num_junctions);
+    for (int road = 0; road < num_roads; road++)
+    {
+        planner->inRoads[next[topology->roadTo[road]]++] = road;
+    }
+    free(next);
+
+    planner->tables = (int64_t **)calloc(num_junctions, sizeof(int64_t *));
+    planner->cacheSize = ROUTE_TABLES_UP_FRONT && num_junctions > ROUTE_TABLE_CACHE_SIZE ? num_junctions : ROUTE_TABLE_CACHE_SIZE;
+    planner->cachedDests = (int *)malloc(sizeof(int) * planner->cacheSize);
+    planner->pinned = (char *)calloc(num_junctions, sizeof(char));
+    if (ROUTE_TABLES_UP_FRONT)
+    {
+        for (int dest = 0; dest < num_junctions; dest++)
+        {
+            getRouteTable(planner, dest);
+        }
+    }
+}
+
+/**
+ * Frees the planner and all of its tables, stopping the batch threads if they were started
+ **/
+void freeRoutePlanner(struct RoutePlanner *planner)
+{
+    if (planner->threads != NULL)
+        stopRouteThreads(planner);
+    free(planner->batchEntries);
+    free(planner->batchSorted);
+    free(planner->batchUnique);
+    free(planner->batchBuild);
+    planner->batchCapacity = 0;
+    for (int i = 0; i < planner->numWorkspaces; i++)
+    {
+        freeWorkspace(planner, &planner->workspaces[i]);
+    }
+    free(planner->workspaces);
+    planner->workspaces = NULL;
+    if (planner->hierarchy != NULL || !USE_ROUTE_TABLES)
+        return;
+    for (int i = 0; i < planner->numCached; i++)
+    {
+        free(planner->tables[planner->cachedDests[i]]);
+    }
+    free(planner->tables);
+    free(planner->cachedDests);
+    free(planner->pinned);
+    free(planner->inOffsets);
+    free(planner->inRoads);
+    planner->tables = NULL;
+}
+
+/**
+ * Sizes the batch scratch space up front, so that batches of up to this many queries do not allocate, and starts
+ * the batch threads if batches this large would be shared between them
+ **/
+void reserveRouteBatch(struct RoutePlanner *planner, int capacity)
+{
+    if (capacity > planner->batchCapacity)
+        growRouteBatch(planner, capacity);
+    if (ROUTE_BATCH_THREADS > 1 && capacity >= ROUTE_BATCH_MIN_PARALLEL && planner->threads == NULL)
+        startRouteThreads(planner);
+}
+
+/**
+ * Returns the junction to travel to next from junction to reach dest, or -1 if there is no route. Only the roads
+ * leaving the current junction use their current speed, as in planRoute, so with tables this is the road minimising
+ * its current travel cost plus the static cost from its end to the destination (the first such road on ties)
+ **/
+int planNextJunction(struct RoutePlanner *planner, int junction, int dest, const int *speeds)
+{
+    if (planner->hierarchy == NULL && USE_ROUTE_TABLES && junction != dest)
+        getRouteTable(planner, dest);
+    return planNext(planner, planner->workspaces, junction, dest, speeds);
+}
+
+/**
+ * Answers a batch of next hop queries. The queries are sorted by destination, junction and speeds so that identical
+ * ones sit next to each other and are answered once. With route tables the distinct destinations are then taken in
+ * chunks that fit in the cache: the missing tables of a chunk are built (one per thread) and its queries answered
+ * (shared between the threads), with the chunk's tables pinned so that building one never evicts another. Without
+ * tables the distinct queries are simply shared between the threads, each with its own scratch space
+ **/
+void planNextJunctions(struct RoutePlanner *planner, struct RouteQuery *queries, int numQueries)
+{
+    const struct RoadTopology *topology = planner->topology;
+    if (numQueries > planner->batchCapacity)
+        growRouteBatch(planner, numQueries);
+
+    // 按目的地、路口和道路速度排序，相同的查询相邻，只回答一次
+    struct RouteBatchEntry *entries = planner->batchEntries;
+    for (int i = 0; i < numQueries; i++)
+    {
+        entries[i].dest = queries[i].dest;
+        entries[i].junction = queries[i].junction;
+        entries[i].numRoads = topology->roadOffsets[queries[i].junction + 1] - topology->roadOffsets[queries[i].junction];
+        entries[i].speeds = queries[i].speeds;
+        entries[i].index = i;
+    }
+    sortBatchEntries(planner, numQueries);
+    planner->numBatchUnique = 0;
+    for (int i = 0; i < numQueries; i++)
+    {
+        if (i == 0 || compareBatchEntries(&entries[i - 1], &entries[i]) != 0)
+            planner->batchUnique[planner->numBatchUnique++] = entries[i].index;
+        entries[i].unique = planner->numBatchUnique - 1;
+    }
+    planner->batchQueries = queries;
+
+    if (planner->hierarchy != NULL || !USE_ROUTE_TABLES)
+    {
+        planner->batchFirst = 0;
+        runParallel(planner, answerQueryTask, planner->numBatchUnique);
+    }
+    else
+    {
+        int start = 0;
+        while (start < planner->numBatchUnique)
+        {
+            // 取出目的地数量不超过缓存容量的一段查询，固定这些目的地的表
+            int end = start, num_dests = 0;
+            planner->numBatchBuild = 0;
+            while (end < planner->numBatchUnique)
+            {
+                int dest = queries[planner->batchUnique[end]].dest;
+                if (!planner->pinned[dest])
+                {
+                    if (num_dests == planner->cacheSize)
+                        break;
+                    num_dests++;
+                    planner->pinned[dest] = 1;
+                }
+                // 第一个查询可能已经在目的地，这时目的地已经固定但表还没有建，由之后的查询建表，建表的目的地只加入一次
+                if (planner->tables[dest] == NULL && queries[planner->batchUnique[end]].junction != dest)
+                {
+                    planner->tables[dest] = reserveRouteTable(planner, dest);
+                    planner->batchBuild[planner->numBatchBuild++] = dest;
+                }
+                end++;
+            }
+
+            runParallel(planner, buildTableTask, planner->numBatchBuild);
+            planner->batchFirst = start;
+            runParallel(planner, answerQueryTask, end - start);
+
+            for (int i = start; i < end; i++)
+            {
+                planner->pinned[queries[planner->batchUnique[i]].dest] = 0;
+            }
+            start = end;
+        }
+    }
+
+    for (int i = 0; i < numQueries; i++)
+    {
+        queries[entries[i].index].next = queries[planner->batchUnique[entries[i].unique]].next;
+    }
+}
+
+/**
+ * Returns the static cost table towards dest, building it on first use. When the cache is full the
+ * oldest table is evicted and its memory reused
+ **/
+const int64_t *getRouteTable(struct RoutePlanner *planner, int dest)
+{
+    if (planner->tables[dest] != NULL)
+        return planner->tables[dest];
+
+    int64_t *table = reserveRouteTable(planner, dest);
+    buildRouteTable(planner, &planner->workspaces[0].search, dest, table);
+    planner->tables[dest] = table;
+    return table;
+}
+
+/**
+ * Finds the memory for a new table towards dest, allocating it while the cache has room and otherwise taking that
+ * of the oldest table whose destination is not pinned
+ **/
+static int64_t *reserveRouteTable(struct RoutePlanner *planner, int dest)
+{
+    int64_t *table;
+    if (planner->numCached < planner->cacheSize)
+    {
+        table = (int64_t *)malloc(sizeof(int64_t) * planner->topology->num_junctions);
+        planner->cachedDests[planner->numCached++] = dest;
+    }
+    else
+    {
+        while (planner->pinned[planner->cachedDests[planner->nextEvict]])
+        {
+            planner->nextEvict = (planner->nextEvict + 1) % planner->cacheSize;
+        }
+        int evicted = planner->cachedDests[planner->nextEvict];
+        table = planner->tables[evicted];
+        planner->tables[evicted] = NULL;
+        planner->cachedDests[planner->nextEvict] = dest;
+        planner->nextEvict = (planner->nextEvict + 1) % planner->cacheSize;
+    }
+    return table;
+}
+
+/**
+ * Reverse Dijkstra from the destination over the roads entering each junction, using the static maximum speed costs.
+ * The heap of the search scratch space is borrowed, ordered by the table itself while it is built
+ **/
+static void buildRouteTable(struct RoutePlanner *planner, struct RouteSearch *search, int dest, int64_t *dist)
+{
+    const struct RoadTopology *topology = planner->topology;
+    for (int i = 0; i < topology->num_junctions; i++)
+    {
+        dist[i] = ROUTE_INFINITY;
+    }
+    dist[dest] = 0;
+    struct IndexedHeap *heap = &search->heap;
+    heap->keys = dist;
+    heapPush(heap, dest);
+    while (heap->size > 0)
+    {
+        int v_idx = heapPop(heap);
+        for (int i = planner->inOffsets[v_idx]; i < planner->inOffsets[v_idx + 1]; i++)
+        {
+            int road = planner->inRoads[i];
+            int from_idx = topology->roadFrom[road];
+            int64_t alt = dist[v_idx] + getTravelCost(topology->roadLength[road], topology->roadMaxSpeed[road]);
+            if (alt < dist[from_idx])
+            {
+                dist[from_idx] = alt;
+                heapPush(heap, from_idx);
+            }
+        }
+    }
+    heap->keys = search->dist;
+}
+
+/**
+ * Answers a next hop query with the given scratch space. With route tables the table towards dest must already be
+ * built (unless junction is dest), so that concurrent queries only ever read the cache
+ **/
+static int planNext(struct RoutePlanner *planner, struct RouteWorkspace *workspace, int junction, int dest, const int *speeds)
+{
+    if (planner->hierarchy != NULL)
+        return planWithHierarchy(planner, workspace, junction, dest, speeds);
+    if (!USE_ROUTE_TABLES)
+        return planRoute(junction, dest, planner->topology, speeds, &workspace->search);
+    if (junction == dest)
+        return -1;
+
+    const struct RoadTopology *topology = planner->topology;
+    const int64_t *table = planner->tables[dest];
+    int64_t best = ROUTE_INFINITY;
+    int next_jnct = -1;
+    for (int road = topology->roadOffsets[junction]; road < topology->roadOffsets[junction + 1]; road++)
+    {
+        int to = topology->roadTo[road];
+        if (table[to] == ROUTE_INFINITY)
+            continue;
+        int speed = speeds != NULL ? speeds[road - topology->roadOffsets[junction]] : topology->roadMaxSpeed[road];
+        int64_t cost = getTravelCost(topology->roadLength[road], speed) + table[to];
+        if (cost < best)
+        {
+            best = cost;
+            next_jnct = to;
+        }
+    }
+
+    // 如果最优的路口在静态代价上没有更接近目的地，它的最短路径可能绕回当前路口（而当前路口的道路应该使用当前速度），
+    // 这时表中的代价不准确，退回到完整的搜索。否则它的代价是准确的，而其他道路的代价只会被低估，所以它就是最优的
+    if (next_jnct != -1 && table[next_jnct] >= table[junction])
+        return planRoute(junction, dest, topology, speeds, &workspace->search);
+    return next_jnct;
+}
+
+/**
+ * Answers a next hop query with the hierarchy. The forward search is seeded with the end of every road leaving the
+ * junction at the current travel cost of that road, so its result is the same as with a route table. The same check
+ * for routes looping back through the junction applies, comparing the static costs of the chosen junction and the
+ * current junction (each found by a further query)
+ **/
+static int planWithHierarchy(struct RoutePlanner *planner, struct RouteWorkspace *workspace, int junction, int dest, const int *speeds)
+{
+    if (junction == dest)
+        return -1;
+
+    const struct RoadTopology *topology = planner->topology;
+    int num_seeds = 0;
+    for (int road = topology->roadOffsets[junction]; road < topology->roadOffsets[junction + 1]; road++)
+    {
+        int speed = speeds != NULL ? speeds[road - topology->roadOffsets[junction]] : topology->roadMaxSpeed[road];
+        workspace->seeds[num_seeds] = topology->roadTo[road];
+        workspace->seedCosts[num_seeds++] = getTravelCost(topology->roadLength[road], speed);
+    }
+
+    int next_jnct, first;
+    int64_t best = queryHierarchy(&workspace->query, workspace->seeds, workspace->seedCosts, num_seeds, dest, &next_jnct);
+    if (next_jnct == -1)
+        return -1;
+
+    // 计算选中路口和当前路口到目的地的静态代价
+    int64_t seed_cost = ROUTE_INFINITY, zero = 0;
+    for (int i = 0; i < num_seeds; i++)
+    {
+        if (workspace->seeds[i] == next_jnct && workspace->seedCosts[i] < seed_cost)
+            seed_cost = workspace->seedCosts[i];
+    }
+    int64_t from_current = queryHierarchy(&workspace->query, &junction, &zero, 1, dest, &first);
+    if (best - seed_cost >= from_current)
+        return planRoute(junction, dest, topology, speeds, &workspace->search);
+    return next_jnct;
+}
+
+/**
+ * Allocates the scratch space of searches over the topology's junctions
+ **/
+void initRouteSearch(struct RouteSearch *search, int num_junctions)
+{
+    search->dist = (int64_t *)malloc(sizeof(int64_t) * num_junctions);
+    search->settled = (char *)calloc(num_junctions, sizeof(char));
+    search->prev = (int *)malloc(sizeof(int) * num_junctions);
+    search->touched = (int *)malloc(sizeof(int) * num_junctions);
+    search->numTouched = 0;
+    for (int i = 0; i < num_junctions; i++)
+    {
+        search->dist[i] = ROUTE_INFINITY;
+        search->prev[i] = -1;
+    }
+    heapInit(&search->heap, num_junctions, search->dist);
+}
+
+/**
+ * Frees the scratch space of searches
+ **/
+void freeRouteSearch(struct RouteSearch *search)
+{
+    heapFree(&search->heap);
+    free(search->dist);
+    free(search->settled);
+    free(search->prev);
+    free(search->touched);
+}
+
+/**
+ * Allocates the scratch space of one thread, with room for a seed per road of the busiest junction when there is
+ * a hierarchy
+ **/
+static void initWorkspace(struct RoutePlanner *planner, struct RouteWorkspace *workspace)
+{
+    initRouteSearch(&workspace->search, planner->topology->num_junctions);
+    if (planner->hierarchy == NULL)
+        return;
+    workspace->seeds = (int *)malloc(sizeof(int) * planner->maxRoads);
+    workspace->seedCosts = (int64_t *)malloc(sizeof(int64_t) * planner->maxRoads);
+    initHierarchyQuery(&workspace->query, planner->hierarchy);
+}
+
+static void freeWorkspace(struct RoutePlanner *planner, struct RouteWorkspace *workspace)
+{
+    freeRouteSearch(&workspace->search);
+    if (planner->hierarchy == NULL)
+        return;
+    freeHierarchyQuery(&workspace->query);
+    free(workspace->seeds);
+    free(workspace->seedCosts);
+}
+
+/**
+ * Grows the batch scratch space to hold this many queries
+ **/
+static void growRouteBatch(struct RoutePlanner *planner, int capacity)
+{
+    planner->batchCapacity = capacity;
+    planner->batchEntries = (struct RouteBatchEntry *)realloc(planner->batchEntries, sizeof(struct RouteBatchEntry) * capacity);
+    planner->batchSorted = (struct RouteBatchEntry *)realloc(planner->batchSorted, sizeof(struct RouteBatchEntry) * capacity);
+    planner->batchUnique = (int *)realloc(planner->batchUnique, sizeof(int) * capacity);
+    planner->batchBuild = (int *)realloc(planner->batchBuild, sizeof(int) * capacity);
+}
+
+/**
+ * Orders batch entries by destination, junction and then the speeds of the junction's roads (no speeds first)
+ **/
+static int compareBatchEntries(const struct RouteBatchEntry *x, const struct RouteBatchEntry *y)
+{
+    if (x->dest != y->dest)
+        return x->dest < y->dest ? -1 : 1;
+    if (x->junction != y->junction)
+        return x->junction < y->junction ? -1 : 1;
+    if (x->speeds == NULL || y->speeds == NULL)
+        return (x->speeds != NULL) - (y->speeds != NULL);
+    return memcmp(x->speeds, y->speeds, sizeof(int) * x->numRoads);
+}
+
+/**
+ * Bottom up merge sort of the first n batch entries, using the second entry array rather than allocating as qsort may
+ **/
+static void sortBatchEntries(struct RoutePlanner *planner, int n)
+{
+    struct RouteBatchEntry *from = planner->batchEntries, *to = planner->batchSorted;
+    for (int width = 1; width < n; width *= 2)
+    {
+        for (int start = 0; start < n; start += 2 * width)
+        {
+            int mid = start + width < n ? start + width : n;
+            int end = start + 2 * width < n ? start + 2 * width : n;
+            int i = start, j = mid, k = start;
+            while (i < mid && j < end)
+            {
+                to[k++] = compareBatchEntries(&from[j], &from[i]) < 0 ? from[j++] : from[i++];
+            }
+            while (i < mid)
+                to[k++] = from[i++];
+            while (j < end)
+                to[k++] = from[j++];
+        }
+        struct RouteBatchEntry *swap = from;
+        from = to;
+        to = swap;
+    }
+    planner->batchEntries = from;
+    planner->batchSorted = to;
+}
+
+static void buildTableTask(struct RoutePlanner *planner, int worker, int item)
+{
+    int dest = planner->batchBuild[item];
+    buildRouteTable(planner, &planner->workspaces[worker].search, dest, planner->tables[dest]);
+}
+
+static void answerQueryTask(struct RoutePlanner *planner, int worker, int item)
+{
+    struct RouteQuery *query = &planner->batchQueries[planner->batchUnique[planner->batchFirst + item]];
+    query->next = planNext(planner, &planner->workspaces[worker], query->junction, query->dest, query->speeds);
+}
+
+/**
+ * Runs the task over items [0, numItems), sharing them out between the batch threads (if reserveRouteBatch started
+ * them) when there are enough to be worth it. Returns once every item is done
+ **/
+static void runParallel(struct RoutePlanner *planner, void (*task)(struct RoutePlanner *, int, int), int numItems)
+{
+    if (planner->threads == NULL || numItems < ROUTE_BATCH_MIN_PARALLEL)
+    {
+        for (int i = 0; i < numItems; i++)
+        {
+            task(planner, 0, i);
+        }
+        return;
+    }
+
+    struct RouteThreads *threads = planner->threads;
+    pthread_mutex_lock(&threads->lock);
+    threads->task = task;
+    threads->numItems = numItems;
+    threads->nextItem = 0;
+    threads->busy = threads->numThreads - 1;
+    threads->generation++;
+    pthread_cond_broadcast(&threads->wake);
+    pthread_mutex_unlock(&threads->lock);
+
+    runTaskItems(planner, 0);
+
+    pthread_mutex_lock(&threads->lock);
+    while (threads->busy > 0)
+    {
+        pthread_cond_wait(&threads->done, &threads->lock);
+    }
+    pthread_mutex_unlock(&threads->lock);
+}
+
+/**
+ * Starts ROUTE_BATCH_THREADS - 1 threads (the caller is the remaining one), each with its own scratch space
+ **/
+static void startRouteThreads(struct RoutePlanner *planner)
+{
+    struct RouteThreads *threads = (struct RouteThreads *)malloc(sizeof(struct RouteThreads));
+    threads->numThreads = ROUTE_BATCH_THREADS;
+    threads->threads = (pthread_t *)malloc(sizeof(pthread_t) * ROUTE_BATCH_THREADS);
+    threads->args = (struct RouteThreadArg *)malloc(sizeof(struct RouteThreadArg) * ROUTE_BATCH_THREADS);
+    threads->generation = threads->busy = threads->stop = 0;
+    pthread_mutex_init(&threads->lock, NULL);
+    pthread_cond_init(&threads->wake, NULL);
+    pthread_cond_init(&threads->done, NULL);
+    planner->threads = threads;
+
+    planner->workspaces = (struct RouteWorkspace *)realloc(planner->workspaces, sizeof(struct RouteWorkspace) * ROUTE_BATCH_THREADS);
+    for (int i = planner->numWorkspaces; i < ROUTE_BATCH_THREADS; i++)
+    {
+        initWorkspace(planner, &planner->workspaces[i]);
+    }
+    planner->numWorkspaces = ROUTE_BATCH_THREADS;
+    for (int i = 1; i < ROUTE_BATCH_THREADS; i++)
+    {
+        threads->args[i].planner = planner;
+        threads->args[i].worker = i;
+        threads->args[i].generation = threads->generation;
+        pthread_create(&threads->threads[i], NULL, routeThreadMain, &threads->args[i]);
+    }
+}
+
+static void stopRouteThreads(struct RoutePlanner *planner)
+{
+    struct RouteThreads *threads = planner->threads;
+    pthread_mutex_lock(&threads->lock);
+    threads->stop = 1;
+    pthread_cond_broadcast(&threads->wake);
+    pthread_mutex_unlock(&threads->lock);
+    for (int i = 1; i < threads->numThreads; i++)
+    {
+        pthread_join(threads->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&threads->lock);
+    pthread_cond_destroy(&threads->wake);
+    pthread_cond_destroy(&threads->done);
+    free(threads->threads);
+    free(threads->args);
+    free(threads);
+    planner->threads = NULL;
+}
+
+/**
+ * Batch threads sleep until a new task is posted, take part in it and report back once there are no items left
+ **/
+static void *routeThreadMain(void *arg)
+{
+    struct RouteThreadArg *threadArg = (struct RouteThreadArg *)arg;
+    struct RouteThreads *threads = threadArg->planner->threads;
+    // 线程启动之前可能已经发布了任务，所以从创建时的任务编号开始等待
+    int seen = threadArg->generation;
+    pthread_mutex_lock(&threads->lock);
+    while (1 == 1)
+    {
+        while (threads->generation == seen && !threads->stop)
+        {
+            pthread_cond_wait(&threads->wake, &threads->lock);
+        }
+        if (threads->stop)
+            break;
+        seen = threads->generation;
+        pthread_mutex_unlock(&threads->lock);
+
+        runTaskItems(threadArg->planner, threadArg->worker);
+
+        pthread_mutex_lock(&threads->lock);
+        threads->busy--;
+        if (threads->busy == 0)
+            pthread_cond_signal(&threads->done);
+    }
+    pthread_mutex_unlock(&threads->lock);
+    return NULL;
+}
+
+/**
+ * Claims items of the current task one at a time until they are all taken
+ **/
+static void runTaskItems(struct RoutePlanner *planner, int worker)
+{
+    struct RouteThreads *threads = planner->threads;
+    while (1 == 1)
+    {
+        int item = __atomic_fetch_add(&threads->nextItem, 1, __ATOMIC_RELAXED);
+        if (item >= threads->numItems)
+            break;
+        threads->task(planner, worker, item);
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef ROUTE_H_
+#define ROUTE_H_
+
+#include <stdint.h>
+#include "ch.h"
+
+// Scratch space of a single source search (planRoute and the route table builds), only the junctions touched by
+// a search are reset afterwards
+struct RouteSearch {
+	int64_t *dist;
+	char *settled;
+	int *prev, *touched;
+	int numTouched;
+	struct IndexedHeap heap;
+};
+
+// Scratch space of one thread answering next hop queries, sized from the map when the planner is created. The
+// hierarchy query and its seeds (one per road leaving a junction) are only allocated when there is a hierarchy
+struct RouteWorkspace {
+	struct RouteSearch search;
+	struct HierarchyQuery query;
+	int *seeds;
+	int64_t *seedCosts;
+};
+
+// One query of a batch, the speeds are those of the roads leaving the junction as for planNextJunction (or NULL)
+// and the next junction is filled in by planNextJunctions
+struct RouteQuery {
+	int junction, dest;
+	const int *speeds;
+	int next;
+};
+
+// Sort entry of a batch, used to group its queries by destination and find identical ones
+struct RouteBatchEntry {
+	int dest, junction, numRoads, index, unique;
+	const int *speeds;
+};
+
+struct RouteThreads;
+
+// Answers next hop queries for all the vehicles of an actor. With route tables enabled it keeps, per destination,
+// the static (maximum speed) travel cost from every junction to that destination, built lazily by a reverse
+// Dijkstra and shared by every vehicle heading there. A next hop is then just the best of the junction's roads.
+// When a contraction hierarchy is available it is used instead, answering each query by a bidirectional search
+struct RoutePlanner {
+	const struct RoadTopology *topology;
+	// Contraction hierarchy (NULL if there is none) and the scratch space of queries, one per batch thread (only
+	// the first is allocated unless batches large enough to share out are reserved)
+	const struct ContractionHierarchy *hierarchy;
+	struct RouteWorkspace *workspaces;
+	int numWorkspaces, maxRoads;
+	// Reverse adjacency, the roads entering junction i are inRoads[inOffsets[i]] to inRoads[inOffsets[i+1]-1]
+	int32_t *inOffsets, *inRoads;
+	// Per destination cost tables, NULL until built, at most cacheSize are kept (ROUTE_TABLE_CACHE_SIZE, or every
+	// junction with ROUTE_TABLES_UP_FRONT). Tables of pinned destinations are needed by the batch being answered and are
+	// never evicted
+	int64_t **tables;
+	int *cachedDests;
+	int cacheSize, numCached, nextEvict;
+	char *pinned;
+	// Threads answering batches, started by the first batch large enough to share out
+	struct RouteThreads *threads;
+	// Scratch space of batches, sized by reserveRouteBatch and grown (counted as a heap allocation) past it
+	struct RouteBatchEntry *batchEntries, *batchSorted;
+	int *batchUnique, *batchBuild;
+	int batchCapacity, numBatchUnique, numBatchBuild, batchFirst;
+	struct RouteQuery *batchQueries;
+};
+
+// Initialises the planner over the topology and optional hierarchy, building every table up front and keeping them all
+// if ROUTE_TABLES_UP_FRONT is set (tables are not used with a hierarchy)
+void initRoutePlanner(struct RoutePlanner *, const struct RoadTopology *, const struct ContractionHierarchy *);
+// Frees the planner, all of its tables and stops its batch threads
+void freeRoutePlanner(struct RoutePlanner *);
+// Sizes the batch scratch space for batches of up to this many queries, starting the batch threads if such
+// batches are large enough to share out
+void reserveRouteBatch(struct RoutePlanner *, int);
+// Returns the junction to travel to next from the first junction to reach the second, or -1 if there is no route.
+// The speeds are the current speeds of the roads leaving the first junction, or NULL to use their maximum speed
+int planNextJunction(struct RoutePlanner *, int, int, const int *);
+// Answers a batch of next hop queries together, giving the same results as planNextJunction. Identical queries
+// are answered once, queries are grouped by destination and large batches are shared between the batch threads
+void planNextJunctions(struct RoutePlanner *, struct RouteQuery *, int);
+// Returns the static cost table towards a destination, building it if needed
+const int64_t *getRouteTable(struct RoutePlanner *, int);
+// Allocates the scratch space of searches over this many junctions
+void initRouteSearch(struct RouteSearch *, int);
+// Frees the scratch space of searches
+void freeRouteSearch(struct RouteSearch *);
+
+#endif /* ROUTE_H_ */
@@ -0,0 +1,532 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "mpi.h"
+#include "pool.h"
+#include "steal.h"
+
+// MPI P2P tags of the work stealing scheduler, which communicates on its own duplicate of MPI_COMM_WORLD so that
+// actors probing for any tag never see its messages
+#define WS_COMMAND_TAG 1
+#define WS_REPORT_TAG 2
+// After a failed steal an idle rank waits before trying another victim, the wait doubles up to the maximum and is
+// reset once a steal succeeds. Idle ranks sleep for the poll interval whenever there is no message for them
+#define WS_StealBackoffMin 0.0001
+#define WS_StealBackoffMax 0.01
+#define WS_PollInterval 0.00005
+// A rank asks the application to throttle start requests once its deque holds more tasks than this
+#define WS_DequePressure 256
+#define WS_DEBUG 0
+
+// Message between the ranks. A task carries its payload and how long it has waited so far, so that its start latency
+// is measured without comparing clocks across nodes, and the termination token carries its count and colour
+struct WS_Message {
+	int command;
+	int data;
+	int color;
+	double age;
+};
+
+// A task in a rank's deque, the owner runs the newest from the bottom and thieves take the oldest from the top
+struct WS_Task {
+	int payload;
+	char queued;
+	double queuedAt;
+};
+
+enum WS_Color {WS_WHITE=0, WS_BLACK=1};
+
+static MPI_Comm WS_comm = MPI_COMM_NULL;
+static int WS_rank, WS_size;
+static unsigned int WS_seed;
+// Ring buffer holding this rank's deque
+static struct WS_Task *WS_deque = NULL;
+static int WS_dequeCapacity = 0, WS_dequeTop = 0, WS_dequeSize = 0;
+static int WS_taskData = 0;
+static int WS_running = 0;
+static int WS_stealPending = 0;
+static double WS_backoff = WS_StealBackoffMin, WS_nextSteal = 0;
+static int WS_stopped = 0;
+// Until its first poll the root hands the tasks it starts to ranks 1, 2, ... in order, so the initial actors are placed
+// on the same ranks as with the master scheduler
+static int WS_seeding = 1, WS_nextSeed = 1;
+static int WS_runComplete = 0;
+// Safra's termination detection. The counter is the number of task messages this rank has sent less the number it has
+// received, and a rank turns black when it receives one. The token travels the ring of ranks and is only passed on by
+// idle ranks, the root announces termination once the token returns white with a total count of zero
+static int WS_counter = 0;
+static int WS_color = WS_WHITE;
+static int WS_haveToken = 0, WS_tokenCount = 0, WS_tokenColor = WS_WHITE;
+static struct PP_Statistics WS_statistics;
+
+static int acquireTask();
+static void runTask(struct WS_Task *);
+static void receiveTask(struct WS_Message *);
+static void handleMessage(struct WS_Message *, int);
+static void serveMessages();
+static void sendMessage(int, enum PP_Control_Command, int, int, double);
+static int checkTermination();
+static void passToken();
+static int randomVictim();
+static void idleWait();
+static void pushTask(int, char, double);
+static int popTask(struct WS_Task *);
+static int takeOldestTask(struct WS_Task *);
+static void errorMessage(char *);
+
+/**
+ * Initialises the scheduler, returning two on the root as the process pool does. Every other rank waits for the root to
+ * hand it an initial task or tell it that there is none, and then runs tasks or steals until one is found
+ */
+int stealingInit()
+{
+	MPI_Comm_dup(MPI_COMM_WORLD, &WS_comm);
+	MPI_Comm_rank(WS_comm, &WS_rank);
+	MPI_Comm_size(WS_comm, &WS_size);
+	WS_seed = (unsigned int)time(NULL) ^ (2654435761u * (unsigned int)(WS_rank + 1));
+	WS_statistics.numWorkers = WS_rank == 0 ? 0 : 1;
+	if (WS_rank == 0)
+	{
+		if (WS_size < 2)
+			errorMessage("No worker processes available for pool, run with more than one MPI process");
+		// 第一轮终止检测在主进程第一次轮询时发起
+		WS_haveToken = 1;
+		WS_tokenColor = WS_BLACK;
+		return 2;
+	}
+
+	struct WS_Message message;
+	MPI_Recv(&message, sizeof(message), MPI_BYTE, 0, WS_COMMAND_TAG, WS_comm, MPI_STATUS_IGNORE);
+	if (message.command == PP_WAKE)
+		receiveTask(&message);
+	return acquireTask();
+}
+
+/**
+ * Stops every rank and frees the scheduler, collective over MPI_COMM_WORLD
+ */
+void stealingFinalise()
+{
+	int rank;
+	if (WS_rank == 0)
+	{
+		for (rank = 1; rank < WS_size; rank++)
+			sendMessage(rank, PP_STOP, 0, 0, 0);
+	}
+	MPI_Barrier(WS_comm);
+
+	// 丢弃停止之前发出但还没有被接收的窃取请求和回复
+	int flag;
+	MPI_Status status;
+	MPI_Iprobe(MPI_ANY_SOURCE, WS_COMMAND_TAG, WS_comm, &flag, &status);
+	while (flag)
+	{
+		struct WS_Message message;
+		MPI_Recv(&message, sizeof(message), MPI_BYTE, status.MPI_SOURCE, WS_COMMAND_TAG, WS_comm, MPI_STATUS_IGNORE);
+		MPI_Iprobe(MPI_ANY_SOURCE, WS_COMMAND_TAG, WS_comm, &flag, &status);
+	}
+	MPI_Comm_free(&WS_comm);
+	free(WS_deque);
+	WS_deque = NULL;
+}
+
+/**
+ * Called by the root in a loop. The root runs no tasks, it ends seeding on its first call and then serves steals from
+ * the tasks it started and drives termination detection. Returns zero once a rank shut the pool down or every rank is
+ * idle with an empty deque
+ */
+int stealingMasterPoll()
+{
+	if (WS_rank != 0)
+		errorMessage("Worker process called master poll");
+	if (WS_seeding)
+	{
+		// 没有分配到初始任务的进程开始窃取
+		int rank;
+		WS_seeding = 0;
+		for (rank = WS_nextSeed; rank < WS_size; rank++)
+			sendMessage(rank, PP_NOTASK, 0, 0, 0);
+	}
+	if (WS_runComplete || checkTermination())
+		return 0;
+
+	struct WS_Message message;
+	MPI_Status status;
+	MPI_Recv(&message, sizeof(message), MPI_BYTE, MPI_ANY_SOURCE, WS_COMMAND_TAG, WS_comm, &status);
+	handleMessage(&message, status.MPI_SOURCE);
+	return !WS_runComplete && !checkTermination();
+}
+
+/**
+ * Called by a rank once its task has finished, runs the next task from its own deque or steals one. Returns zero once
+ * the pool has been stopped
+ */
+int stealingWorkerSleep()
+{
+	if (WS_rank == 0)
+		errorMessage("Master process called worker poll");
+	WS_running = 0;
+	WS_statistics.numActive = 0;
+	return acquireTask();
+}
+
+/**
+ * Called by a running task, serves the steal requests that arrived meanwhile and returns one once the pool has been
+ * stopped
+ */
+int stealingShouldWorkerStop()
+{
+	serveMessages();
+	return WS_stopped;
+}
+
+/**
+ * Serves the steal requests that arrived while the task was running
+ */
+void stealingProgress()
+{
+	serveMessages();
+}
+
+/**
+ * Pushes the tasks onto the caller's deque, they are run by the caller once its current task finishes or stolen by an
+ * idle rank before then. While seeding the root sends them straight to the next rank instead. Writes the rank each
+ * task was placed on to ranks_out
+ */
+int stealingStartWorkers(int n, int *ranks_out, const int *payloads)
+{
+	double now = MPI_Wtime();
+	int i;
+	for (i = 0; i < n; i++)
+	{
+		if (WS_rank == 0 && WS_seeding && WS_nextSeed < WS_size)
+		{
+			sendMessage(WS_nextSeed, PP_WAKE, payloads[i], 0, 0);
+			WS_counter++;
+			ranks_out[i] = WS_nextSeed++;
+		}
+		else
+		{
+			pushTask(payloads[i], 1, now);
+			WS_statistics.numQueued++;
+			ranks_out[i] = WS_rank;
+		}
+	}
+	return n;
+}
+
+int stealingIsBackpressured()
+{
+	return WS_dequeSize > WS_DequePressure;
+}
+
+/**
+ * Asks the root to shut the pool down
+ */
+void stealingShutdown()
+{
+	if (WS_rank != 0)
+	{
+		if (WS_DEBUG)
+			printf("[Worker %d] Commanding a pool shutdown\n", WS_rank);
+		sendMessage(0, PP_RUNCOMPLETE, 0, 0, 0);
+	}
+}
+
+int stealingCommandData()
+{
+	return WS_taskData;
+}
+
+/**
+ * Called by the root, collects the counters of every rank. The ranks answer while idle or from within a running task,
+ * and the root serves steals while it waits
+ */
+void stealingStatistics(struct PP_Statistics *statistics)
+{
+	if (WS_rank != 0)
+		errorMessage("Worker process requested pool statistics");
+	*statistics = WS_statistics;
+	statistics->backlogDepth = WS_dequeSize;
+	int rank;
+	for (rank = 1; rank < WS_size; rank++)
+	{
+		struct PP_Statistics rankStatistics;
+		MPI_Request request;
+		int flag = 0;
+		MPI_Irecv(&rankStatistics, sizeof(rankStatistics), MPI_BYTE, rank, WS_REPORT_TAG, WS_comm, &request);
+		sendMessage(rank, PP_REPORT, 0, 0, 0);
+		while (!flag)
+		{
+			serveMessages();
+			MPI_Test(&request, &flag, MPI_STATUS_IGNORE);
+			if (!flag)
+				idleWait();
+		}
+		statistics->numWorkers += rankStatistics.numWorkers;
+		statistics->numActive += rankStatistics.numActive;
+		statistics->highWaterMark += rankStatistics.highWaterMark;
+		statistics->numStarts += rankStatistics.numStarts;
+		statistics->totalStartLatency += rankStatistics.totalStartLatency;
+		if (rankStatistics.maxStartLatency > statistics->maxStartLatency)
+			statistics->maxStartLatency = rankStatistics.maxStartLatency;
+		statistics->backlogDepth += rankStatistics.backlogDepth;
+		statistics->maxBacklogDepth += rankStatistics.maxBacklogDepth;
+		statistics->numQueued += rankStatistics.numQueued;
+		statistics->totalQueueWait += rankStatistics.totalQueueWait;
+		if (rankStatistics.maxQueueWait > statistics->maxQueueWait)
+			statistics->maxQueueWait = rankStatistics.maxQueueWait;
+		statistics->numSteals += rankStatistics.numSteals;
+		statistics->numFailedSteals += rankStatistics.numFailedSteals;
+	}
+}
+
+/**
+ * Idle loop of a rank. Steal requests that arrived during the last task are served first, so thieves take the oldest
+ * tasks, then the rank runs the newest task of its own deque if there is one and otherwise steals from random victims.
+ * The termination token is only passed on from here, while the rank is idle
+ */
+static int acquireTask()
+{
+	while (1 == 1)
+	{
+		serveMessages();
+		if (WS_stopped)
+			return 0;
+		struct WS_Task task;
+		if (popTask(&task))
+		{
+			runTask(&task);
+			return 1;
+		}
+		if (WS_haveToken)
+			passToken();
+		if (!WS_stealPending && MPI_Wtime() >= WS_nextSteal)
+		{
+			sendMessage(randomVictim(), PP_STEAL, 0, 0, 0);
+			WS_stealPending = 1;
+		}
+		idleWait();
+	}
+}
+
+/**
+ * Makes the task the rank's current one, its payload is what getCommandData returns
+ */
+static void runTask(struct WS_Task *task)
+{
+	double wait = MPI_Wtime() - task->queuedAt;
+	WS_taskData = task->payload;
+	WS_running = 1;
+	WS_statistics.numActive = 1;
+	WS_statistics.highWaterMark = 1;
+	WS_statistics.numStarts++;
+	WS_statistics.totalStartLatency += wait;
+	if (wait > WS_statistics.maxStartLatency)
+		WS_statistics.maxStartLatency = wait;
+	if (task->queued)
+	{
+		WS_statistics.totalQueueWait += wait;
+		if (wait > WS_statistics.maxQueueWait)
+			WS_statistics.maxQueueWait = wait;
+	}
+	if (WS_DEBUG)
+		printf("[Worker %d] Running task with data %d after %.1f us\n", WS_rank, task->payload, 1e6 * wait);
+}
+
+/**
+ * A task sent by the root while seeding or by a victim, which is counted for termination detection
+ */
+static void receiveTask(struct WS_Message *message)
+{
+	WS_counter--;
+	WS_color = WS_BLACK;
+	pushTask(message->data, message->command == PP_TASK, MPI_Wtime() - message->age);
+}
+
+static void handleMessage(struct WS_Message *message, int source)
+{
+	if (message->command == PP_STEAL)
+	{
+		// 把最早的任务交给窃取者，没有任务时回复PP_NOTASK
+		struct WS_Task task;
+		if (takeOldestTask(&task))
+		{
+			sendMessage(source, PP_TASK, task.payload, 0, MPI_Wtime() - task.queuedAt);
+			WS_counter++;
+			if (WS_DEBUG)
+				printf("[Worker %d] Task with data %d stolen by %d\n", WS_rank, task.payload, source);
+		}
+		else
+		{
+			sendMessage(source, PP_NOTASK, 0, 0, 0);
+		}
+	}
+	else if (message->command == PP_TASK || message->command == PP_WAKE)
+	{
+		if (message->command == PP_TASK)
+		{
+			WS_stealPending = 0;
+			WS_backoff = WS_StealBackoffMin;
+			WS_statistics.numSteals++;
+		}
+		receiveTask(message);
+	}
+	else if (message->command == PP_NOTASK)
+	{
+		// 窃取失败后等待一段时间再尝试下一个进程，连续失败时等待时间加倍
+		WS_stealPending = 0;
+		WS_statistics.numFailedSteals++;
+		WS_nextSteal = MPI_Wtime() + WS_backoff;
+		WS_backoff = WS_backoff * 2 < WS_StealBackoffMax ? WS_backoff * 2 : WS_StealBackoffMax;
+	}
+	else if (message->command == PP_TOKEN)
+	{
+		WS_haveToken = 1;
+		WS_tokenCount = message->data;
+		WS_tokenColor = message->color;
+	}
+	else if (message->command == PP_REPORT)
+	{
+		WS_statistics.backlogDepth = WS_dequeSize;
+		MPI_Send(&WS_statistics, sizeof(WS_statistics), MPI_BYTE, source, WS_REPORT_TAG, WS_comm);
+	}
+	else if (message->command == PP_RUNCOMPLETE)
+	{
+		WS_runComplete = 1;
+	}
+	else if (message->command == PP_STOP)
+	{
+		WS_stopped = 1;
+	}
+	else
+	{
+		errorMessage("Unexpected work stealing command");
+	}
+}
+
+/**
+ * Handles every message that has arrived without waiting for more
+ */
+static void serveMessages()
+{
+	int flag;
+	MPI_Status status;
+	MPI_Iprobe(MPI_ANY_SOURCE, WS_COMMAND_TAG, WS_comm, &flag, &status);
+	while (flag)
+	{
+		struct WS_Message message;
+		MPI_Recv(&message, sizeof(message), MPI_BYTE, status.MPI_SOURCE, WS_COMMAND_TAG, WS_comm, MPI_STATUS_IGNORE);
+		handleMessage(&message, status.MPI_SOURCE);
+		MPI_Iprobe(MPI_ANY_SOURCE, WS_COMMAND_TAG, WS_comm, &flag, &status);
+	}
+}
+
+static void sendMessage(int rank, enum PP_Control_Command command, int data, int color, double age)
+{
+	struct WS_Message message;
+	message.command = command;
+	message.data = data;
+	message.color = color;
+	message.age = age;
+	MPI_Send(&message, sizeof(message), MPI_BYTE, rank, WS_COMMAND_TAG, WS_comm);
+}
+
+/**
+ * Called by the root, which counts as idle while its deque is empty. Once the token has come back it either announces
+ * termination or starts another round, the root's own colour and counter complete the token's
+ */
+static int checkTermination()
+{
+	if (!WS_haveToken || WS_dequeSize > 0)
+		return 0;
+	if (WS_tokenColor == WS_WHITE && WS_color == WS_WHITE && WS_tokenCount + WS_counter == 0)
+	{
+		if (WS_DEBUG)
+			printf("[Master] Every rank is idle, terminating\n");
+		return 1;
+	}
+	WS_haveToken = 0;
+	WS_color = WS_WHITE;
+	sendMessage(1 % WS_size, PP_TOKEN, 0, WS_WHITE, 0);
+	return 0;
+}
+
+/**
+ * Passes the token on to the next rank of the ring, adding this rank's counter and blackening it if the rank received
+ * a task since it last passed the token
+ */
+static void passToken()
+{
+	sendMessage((WS_rank + 1) % WS_size, PP_TOKEN, WS_tokenCount + WS_counter, WS_color == WS_BLACK ? WS_BLACK : WS_tokenColor, 0);
+	WS_haveToken = 0;
+	WS_color = WS_WHITE;
+}
+
+/**
+ * Any rank other than the caller, the root included as it holds the tasks it started once seeding is over
+ */
+static int randomVictim()
+{
+	int victim = rand_r(&WS_seed) % (WS_size - 1);
+	return victim >= WS_rank ? victim + 1 : victim;
+}
+
+static void idleWait()
+{
+	struct timespec interval;
+	interval.tv_sec = 0;
+	interval.tv_nsec = (long)(WS_PollInterval * 1e9);
+	nanosleep(&interval, NULL);
+}
+
+static void pushTask(int payload, char queued, double queuedAt)
+{
+	if (WS_dequeSize == WS_dequeCapacity)
+	{
+		// 扩容时把环形缓冲区展开到新数组的开头
+		int capacity = WS_dequeCapacity > 0 ? 2 * WS_dequeCapacity : 64, i;
+		struct WS_Task *deque = (struct WS_Task *)malloc(sizeof(struct WS_Task) * capacity);
+		for (i = 0; i < WS_dequeSize; i++)
+			deque[i] = WS_deque[(WS_dequeTop + i) % WS_dequeCapacity];
+		free(WS_deque);
+		WS_deque = deque;
+		WS_dequeCapacity = capacity;
+		WS_dequeTop = 0;
+	}
+	struct WS_Task *task = &WS_deque[(WS_dequeTop + WS_dequeSize) % WS_dequeCapacity];
+	task->payload = payload;
+	task->queued = queued;
+	task->queuedAt = queuedAt;
+	WS_dequeSize++;
+	if (WS_dequeSize > WS_statistics.maxBacklogDepth)
+		WS_statistics.maxBacklogDepth = WS_dequeSize;
+}
+
+static int popTask(struct WS_Task *task)
+{
+	if (WS_dequeSize == 0)
+		return 0;
+	WS_dequeSize--;
+	*task = WS_deque[(WS_dequeTop + WS_dequeSize) % WS_dequeCapacity];
+	return 1;
+}
+
+static int takeOldestTask(struct WS_Task *task)
+{
+	if (WS_dequeSize == 0)
+		return 0;
+	*task = WS_deque[WS_dequeTop];
+	WS_dequeTop = (WS_dequeTop + 1) % WS_dequeCapacity;
+	WS_dequeSize--;
+	return 1;
+}
+
+/**
+ * Writes an error message to stderr and MPI Aborts
+ */
+static void errorMessage(char *message)
+{
+	fprintf(stderr, "%4d: [WorkStealing] %s\n", WS_rank, message);
+	MPI_Abort(MPI_COMM_WORLD, 1);
+}
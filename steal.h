@@ -0,0 +1,20 @@
+#ifndef STEAL_H_
+#define STEAL_H_
+
+#include "pool.h"
+
+// Work stealing scheduler behind the process pool API, selected with processPoolSetScheduler. Each call does what the
+// process pool call of the same name in pool.h does
+int stealingInit();
+void stealingFinalise();
+int stealingMasterPoll();
+int stealingWorkerSleep();
+int stealingShouldWorkerStop();
+void stealingProgress();
+int stealingStartWorkers(int, int *, const int *);
+int stealingIsBackpressured();
+void stealingShutdown();
+int stealingCommandData();
+void stealingStatistics(struct PP_Statistics *);
+
+#endif /* STEAL_H_ */
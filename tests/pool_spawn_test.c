@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "mpi.h"
+#include "pool.h"
+
+/*
+ * 弹性进程池的测试，pool.c以PP_ElasticSpawn打开、冷却时间很短的选项编译。第一个工作进程请求比MPI_COMM_WORLD中更多的
+ * 工作进程，主进程必须动态启动进程组来补足。这些进程完成工作后空闲超过冷却时间，主进程要把整个组停止并断开连接，
+ * 断开连接要等到被停止的进程也断开后才返回，所以统计中的退役数说明这些进程已经可以退出
+ */
+#define NUM_STARTS 6
+#define WORK_MICROSECONDS 200000
+#define WAIT_SECONDS 3
+
+int main(int argc, char *argv[])
+{
+    MPI_Init(&argc, &argv);
+    char *spawnArgv[] = {NULL};
+    processPoolSetSpawnCommand(argv[0], spawnArgv);
+    int failures = 0;
+    int status = processPoolInit();
+    if (status == 1)
+    {
+        int workerStatus = 1;
+        while (workerStatus)
+        {
+            if (getCommandData() == 0)
+            {
+                int payloads[NUM_STARTS], ranks[NUM_STARTS], i;
+                for (i = 0; i < NUM_STARTS; i++)
+                    payloads[i] = 1;
+                int started = startWorkerProcesses(NUM_STARTS, ranks, payloads);
+                if (started != NUM_STARTS)
+                {
+                    fprintf(stderr, "pool_spawn_test: started %d of %d workers\n", started, NUM_STARTS);
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+                // 等待动态启动的进程空闲超过冷却时间，主进程处理关闭命令时会检查并停止它们
+                sleep(WAIT_SECONDS);
+                shutdownPool();
+            }
+            else
+            {
+                usleep(WORK_MICROSECONDS);
+            }
+            workerStatus = workerSleep();
+        }
+    }
+    else if (status == 2)
+    {
+        int payload = 0, rank;
+        startWorkerProcesses(1, &rank, &payload);
+        while (masterPoll())
+            ;
+        struct PP_Statistics statistics;
+        getPoolStatistics(&statistics);
+        if (statistics.numSpawned == 0)
+        {
+            fprintf(stderr, "pool_spawn_test: the pool did not spawn any workers\n");
+            failures++;
+        }
+        if (statistics.numRetired != statistics.numSpawned)
+        {
+            fprintf(stderr, "pool_spawn_test: retired %ld of %ld spawned workers\n", statistics.numRetired, statistics.numSpawned);
+            failures++;
+        }
+        if (failures == 0)
+            printf("pool_spawn_test: spawned and retired %ld workers\n", statistics.numSpawned);
+    }
+    processPoolFinalise();
+    MPI_Finalize();
+    return failures > 0;
+}
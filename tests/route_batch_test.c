@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "mpi.h"
+#include "roadmap.h"
+#include "route.h"
+#include "code.h"
+#include "function.h"
+
+/*
+ * 批量回答下一跳查询，并与逐个调用planRoute的结果比较。批量中包括路口就是目的地的查询，
+ * 并且这样的查询排在同一目的地的其他查询之前，之后的查询仍然要为这个目的地建表
+ */
+static int checkBatch(struct RoutePlanner *planner, struct RouteSearch *search, struct RouteQuery *queries, int numQueries)
+{
+    planNextJunctions(planner, queries, numQueries);
+    int failures = 0;
+    for (int i = 0; i < numQueries; i++)
+    {
+        int expected = queries[i].junction == queries[i].dest ? -1 : planRoute(queries[i].junction, queries[i].dest, planner->topology, NULL, search);
+        if (queries[i].next != expected)
+        {
+            fprintf(stderr, "route_batch_test: query %d -> %d answered %d, expected %d\n", queries[i].junction, queries[i].dest, queries[i].next, expected);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Error: You need to provide the text roadmap file as the only argument\n");
+        return 1;
+    }
+    struct RoadTopology topology;
+    parseRoadTopology(argv[1], &topology);
+    struct RoutePlanner planner;
+    initRoutePlanner(&planner, &topology, NULL);
+    struct RouteSearch search;
+    initRouteSearch(&search, topology.num_junctions);
+
+    // 第一个查询已经在目的地，目的地5在它之后还有需要表的查询
+    struct RouteQuery atDestFirst[] = {{5, 5, NULL, 0}, {6, 5, NULL, 0}, {0, 5, NULL, 0}, {8, 5, NULL, 0}};
+    int failures = checkBatch(&planner, &search, atDestFirst, 4);
+
+    // 所有路口到所有目的地，包括不连通的路口和每个路口到自己
+    int numQueries = topology.num_junctions * topology.num_junctions;
+    struct RouteQuery *queries = (struct RouteQuery *)malloc(sizeof(struct RouteQuery) * numQueries);
+    for (int i = 0; i < numQueries; i++)
+    {
+        queries[i].junction = i % topology.num_junctions;
+        queries[i].dest = i / topology.num_junctions;
+        queries[i].speeds = NULL;
+    }
+    failures += checkBatch(&planner, &search, queries, numQueries);
+
+    free(queries);
+    freeRouteSearch(&search);
+    freeRoutePlanner(&planner);
+    freeRoadTopology(&topology);
+    if (failures > 0)
+        return 1;
+    printf("route_batch_test: ok\n");
+    return 0;
+}
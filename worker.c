@@ -7,15 +7,80 @@
 #include <time.h>
 #include "pool.h"
 #include "mpi.h"
+#include "roadmap.h"
+#include "route.h"
 #include "code.h"
 #include "comm.h"
 #include "function.h"
 #include "worker.h"
 
+static void setRandomVehicleType(struct VehicleStruct *);
+
 /**
- * Activates a vehicle and sets its type and route randomly
+ * Activates a number of vehicles with random types and routes. The routes are drawn for all of the vehicles at
+ * once and checked to be viable with a single batch of route queries, redrawing those without a route until
+ * every vehicle has one. The queries live in the actor's scratch space, which must hold this many vehicles
  **/
-void activateRandomVehicle(struct VehicleStruct *vehicle, int num_junctions, struct JunctionStruct *roadMap)
+void activateRandomVehicles(struct VehicleStruct *vehicles, int num_vehicles, struct RoutePlanner *planner, struct VehicleScratch *scratch)
+{
+    int num_junctions = planner->topology->num_junctions;
+    for (int i = 0; i < num_vehicles; i++)
+    {
+        setRandomVehicleType(&vehicles[i]);
+    }
+
+    // 为所有车辆抽取起始地和目的地，批量检查从 source 到 dest 是否有路，没有路的车辆重新抽取
+    struct RouteQuery *queries = scratch->queries;
+    int *pending = scratch->vehicleIndex;
+    int num_pending = num_vehicles;
+    for (int i = 0; i < num_vehicles; i++)
+    {
+        pending[i] = i;
+    }
+    while (num_pending > 0)
+    {
+        for (int i = 0; i < num_pending; i++)
+        {
+            struct VehicleStruct *vehicle = &vehicles[pending[i]];
+            // Ensure that the source and destination are different
+            vehicle->source = vehicle->dest = getRandomInteger(0, num_junctions);
+            while (vehicle->dest == vehicle->source)
+            {
+                vehicle->dest = getRandomInteger(0, num_junctions);
+            }
+            queries[i].junction = vehicle->source;
+            queries[i].dest = vehicle->dest;
+            queries[i].speeds = NULL;
+        }
+        // See if there is a viable route between each source and destination
+        planNextJunctions(planner, queries, num_pending);
+        int num_failed = 0;
+        for (int i = 0; i < num_pending; i++)
+        {
+            if (queries[i].next == -1)
+                pending[num_failed++] = pending[i];
+        }
+        num_pending = num_failed;
+    }
+
+    for (int i = 0; i < num_vehicles; i++)
+    {
+        // 设置所在路口和道路
+        vehicles[i].currentJunction = vehicles[i].source;
+        vehicles[i].roadOn = -1;
+        vehicles[i].plannedRoad = -1;
+
+        /**
+         * vehicle向control发送统计信息
+         */
+        sendControlMessage(&vehicles[i], NEW_VEHICLE);
+    }
+}
+
+/**
+ * Sets the vehicle's type randomly along with the maximum speed, passengers and fuel of that type
+ **/
+static void setRandomVehicleType(struct VehicleStruct *vehicle)
 {
     int random_vehicle_type = getRandomInteger(0, 5);
     enum VehicleType vehicleType;
@@ -51,27 +116,6 @@ void activateRandomVehicle(struct VehicleStruct *vehicle, int num_junctions, str
     vehicle->speed = 0;
     vehicle->remaining_distance = 0;
     vehicle->arrived_road_time = 0;
-    // 设置起始地和目的地
-    vehicle->source = vehicle->dest = getRandomInteger(0, num_junctions);
-    while (vehicle->dest == vehicle->source)
-    {
-        // Ensure that the source and destination are different
-        vehicle->dest = getRandomInteger(0, num_junctions);
-        // 确保从 source 到 dest 有路
-        if (vehicle->dest != vehicle->source)
-        {
-            // See if there is a viable route between the source and destination
-            int next_jnct = planRoute(vehicle->source, vehicle->dest, num_junctions, roadMap);
-            if (next_jnct == -1)
-            {
-                // Regenerate source and dest
-                vehicle->source = vehicle->dest = getRandomInteger(0, num_junctions);
-            }
-        }
-    }
-    // 设置所在路口和道路
-    vehicle->currentJunction = &roadMap[vehicle->source];
-    vehicle->roadOn = NULL;
     // 设置交通工具的最大速度、乘客数量和燃油
     if (vehicleType == CAR)
     {
@@ -113,17 +157,17 @@ void activateRandomVehicle(struct VehicleStruct *vehicle, int num_junctions, str
     {
         fprintf(stderr, "Unknown vehicle type\n");
     }
-
-    /**
-     * vehicle向control发送统计信息
-     */
-    sendControlMessage(vehicle, NEW_VEHICLE);
 }
 
 void createInitialActor(int type)
 {
-    int data[1];
-    int workerPid = startWorkerProcess();
-    data[0] = type;
-    MPI_Bsend(data, 1, MPI_INT, workerPid, 0, MPI_COMM_WORLD);
+    // 演员类型随唤醒命令一起发送
+    int workerPid;
+    startWorkerProcesses(1, &workerPid, &type);
+    if (workerPid == -1)
+    {
+        // 初始演员不能排队等待，否则其他演员会向还没有启动的rank发送消息
+        fprintf(stderr, "Error: No more processes available for initial actor of type %d, run with more MPI processes\n", type);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
 }
\ No newline at end of file
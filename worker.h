@@ -1,2 +1,6 @@
-void activateRandomVehicle(struct VehicleStruct *, int, struct JunctionStruct *);
+struct VehicleStruct;
+struct RoutePlanner;
+struct VehicleScratch;
+
+void activateRandomVehicles(struct VehicleStruct *, int, struct RoutePlanner *, struct VehicleScratch *);
 void createInitialActor(int);